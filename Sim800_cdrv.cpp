@@ -19,37 +19,365 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "Sim800_cdrv.h"
-
-#include <SPIFFS.h>
-#include <Arduino.h>
-#include <esp_task_wdt.h>
+#include "Sim800_port.h"
 
 /* Private define ------------------------------------------------------------*/
+#define SIM800_RX_RING_MASK                     (SIM800_RX_RING_SIZE - 1)
+#define SIM800_URC_TABLE_MASK                   (SIM800_URC_TABLE_SIZE - 1)
+#define SIM800_SMS_TICKET_TABLE_MASK            (SIM800_SMS_TICKET_TABLE_SIZE - 1)
+
+static_assert((SIM800_RX_RING_SIZE & SIM800_RX_RING_MASK) == 0, "SIM800_RX_RING_SIZE must be a power of two");
+static_assert(SIM800_RX_RING_SIZE <= 0x8000, "SIM800_RX_RING_SIZE must fit the 16-bit ring indexes");
+static_assert((SIM800_URC_TABLE_SIZE & SIM800_URC_TABLE_MASK) == 0, "SIM800_URC_TABLE_SIZE must be a power of two");
+static_assert((SIM800_SMS_TICKET_TABLE_SIZE & SIM800_SMS_TICKET_TABLE_MASK) == 0, "SIM800_SMS_TICKET_TABLE_SIZE must be a power of two");
+static_assert(SIM800_SMS_TICKET_TABLE_SIZE > SIM800_SMS_QUEUE_SIZE, "every queued message needs a ticket entry");
+static_assert(sizeof(sSmsTicket) <= 6, "a ticket entry holds no pointers, the callback is kept per payload slot");
+
+#define QUEUE_LOG_FLAG_BROADCAST                0x01
+#define QUEUE_LOG_TEXT_OFFSET                   (2 + SIM800_PHONE_BCD_LEN)  /* priority, flags, number */
+
+static_assert(SIM800_INBOX_CONCAT_PARTS <= 8, "the parts received are one bit each");
+static_assert(SIM800_INBOX_BODY_SIZE >= SIM800_RX_LINE_MAX_LEN, "a single part body must fit the inbox body");
+static_assert(SIM800_INBOX_PART_MAX_LEN <= 0xFF, "the kept length of a part is one byte");
+
+static_assert(QUEUE_LOG_TEXT_OFFSET + SIM800_SMS_TEXT_MAX_LEN <= SIM800_WAL_RECORD_MAX_LEN,
+              "a queued message must fit one log record");
 /* Private macro -------------------------------------------------------------*/
-#define fNotifyEventCommand_() \
-	if(Sim800._pfCommandEvent != NULL) { \
-		Sim800._pfCommandEvent(&(Sim800._args)); \
-	}
 
 /* Private typedef -----------------------------------------------------------*/
+typedef enum {
+
+  eAT_FINAL_NONE = 0,
+  eAT_FINAL_OK,
+  eAT_FINAL_ERROR,
+  eAT_FINAL_CME_ERROR,
+  eAT_FINAL_CMS_ERROR,
+  eAT_FINAL_NO_CARRIER,
+  eAT_FINAL_BUSY,
+  eAT_FINAL_NO_ANSWER,
+  eAT_FINAL_NO_DIALTONE
+
+}eSim800AtFinal;
+
+/**
+ * @brief Records of the queue log
+ * 
+ */
+typedef enum {
+
+  eQUEUE_LOG_ENQUEUE = 1,   /* priority, flags, BCD number, UTF-8 text */
+  eQUEUE_LOG_SENT,          /* broadcast recipients sent so far, 16 bit */
+  eQUEUE_LOG_DONE           /* nothing more to send */
+
+}eSim800QueueLogRecord;
+
+/**
+ * @brief Records of the phonebook log, the ticket field is not used
+ * 
+ */
+typedef enum {
+
+  ePHONEBOOK_LOG_ADD = 1,   /* BCD number, flags; also a change of flags */
+  ePHONEBOOK_LOG_REMOVE     /* BCD number */
+
+}eSim800PhonebookLogRecord;
+
+/**
+ * @brief One comma separated field of a header line, quotes left out
+ * 
+ */
+typedef struct {
+
+  const char *p;
+
+  uint8_t Len;
+
+}sSmsField;
+
+/**
+ * @brief Concatenation header of an inbound part, Total 0 for a single message
+ * 
+ */
+typedef struct {
+
+  uint16_t Ref;
+
+  uint8_t Total;
+
+  uint8_t Part;             /* 1 based */
+
+}sSmsConcatInfo;
+
+/**
+ * @brief A word of an inbound command, matched whole and regardless of case
+ * 
+ */
+typedef struct {
+
+  const char *pWord;        /* lower case */
+
+  uint8_t Len;
+
+  eCommandType Command;     /* eNO_COMMAND for the on/off words */
+
+  eSim800Switch Switch;
+
+}sSmsKeyword;
+
+/**
+ * @brief A message the log still has to bring back
+ * 
+ */
+typedef struct {
+
+  uint16_t Ticket;
+
+  uint16_t Recipients;
+
+  uint16_t Record;          /* position of its ENQUEUE record in the log */
+
+}sQueueLogLive;
+
+/**
+ * @brief Both passes of a queue log compaction
+ * 
+ */
+typedef struct {
+
+  sQueueLogLive Live[SIM800_SMS_QUEUE_SIZE];
+
+  uint8_t Count;
+
+  uint16_t Record;
+
+  bool Replay;              /* queue the live messages again, after a reset */
+
+  bool Failed;              /* a record did not make it into the rewrite */
+
+  sSim800Wal Out;
+
+}sQueueLogScan;
+
+/**
+ * @brief One AT+CUSD exchange of the credit check
+ * 
+ */
+typedef struct {
+
+  const char *pCommand;
+
+  const char *pExpected;
+
+  bool Ussd;                /* answered by +CUSD after the OK */
+
+  bool Pause;               /* sent WAIT_FOR_USSD_MENU_MS after the step before */
+
+}sCreditStep;
+
+typedef struct {
+
+  bool Done;
+
+  uint32_t Credit;
+
+}sCreditWait;
+
 /* Private variables ---------------------------------------------------------*/
-const char* SavedPhoneNumbersPath = "/PhoneNumbers.json";
+const char* SavedPhoneNumbersPath = "/PhoneNumbers.json";   /* before the phonebook log, read once to migrate */
+const char* PhonebookLogPath = "/Phonebook.log";
+const char* PhonebookLogTmpPath = "/Phonebook.tmp";
+const char* SmsQueueLogPath = "/SmsQueue.log";
+const char* SmsQueueLogTmpPath = "/SmsQueue.tmp";
+
+// Deferred command events: pool slot indexes travel from EventFree to EventReady and back
+static SIM800_EVENT_QUEUE_T EventReady = NULL;
+static SIM800_EVENT_QUEUE_T EventFree = NULL;
+static SIM800_EVENT_QUEUE_STORAGE_T EventReadyStorage;
+static SIM800_EVENT_QUEUE_STORAGE_T EventFreeStorage;
+static uint8_t EventReadyBuffer[SIM800_EVENT_QUEUE_LEN];
+static uint8_t EventFreeBuffer[SIM800_EVENT_QUEUE_LEN];
+
+// Checked at compile time, so a keyword that can never match does not build
+static constexpr uint8_t fKeyword_Len(const char *pWord) {
+  return (*pWord == '\0') ? 0 : 1 + fKeyword_Len(pWord + 1);
+}
+
+static constexpr bool fKeyword_IsLower(const char *pWord) {
+  return (*pWord == '\0') ||
+         (((*pWord >= 'a' && *pWord <= 'z') || (uint8_t)*pWord >= 0x80) && fKeyword_IsLower(pWord + 1));
+}
+
+#define SMS_KEYWORD(word, command, sw)          { word, fKeyword_Len(word), command, sw }
+
+static constexpr sSmsKeyword SmsKeywords[] = {
+  SMS_KEYWORD(SYSTEM,   eSYSTEM_COMMAND,   eSWITCH_NONE),
+  SMS_KEYWORD(LAMP,     eLAMP_COMMAND,     eSWITCH_NONE),
+  SMS_KEYWORD(SMSIP,    eIP_COMMAND,       eSWITCH_NONE),
+  SMS_KEYWORD(ALARM,    eALARM_COMMAND,    eSWITCH_NONE),
+  SMS_KEYWORD(MONOXIDE, eMONIXIDE_COMMAND, eSWITCH_NONE),
+  SMS_KEYWORD(FIRE,     eFIRE_COMMAND,     eSWITCH_NONE),
+  SMS_KEYWORD(HUMIDITY, eHUMIDITY_COMMAND, eSWITCH_NONE),
+  SMS_KEYWORD(TEMP,     eTEMP_COMMAND,     eSWITCH_NONE),
+  SMS_KEYWORD(ON,       eNO_COMMAND,       eSWITCH_ON),
+  SMS_KEYWORD(OFF,      eNO_COMMAND,       eSWITCH_OFF),
+  SMS_KEYWORD(SYSTEM_FA,   eSYSTEM_COMMAND,   eSWITCH_NONE),
+  SMS_KEYWORD(LAMP_FA,     eLAMP_COMMAND,     eSWITCH_NONE),
+  SMS_KEYWORD(ALARM_FA,    eALARM_COMMAND,    eSWITCH_NONE),
+  SMS_KEYWORD(FIRE_FA,     eFIRE_COMMAND,     eSWITCH_NONE),
+  SMS_KEYWORD(HUMIDITY_FA, eHUMIDITY_COMMAND, eSWITCH_NONE),
+  SMS_KEYWORD(TEMP_FA,     eTEMP_COMMAND,     eSWITCH_NONE),
+  SMS_KEYWORD(ON_FA,       eNO_COMMAND,       eSWITCH_ON),
+  SMS_KEYWORD(OFF_FA,      eNO_COMMAND,       eSWITCH_OFF),
+};
+
+#define SMS_KEYWORD_COUNT                       (sizeof(SmsKeywords) / sizeof(SmsKeywords[0]))
+
+static constexpr bool fKeyword_TableValid(size_t Index) {
+  return (Index == SMS_KEYWORD_COUNT) ||
+         (SmsKeywords[Index].Len > 0 && fKeyword_IsLower(SmsKeywords[Index].pWord) && fKeyword_TableValid(Index + 1));
+}
+
+static constexpr uint8_t fKeyword_MaxLen(size_t Index) {
+  return (Index == SMS_KEYWORD_COUNT) ? 0 :
+         (SmsKeywords[Index].Len > fKeyword_MaxLen(Index + 1)) ? SmsKeywords[Index].Len : fKeyword_MaxLen(Index + 1);
+}
+
+static_assert(fKeyword_TableValid(0), "SMS keywords must be non-empty lower case or non-ASCII words");
+
+#define SMS_KEYWORD_MAX_LEN                     fKeyword_MaxLen(0)
+
+#define SMS_HEADER_MAX_FIELDS                   11    /* +CMGR with AT+CSDH=1 */
+#define SMS_FO_UDHI                             0x40
+#define SMS_ALPHABET_GSM7                       0x00  /* TP-DCS bits 3-2 */
+#define SMS_ALPHABET_8BIT                       0x04
+#define SMS_ALPHABET_UCS2                       0x08
+#define SMS_TIMESTAMP_LEN                       20    /* yy/MM/dd,hh:mm:ss+zz */
+
+static const char *const SmsStatNames[] = { "REC UNREAD", "REC READ", "STO UNSENT", "STO SENT" };
+
+// The operator menu: English, then the balance, then the session is closed
+static const sCreditStep CreditSteps[] = {
+  { "AT+CUSD=1",                ATOK,      false, false },
+  { "AT+CUSD=1,\"*555*4*3#\"",  "72",      true,  false },
+  { "AT+CUSD=1,\"2\"",          "English", true,  false },
+  { "AT+CUSD=1,\"*555*1*2#\"",  "Credit:", true,  true  },
+  { "AT+CUSD=0",                ATOK,      false, false },
+};
+
+#define CREDIT_STEP_COUNT                       (sizeof(CreditSteps) / sizeof(CreditSteps[0]))
+#define CREDIT_STEP_BALANCE                     3
 
 /* Private function prototypes -----------------------------------------------*/
-static sim800_res_t fLoadPhoneNumbers(String Path);
-static sim800_res_t fSavePhoneNumbers(String Path);
 static sim800_res_t fNormalizedPhoneNumber(String PhoneNumber, String *Normalized);
 static sim800_res_t fSendCommand(String Command, String DesiredResponse, String *pResponse = nullptr);
+static sim800_res_t fSendCommandEx(const sSim800Cmd *pCmd, String *pResponse);
+static void fCheckCredit_OnDone(sim800_res_t Result, uint32_t Credit, void *pCtx);
+static void fCredit_Process(void);
+static void fCredit_Submit(void);
+static void fCredit_OnStep(sim800_res_t Result, const char *pResponse, void *pCtx);
+static void fCredit_Finish(void);
+static uint32_t fCredit_Parse(const char *pResponse);
+static sim800_res_t fCmd_Submit(const sSim800Cmd *pCmd);
+static void fCmd_Process(void);
+static void fCmd_Step(void);
+static bool fCmd_Reentered(void);
+static void fCmd_HandleLine(const char *pLine);
+static void fCmd_Complete(sim800_res_t Result);
+static void fCmd_Transmit(void);
+static void fCmd_Retry(sim800_res_t Result);
+static bool fCmd_Matches(const sSim800Cmd *pCmd, const char *pLine);
+static eSim800AtFinal fAt_Classify(const char *pLine, uint16_t *pCode);
+static sim800_res_t fAt_FinalToResult(eSim800AtFinal Final, uint16_t Code);
+static bool fAt_IsTransient(sim800_res_t Result);
+static uint8_t fUrc_Hash(const char *pPrefix, uint8_t Len);
+static sim800_res_t fUrc_Register(const char *pPrefix, pfSim800UrcHandler pfHandler, void *pCtx, bool Replace);
+static bool fUrc_Dispatch(const char *pLine);
+static void fUrc_OnDeliveryReport(const char *pLine, void *pCtx);
+static void fUrc_OnNewMessage(const char *pLine, void *pCtx);
+static void fUrc_OnModemEvent(const char *pLine, void *pCtx);
+static void fUrc_OnModemReset(const char *pLine, void *pCtx);
+static void fRx_Fill(void);
+static bool fRx_NextLine(const char **ppLine);
+static bool fRx_PromptDue(void);
 static sim800_res_t fGSM_Init(void);
+static const char *fCfg_Desired(eSim800Setting Setting);
+static void fCfg_Invalidate(void);
+static void fCfg_Sync(void(*pfDone)(sim800_res_t Result));
+static void fCfg_SyncDone(void);
+static void fCfg_OnSync(sim800_res_t Result, const char *pResponse, void *pCtx);
 static sim800_res_t fInbox_Read(void);
 static sim800_res_t fInbox_Clear(void);
-static sim800_res_t fRecivedSms_Parse(const String *pLine);
+static void fInbox_OnLine(const char *pLine, void *pCtx);
+static void fInbox_OnReadDone(sim800_res_t Result, const char *pResponse, void *pCtx);
+static void fInbox_OnListDone(sim800_res_t Result, const char *pResponse, void *pCtx);
+static bool fInbox_UseTextMode(void);
+static const char *fInbox_DecodeBody(const char *pLine, const sSim800SmsHeader *pHeader, sSmsConcatInfo *pConcat);
+static uint8_t fInbox_Alphabet(uint8_t Dcs);
+static uint8_t fInbox_UserDataHeader(const char *pHex, uint16_t Len, sSmsConcatInfo *pConcat);
+static const char *fConcat_Add(const sSmsConcatInfo *pInfo, const uint8_t *pNumber, const char *pText);
+static void fConcat_Expire(void);
+static sim800_res_t fEvent_Add(eCommandType Type, pfSim800CommandEvent pfHandler,
+                               void(*pfPlain)(sSim800RecievedMassgeDone *pArgs), void *pCtx);
+static void fEvent_Post(sSim800RecievedMassgeDone *pArgs);
+static void fEvent_Dispatch(sSim800RecievedMassgeDone *pArgs);
+static sim800_res_t fRecivedSms_Parse(const char *pLine);
+static sim800_res_t fSmsHeader_Parse(const char *pLine, sSim800SmsHeader *pHeader, const char **ppTime);
+static uint8_t fSmsHeader_Fields(const char *pLine, sSmsField *pFields, uint8_t Max);
+static bool fSmsHeader_Uint(const sSmsField *pField, uint32_t *pValue);
+static bool fSmsHeader_Number(const sSmsField *pField, uint8_t *pBcd);
+static uint32_t fSmsHeader_Time(const sSmsField *pField);
 static sim800_res_t fRecivedSms_CheckCommand(void);
-static sim800_res_t fCheckForDeliveryReport(void);
-static sim800_res_t fEnqueueMsg(String PhoneNumber, String Text);
-static sim800_res_t fDequeueMsg(sSmsMessage *msg);
-static sim800_res_t fSim800_SMSSend_Immediate(String PhoneNumber, String Text);
-static String fTextToHex(String text);
+static bool fCommand_Parse(const char *pText, sSim800RecievedMassgeDone *pArgs);
+static const sSmsKeyword *fCommand_Lookup(const char *pWord, uint8_t Len);
+static sim800_res_t fEnqueueMsg(const char *pNumber, const char *pText, uint16_t Len, eSim800SmsPriority Priority,
+                                uint16_t *pTicket);
+static sim800_res_t fDequeueMsg(uint8_t *pSlot, char *pNumber, uint8_t Size, eSim800SmsPriority *pPriority,
+                                uint16_t *pRecipient);
+static sim800_res_t fAllocMsg(const char *pText, uint16_t Len, eSim800SmsPriority Priority, uint8_t *pSlot);
+static sim800_res_t fEnqueueJob(const sSmsJob *pJob);
+static sSmsJobQueue *fPickJobQueue(void);
+static void fReleaseMsg(uint8_t Slot);
+static bool fPhonebook_At(uint16_t Index, char *pNumber, uint8_t Size);
+static bool fPhonebook_Find(const uint8_t *pBcd, uint16_t *pIndex);
+static const sSim800Contact *fPhonebook_Lookup(const char *pNumber);
+static sim800_res_t fPhonebook_Add(const char *pNumber, uint8_t Flags);
+static sim800_res_t fPhonebook_Remove(const char *pNumber);
+static void fPhonebookLog_Load(void);
+static sim800_res_t fPhonebookLog_Append(uint8_t Type, const char *pNumber);
+static sim800_res_t fPhonebookLog_Compact(void);
+static void fPhonebookLog_OnRecord(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx);
+static void fPhonebookLog_ImportJson(const char *pPath);
+static void fCall_BuildCommand(const char *pNormalized, sSim800Cmd *pCmd);
+static void fSmsTx_Process(void);
+static bool fSmsTx_BuildPdu(void);
+static void fSmsTx_OnSetupDone(sim800_res_t Result);
+static void fSmsTx_Submit(void);
+static void fSmsTx_Retry(sim800_res_t Result);
+static void fSmsTx_Finish(sim800_res_t Result);
+static void fSmsTx_OnSubmit(sim800_res_t Result, const char *pResponse, void *pCtx);
+static void fSmsTx_OnCall(sim800_res_t Result, const char *pResponse, void *pCtx);
+static void fSmsTx_WritePayload(void *pCtx);
+static bool fReport_Track(const char *pResponse);
+static void fReport_Match(uint8_t MessageRef, uint8_t Status);
+static void fReport_OnPdu(const char *pLine, void *pCtx);
+static void fReport_Expire(void);
+static bool fReport_Resend(void);
+static bool fReport_HasRoom(void);
+static uint16_t fTicket_Open(void);
+static sSmsTicket *fTicket_Find(uint16_t Id);
+static void fTicket_Phase(uint16_t Id, eSim800SmsStatus Status);
+static void fTicket_Outcome(uint16_t Id, eSim800SmsStatus Status);
+static uint8_t fTicket_Rank(uint8_t Status);
+static void fTicket_Close(uint8_t Slot);
+static void fQueueLog_Enqueue(const sSmsJob *pJob);
+static void fQueueLog_Sent(uint16_t Ticket, uint16_t Recipients);
+static void fQueueLog_Done(uint16_t Ticket);
+static void fQueueLog_Write(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, bool Flush);
+static void fQueueLog_Process(void);
+static bool fQueueLog_Compact(bool Replay);
+static void fQueueLog_OnLive(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx);
+static void fQueueLog_OnCopy(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx);
+static sim800_res_t fQueueLog_Restore(const uint8_t *pData, uint16_t Len, uint16_t Recipients, uint16_t *pTicket);
 
 /* Variables -----------------------------------------------------------------*/
 sSim800 Sim800;
@@ -66,26 +394,104 @@ sSim800 Sim800;
  */
 sim800_res_t fSim800_Init(void) {
 
+  if(fCmd_Reentered()) {
+    return SIM800_RES_ENGINE_BUSY;
+  }
 
   Sim800.Init = false;
   Sim800.IsSending = false;
   Sim800.CommandSendRetries = SIM800_COMMAND_ATTEMPTS;
   Sim800.QueueCount = 0;
-  Sim800.QueueHead = 0;
-  Sim800.QueueTail = 0;
+  for(uint8_t i = 0; i < eSMS_PRIORITY_COUNT; i++) {
+    Sim800.SmsJobs[i].Head = 0;
+    Sim800.SmsJobs[i].Tail = 0;
+    Sim800.SmsJobs[i].Count = 0;
+  }
+  Sim800.FreeCount = 0;
+  for(uint8_t i = 0; i < SIM800_SMS_QUEUE_SIZE; i++) {
+    Sim800.SmsQueue[SIM800_SMS_QUEUE_SIZE - 1 - i].RefCount = 1;
+    Sim800.SmsQueue[SIM800_SMS_QUEUE_SIZE - 1 - i].Ticket = 0;
+    fReleaseMsg(SIM800_SMS_QUEUE_SIZE - 1 - i);
+  }
+  Sim800.CmdEngine.Head = 0;
+  Sim800.CmdEngine.Tail = 0;
+  Sim800.CmdEngine.Count = 0;
+  Sim800.CmdEngine.State = eCMD_IDLE;
+  Sim800.CmdEngine.Processing = false;
+  Sim800.Running = false;
+  Sim800.Rx.Head = 0;
+  Sim800.Rx.Tail = 0;
+  Sim800.Rx.LineLen = 0;
+  Sim800.Rx.Truncated = false;
+  Sim800.SmsTx.State = eSMS_TX_IDLE;
+  Sim800.Credit.Busy = false;
+  for(uint8_t i = 0; i < SIM800_SMS_INFLIGHT_SIZE; i++) {
+    Sim800.InFlight[i].State = eREPORT_FREE;
+  }
+  Sim800.pfUrcBody = NULL;
+  for(uint8_t i = 0; i < SIM800_SMS_TICKET_TABLE_SIZE; i++) {
+    Sim800.Tickets[i].Id = 0;
+  }
+  Sim800.NextTicket = 0;
+  Sim800.QueueLog.pPath = NULL;
+  Sim800.Inbox.State = SMS_IDLE;
+  Sim800.Inbox.PendingHead = 0;
+  Sim800.Inbox.PendingCount = 0;
+  Sim800.Inbox.Busy = false;
+  for(uint8_t i = 0; i < SIM800_INBOX_CONCAT_SLOTS; i++) {
+    Sim800.Inbox.Concat[i].Used = false;
+  }
+  Sim800.Config.PduMode = false;
+  Sim800.Config.Syncing = false;
+  Sim800.Config.Resync = false;
+  fCfg_Invalidate();
+
+  // Built-in handlers do not replace the ones the application registered before init
+  fUrc_Register("+CDS", fUrc_OnDeliveryReport, NULL, false);
+  fUrc_Register("+CMTI", fUrc_OnNewMessage, NULL, false);
+  for(const char *pEvent : { "RING", "NO CARRIER", "+CUSD", "+CPIN", "Call Ready", "SMS Ready",
+                             "UNDER-VOLTAGE WARNNING", "OVER-VOLTAGE WARNNING" }) {
+    fUrc_Register(pEvent, fUrc_OnModemEvent, NULL, false);
+  }
+  for(const char *pEvent : { "RDY", "+CFUN", "NORMAL POWER DOWN", "UNDER-VOLTAGE POWER DOWN",
+                             "OVER-VOLTAGE POWER DOWN" }) {
+    fUrc_Register(pEvent, fUrc_OnModemReset, NULL, false);
+  }
 
-  if(!SPIFFS.begin(true)) {
+  if(!SIM800_FS.begin(true)) {
     Serial.println("SPIFFS Mount Failed!");
     return SIM800_RES_INIT_FAIL;
   }
 
-  if(fLoadPhoneNumbers(SavedPhoneNumbersPath) != SIM800_RES_OK) {
-    return SIM800_RES_LOAD_JSON_FIAL;
+  fPhonebookLog_Load();
+
+  // Created once, a re-init keeps the queues and what is still in them
+  if(Sim800.DeferEvents && EventReady == NULL) {
+    EventReady = SIM800_EVENT_QUEUE_CREATE(SIM800_EVENT_QUEUE_LEN, EventReadyBuffer, &EventReadyStorage);
+    EventFree = SIM800_EVENT_QUEUE_CREATE(SIM800_EVENT_QUEUE_LEN, EventFreeBuffer, &EventFreeStorage);
+    for(uint8_t i = 0; i < SIM800_EVENT_QUEUE_LEN; i++) {
+      sSmsData *pData = &Sim800.EventPool[i].MassageData;
+      pData->phoneNumber.reserve(SIM800_PHONE_MAX_DIGITS);
+      pData->dateTime.reserve(SMS_TIMESTAMP_LEN);
+      pData->Massage.reserve(SIM800_INBOX_BODY_SIZE - 1);
+      (void)SIM800_EVENT_QUEUE_SEND(EventFree, &i);
+    }
+  }
+
+  if(Sim800.PersistQueue) {
+    fWal_Open(&Sim800.QueueLog, SmsQueueLogPath, SmsQueueLogTmpPath);
+    fQueueLog_Compact(true); // what was queued before the reset goes out again
   }
 
-  if(fGSM_Init() != SIM800_RES_OK) {
+  sim800_res_t gsmResult = fGSM_Init();
+  if(gsmResult != SIM800_RES_OK) {
 
     Sim800.IsSending = false;
+    // SIM problems need a different fix than a silent modem, report them as they are
+    if(gsmResult == SIM800_RES_SIMCARD_NOT_INSERTED || gsmResult == SIM800_RES_SIM_PIN_REQUIRED ||
+       gsmResult == SIM800_RES_SIM_FAILURE) {
+      return gsmResult;
+    }
     return SIM800_RES_INIT_GSM_FAIL;
   }
 
@@ -96,112 +502,60 @@ sim800_res_t fSim800_Init(void) {
 }
 
 /**
- * @brief 
+ * @brief Advances the command engine and the SMS sender by one step, never blocks
  * 
  * @param me 
  */
 void fSim800_Run(void) {
 
-  if(!Sim800.Init || Sim800.IsSending) return;
-
-  sSmsMessage msg;
-  if(fDequeueMsg(&msg) == SIM800_RES_OK) {
-
-    sim800_res_t result = fSim800_SMSSend_Immediate(msg.PhoneNumber, msg.Text);
+  // Called again from one of its own callbacks, the outer call is still working
+  if(!Sim800.Init || Sim800.Running) return;
 
-    Sim800.IsSending = false;
-    if (result == SIM800_RES_OK) {
-
-      Serial.println("SMS sent successfully.");
-
-    } else {
+  Sim800.Running = true;
 
-      Serial.printf("Failed to send SMS to %s (err=%d).\n", msg.PhoneNumber.c_str(), result);
-      if(Sim800.EnableDeliveryReport) {
+  fCmd_Process();
+  fInbox_Read();
+  fConcat_Expire();
 
-        Serial.println("All SMS retries failed");
-        if(fSim800_Call(msg.PhoneNumber) != SIM800_RES_CALL_INITIAL_FAILD) {
-          
-          Serial.println("ReEnqueue massage...");
-          fEnqueueMsg(msg.PhoneNumber, msg.Text);
-        }        
-      }
-    }
-    return; // only handle one per Run cycle to avoid WDT
+  // The modem restarted with its defaults, restore them before new messages go unannounced
+  if(Sim800.Config.Resync && !Sim800.Config.Syncing && Sim800.SmsTx.State == eSMS_TX_IDLE) {
+    Sim800.Config.Resync = false;
+    fCfg_Sync(NULL);
   }
 
-  Sim800.IsSending = false;
+  fSmsTx_Process();
+  fCredit_Process();
+  fQueueLog_Process();
+
+  Sim800.Running = false;
 }
 
+/**
+ * @brief Sweeps messages that arrived without a +CMTI (before AT+CNMI took effect).
+ *        Not needed for normal operation, new messages are read as they are announced.
+ *        Listed messages are handled as their lines arrive and deleted in one batch.
+ * 
+ */
 void fSim800_CheckInbox() {
 
-  Serial.println("checking inbox...");
-
-  Sim800.IsSending = true;
-  Sim800.ComPort->println("AT+CMGL=\"REC UNREAD\"");
-  Sim800.IsSending = false;
-
-  unsigned long startTime = millis();
-  eSmsState state = SMS_IDLE;
-  int pendingDeleteIndex = -1;
-
-  while(millis() - startTime < WAIT_FOR_COMMAND_RESPONSE_MS) {
-
-    esp_task_wdt_reset();
-    if(Sim800.ComPort->available() > 0) {
-
-      String line = Sim800.ComPort->readStringUntil('\n');
-      line.trim();
-      if(line.length() == 0) continue;
-
-      if (line == "OK") {
-        break; // end of listing
-      }
-
-      if(line.startsWith("+CMGL:")) {
-
-        Serial.print("parsing line: ");Serial.println(line);
-
-        if(fRecivedSms_Parse(&line) == SIM800_RES_OK) {
-          state = SMS_BODY;//next lines are body
-        }else {
-          state = SMS_IDLE;
-        }
-
-      } else if(state == SMS_BODY) {
-
-        Serial.println("----------New massage-----------");
-        Serial.println(line);
-        // This is SMS body
-        Sim800._args.MassageData.Massage = line;
-
-        Serial.printf("SMS (index %d) from %s : %s\n",
-          Sim800._args.MassageData.index,
-          Sim800._args.MassageData.phoneNumber,
-          Sim800._args.MassageData.Massage.c_str()
-        );
-
-        // process SMS
-        fRecivedSms_CheckCommand();
+  if(Sim800.Inbox.Busy || !fInbox_UseTextMode()) return;
 
-        // mark for deletion
-        pendingDeleteIndex = Sim800._args.MassageData.index;
-
-        state = SMS_IDLE;
-      }
-    }
-    vTaskDelay(1);
-  }
-
-  // Delete after finishing loop
-  if (pendingDeleteIndex >= 0) {
+  Serial.println("checking inbox...");
 
-    Serial.printf("deleting massage index %d\n", pendingDeleteIndex);
-    String deleteCmd = "AT+CMGD=" + String(pendingDeleteIndex) + ",0";
-    fSendCommand(deleteCmd, "OK");
+  sSim800Cmd cmd = {};
+  strncpy(cmd.Command, CHECK_UNREAD_MSG, sizeof(cmd.Command) - 1);
+  strncpy(cmd.Expected, ATOK, sizeof(cmd.Expected) - 1);
+  cmd.TimeoutMs = WAIT_FOR_COMMAND_RESPONSE_MS;
+  cmd.Attempts = 1;
+  cmd.pfLine = fInbox_OnLine;
+  cmd.pfDone = fInbox_OnListDone;
+
+  Sim800.Inbox.State = SMS_IDLE;
+  Sim800.Inbox.Index = -1;
+  Sim800.Inbox.Handled = 0;
+  if(fCmd_Submit(&cmd) == SIM800_RES_OK) {
+    Sim800.Inbox.Busy = true;
   }
-  
-  Sim800.IsSending = false;
 }
 
 /**
@@ -223,10 +577,12 @@ sim800_res_t fSim800_AddPhoneNumber(String PhoneNumber, bool IsAdmin) {
     return SIM800_RES_PHONENUMBER_INVALID;
   }
 
-  Sim800.SavedPhoneNumbers[NormalizedPhoneNumber] = IsAdmin? 1 : 0;
-  fSavePhoneNumbers(SavedPhoneNumbersPath);
+  sim800_res_t result = fPhonebook_Add(NormalizedPhoneNumber.c_str(), IsAdmin ? SIM800_CONTACT_ADMIN : 0);
+  if(result != SIM800_RES_OK) {
+    return result;
+  }
 
-  return SIM800_RES_OK;
+  return fPhonebookLog_Append(ePHONEBOOK_LOG_ADD, NormalizedPhoneNumber.c_str());
 }
 
 /**
@@ -247,14 +603,11 @@ sim800_res_t fSim800_RemovePhoneNumber(String PhoneNumber) {
     return SIM800_RES_PHONENUMBER_INVALID;
   }
 
-  if (!Sim800.SavedPhoneNumbers.containsKey(NormalizedPhoneNumber)) {
+  if (fPhonebook_Remove(NormalizedPhoneNumber.c_str()) != SIM800_RES_OK) {
     return SIM800_RES_PHONENUMBER_NOT_FOUND;
   }
 
-  Sim800.SavedPhoneNumbers.remove(NormalizedPhoneNumber);
-  fSavePhoneNumbers(SavedPhoneNumbersPath);
-
-  return SIM800_RES_OK;
+  return fPhonebookLog_Append(ePHONEBOOK_LOG_REMOVE, NormalizedPhoneNumber.c_str());
 }
 
 /**
@@ -270,135 +623,182 @@ sim800_res_t fSim800_RemoveAllPhoneNumbers(void) {
     return SIM800_RES_INIT_FAIL;
   }
 
-  Sim800.SavedPhoneNumbers.clear();
-  fSavePhoneNumbers(SavedPhoneNumbersPath);
+  Sim800.Phonebook.Count = 0;
 
-  return SIM800_RES_OK;
+  return fPhonebookLog_Compact();
 }
 
 /**
  * @brief 
  * 
+ * @param phoneNumber 
+ * @param message 
  * @return sim800_res_t 
  */
-static sim800_res_t fCheckForDeliveryReport(void) {
-
-  unsigned long startTime = millis();
-
-  while (millis() - startTime < WAIT_FOR_SIM800_SEND_SMS_DELIVERY) {
-    
-    esp_task_wdt_reset();
-    if(Sim800.ComPort->available()) {
+sim800_res_t fSim800_SMSSend(String phoneNumber, String message) {
 
-      Serial.println("wait for delivery report...");
-      String incomingData = Sim800.ComPort->readString();
-      if (incomingData.indexOf("+CDS:") != -1) {
-        Serial.println("delivery report reviceved");
-        return SIM800_RES_OK;
-      }
-    }
-    vTaskDelay(pdMS_TO_TICKS(50));
-  }
-  return SIM800_RES_DELIVERY_REPORT_FAIL;
+  return fSim800_SMSSendEx(phoneNumber, message, eSMS_PRIORITY_NORMAL, NULL);
 }
 
 /**
- * @brief 
+ * @brief Queues a message in a priority class, an alarm goes out before anything
+ *        queued as normal or low
  * 
  * @param phoneNumber 
  * @param message 
+ * @param Priority 
+ * @param pTicket NULL, or gets the ticket for fSim800_SMSStatus and fSim800_SMSOnDone
  * @return sim800_res_t 
  */
-sim800_res_t fSim800_SMSSend(String phoneNumber, String message) {
+sim800_res_t fSim800_SMSSendEx(String phoneNumber, String message, eSim800SmsPriority Priority, uint16_t *pTicket) {
 
   if(!Sim800.Init) return SIM800_RES_INIT_FAIL;
 
-  message = fTextToHex(message);    
+  if(Priority >= eSMS_PRIORITY_COUNT) Priority = eSMS_PRIORITY_NORMAL;
 
-  if(!fEnqueueMsg(phoneNumber, message)) {
-    return SIM800_RES_ENQUEUE_FAIL;
+  String number;
+  if(fNormalizedPhoneNumber(phoneNumber, &number) != SIM800_RES_OK) {
+    return SIM800_RES_PHONENUMBER_INVALID;
+  }
+
+  sim800_res_t res = fEnqueueMsg(number.c_str(), message.c_str(), message.length(), Priority, pTicket);
+  if(res != SIM800_RES_OK) {
+    return res;
   }
 
   return SIM800_RES_OK; // will send later in Run
 }
 
 /**
- * @brief 
+ * @brief Queues one broadcast job: the text is stored once and the sender walks the
+ *        phonebook, so any number of contacts takes one slot and one queue entry
  * 
- * @param me 
  * @param message 
  * @return sim800_res_t 
  */
 sim800_res_t fSim800_SMSSendToAll(String message) {
 
-  if(Sim800.SavedPhoneNumbers.size() == 0) {
-    Serial.println("No phone numbers in SavedPhoneNumbers");
+  return fSim800_SMSSendToAllEx(message, eSMS_PRIORITY_NORMAL, NULL);
+}
+
+/**
+ * @brief Broadcast in a priority class, an alarm broadcast reaches every contact
+ *        before normal traffic resumes
+ * 
+ * @param message 
+ * @param Priority 
+ * @param pTicket NULL, or gets one ticket for the whole broadcast
+ * @return sim800_res_t 
+ */
+sim800_res_t fSim800_SMSSendToAllEx(String message, eSim800SmsPriority Priority, uint16_t *pTicket) {
+
+  if(!Sim800.Init) return SIM800_RES_INIT_FAIL;
+
+  if(Sim800.Phonebook.Count == 0) {
+    Serial.println("No phone numbers in the phonebook");
     return SIM800_RES_PHONENUMBER_NOT_FOUND;
   }
 
-  JsonObject phoneNumbers = Sim800.SavedPhoneNumbers.as<JsonObject>();
-  for(JsonObject::iterator it = phoneNumbers.begin(); it != phoneNumbers.end(); ++it) {
-    
-    String phoneNumber = it->key().c_str();
-    fEnqueueMsg(phoneNumber, message);
+  if(Priority >= eSMS_PRIORITY_COUNT) Priority = eSMS_PRIORITY_NORMAL;
+
+  sSmsJob job = {};
+  job.Broadcast = true;
+  job.Cursor = 0;
+  job.Priority = Priority;
+
+  sim800_res_t res = fAllocMsg(message.c_str(), message.length(), Priority, &job.Slot);
+  if(res != SIM800_RES_OK) {
+    return res;
+  }
+
+  if(fEnqueueJob(&job) != SIM800_RES_OK) {
+    fReleaseMsg(job.Slot);
+    return SIM800_RES_ENQUEUE_FAIL;
   }
 
+  Sim800.SmsQueue[job.Slot].Ticket = fTicket_Open();
+  if(pTicket != NULL) *pTicket = Sim800.SmsQueue[job.Slot].Ticket;
+  fQueueLog_Enqueue(&job);
+
   return SIM800_RES_OK; // all queued
 }
 
 /**
- * @brief 
+ * @brief Where the message of a ticket is
  * 
- * @param PhoneNumber 
- * @return sim800_res_t 
+ * @param Ticket 
+ * @param pDone NULL, or set once the status is the final outcome
+ * @return eSim800SmsStatus eSMS_STATUS_UNKNOWN when the ticket is too old or never existed
  */
-sim800_res_t fSim800_Call(String phoneNumber) {
+eSim800SmsStatus fSim800_SMSStatus(uint16_t Ticket, bool *pDone) {
 
-  String PhoneNumber;
-  fNormalizedPhoneNumber(phoneNumber, &PhoneNumber);
-
-  Serial.println("Initiating call to " + PhoneNumber);
-  String phonenumber_call = "+98" + PhoneNumber.substring(1); // Adjust phone number format
-  String phonenumber_str = "ATD+ " + phonenumber_call + ";";
+  sSmsTicket *pTicket = fTicket_Find(Ticket);
 
-  Serial.println(phonenumber_str);
-  fSendCommand(phonenumber_str, ATOK); 
-  Sim800.IsSending = false;
+  if(pDone != NULL) *pDone = (pTicket != NULL && pTicket->Done);
 
-  // Wait for call response (e.g., OK or ERROR)
-  unsigned long callStartTime = millis();
-  bool callSuccess = false;
+  return (pTicket != NULL) ? (eSim800SmsStatus)pTicket->Status : eSMS_STATUS_UNKNOWN;
+}
 
-  while (millis() - callStartTime < WIAT_FOR_CALL_RESPONSE) { // 5-second timeout for call response
+/**
+ * @brief Calls pfDone from fSim800_Run when the message of the ticket is done,
+ *        right away when it already is
+ * 
+ * @param Ticket 
+ * @param pfDone 
+ * @param pCtx 
+ * @return sim800_res_t 
+ */
+sim800_res_t fSim800_SMSOnDone(uint16_t Ticket, pfSim800SmsDone pfDone, void *pCtx) {
 
-    esp_task_wdt_reset();
-    if (Sim800.ComPort->available()) {
+  sSmsTicket *pTicket = fTicket_Find(Ticket);
 
-      String response = Sim800.ComPort->readString();
-      printf("call requests response: %s\n", response);
+  if(pTicket == NULL) return SIM800_RES_TICKET_NOT_FOUND;
 
-      if(response.indexOf("OK") != -1) {
+  if(pTicket->Done) {
+    if(pfDone != NULL) pfDone(Ticket, (eSim800SmsStatus)pTicket->Status, pCtx);
+    return SIM800_RES_OK;
+  }
 
-        Serial.println("Call initiated successfully.");
-        callSuccess = true;
-        break;
+  // an open ticket still holds its payload slot, the callback is kept there
+  for(uint8_t i = 0; i < SIM800_SMS_QUEUE_SIZE; i++) {
+    if(Sim800.SmsQueue[i].RefCount > 0 && Sim800.SmsQueue[i].Ticket == Ticket) {
+      Sim800.TicketHooks[i].pfDone = pfDone;
+      Sim800.TicketHooks[i].pCtx = pCtx;
+      return SIM800_RES_OK;
+    }
+  }
 
-      } else if(response.indexOf("ERROR") != -1) {
+  return SIM800_RES_TICKET_NOT_FOUND;
+}
 
-        Serial.println("Call failed: ERROR response received.");
-        
-      } else if(response.indexOf("NO RESPONSE") != -1) {
+/**
+ * @brief 
+ * 
+ * @param PhoneNumber 
+ * @return sim800_res_t 
+ */
+sim800_res_t fSim800_Call(String phoneNumber) {
 
-        Serial.println("Call failed: No response");
-      }
-    }
+  String PhoneNumber;
+  if(fNormalizedPhoneNumber(phoneNumber, &PhoneNumber) != SIM800_RES_OK) {
+    return SIM800_RES_PHONENUMBER_INVALID;
   }
 
-  if (!callSuccess) {
+  Serial.println("Initiating call to " + PhoneNumber);
+
+  sSim800Cmd cmd = {};
+  fCall_BuildCommand(PhoneNumber.c_str(), &cmd);
+
+  sim800_res_t result = fSendCommandEx(&cmd, nullptr);
+  if(result == SIM800_RES_ENGINE_BUSY) {
+    return result;
+  }
+  if(result != SIM800_RES_OK) {
     Serial.println("Call failed: No valid response within timeout.");
     return SIM800_RES_CALL_INITIAL_FAILD;
   }
 
+  Serial.println("Call initiated successfully.");
   return SIM800_RES_OK;
 }
 
@@ -416,113 +816,316 @@ sim800_res_t fSim800_GetSimcardBalance(uint16_t *pBalance) {
 }
 
 /**
- * @brief 
+ * @brief Blocking form of fSim800_CheckCreditAsync
  * 
- * @return uint32_t 
+ * @return uint32_t credit in Toman, 0 when it could not be read
  */
 uint32_t fSim800_CheckCredit(void) {
 
-  fSendCommand("AT+CUSD=1", ATOK); 
-  fSendCommand("AT+CUSD=1,\"*555*4*3#\"", "72");
-  fSendCommand("AT+CUSD=1,\"2\"", "English"); 
-  //esp_task_wdt_reset();
-  delay(2000);
-  //esp_task_wdt_reset();
-  String balanceLine;
-  fSendCommand("AT+CUSD=1,\"*555*1*2#\"","Credit:", &balanceLine); 
-  fSendCommand("AT+CUSD=0",ATOK); 
-  //"CUSD: 0, \"On 1403/07/01.your balance is 687348 RialsA new generation of MyIrancell super app *45#\", 15␍";
-  int startIndex = balanceLine.indexOf("Credit:") + 7;
-  int endIndex   = balanceLine.indexOf("IRR");
-  String balanceStr = balanceLine.substring(startIndex, endIndex);
-  balanceStr.replace(",", "");
-  long balanceValue = balanceStr.toInt() / 10; //
-  Serial.printf(">>>>>>>>  balance is: %d\n", balanceValue);
-  return balanceValue;
-}
+  sCreditWait wait = { false, 0 };
 
-/**
- * @brief 
- * 
- * @return JsonDocument 
- */
-sim800_res_t fSim800_GetPhoneNumbers(JsonDocument *pDoc) {
+  // Waiting here from a callback would run the engine inside itself
+  if(fCmd_Reentered()) {
+    Serial.println("Credit check refused, blocking call from a driver callback.");
+    return 0;
+  }
 
-  pDoc->set(Sim800.SavedPhoneNumbers);
-  return SIM800_RES_OK;
-}
+  if(fSim800_CheckCreditAsync(fCheckCredit_OnDone, &wait) != SIM800_RES_OK) {
+    return 0;
+  }
 
-/**
- * @brief 
- * 
- * @param me 
- * @param fpFunc 
- * @return uint8_t 
- */
-sim800_res_t fSim800_RegisterCommandEvent(void(*fpFunc)(sSim800RecievedMassgeDone *pArgs)) {
-	
-	if(fpFunc == NULL) {
-    return SIM800_RES_INIT_FAIL;
+  while(!wait.Done) {
+
+    fCmd_Process();
+    fCredit_Process();
+    SIM800_WDT_RESET();
+    SIM800_YIELD();
   }
 
-	Sim800._pfCommandEvent = fpFunc;
-	
-	return SIM800_RES_OK;
+  Serial.printf(">>>>>>>>  balance is: %lu\n", (unsigned long)wait.Credit);
+  return wait.Credit;
 }
 
-
-/*
-╔═════════════════════════════════════════════════════════════════════════════════╗
-║                            ##### Private Functions #####                        ║
-╚═════════════════════════════════════════════════════════════════════════════════╝*/
 /**
- * @brief 
+ * @brief Starts the USSD dialogue that reads the credit and returns at once.
+ *        Every step is queued from the completion of the one before, the pause
+ *        the menu needs is waited out in fSim800_Run.
  * 
- * @param me 
- * @param Path 
- * @return sim800_res_t 
+ * @param pfDone called once with the credit, may be NULL
+ * @param pCtx passed back to pfDone
+ * @return sim800_res_t SIM800_RES_CREDIT_BUSY while another check runs
  */
-static sim800_res_t fSavePhoneNumbers(String Path) {
+sim800_res_t fSim800_CheckCreditAsync(pfSim800CreditDone pfDone, void *pCtx) {
 
-  File file = SPIFFS.open(Path, FILE_WRITE);
-  if(!file) {
-    return SIM800_RES_LOAD_JSON_FIAL;
-  }
+  sSim800Credit *pCredit = &Sim800.Credit;
 
-  serializeJson(Sim800.SavedPhoneNumbers, file);
-  file.close();
+  if(!Sim800.Init) return SIM800_RES_INIT_FAIL;
+
+  if(pCredit->Busy) return SIM800_RES_CREDIT_BUSY;
+
+  pCredit->Busy = true;
+  pCredit->Step = 0;
+  pCredit->Waiting = false;
+  pCredit->Result = SIM800_RES_CMD_TIMEOUT;
+  pCredit->Credit = 0;
+  pCredit->pfDone = pfDone;
+  pCredit->pCtx = pCtx;
+
+  fCredit_Submit();
+  if(!pCredit->Busy) {
+    return SIM800_RES_SEND_COMMAND_FAIL;   // pfDone was not called, the first step never went out
+  }
 
   return SIM800_RES_OK;
 }
 
 /**
- * @brief 
+ * @brief Exports the phonebook as { "09xxxxxxxxx": 1 for an admin, 0 otherwise }
  * 
- * @param JsonDoc 
- * @param Path 
+ * @param pDoc 
  * @return sim800_res_t 
  */
-static sim800_res_t fLoadPhoneNumbers(String Path) {
+sim800_res_t fSim800_GetPhoneNumbers(JsonDocument *pDoc) {
 
-  File file = SPIFFS.open(Path, FILE_READ);
-  if(!file) {
-    return SIM800_RES_LOAD_JSON_FIAL;
+  char number[SIM800_PHONE_MAX_DIGITS + 1];
+
+  pDoc->clear();
+  for(uint16_t i = 0; i < Sim800.Phonebook.Count; i++) {
+
+    const sSim800Contact *pContact = &Sim800.Phonebook.Entries[i];
+    fCodec_BcdUnpack(pContact->Number, sizeof(pContact->Number), number, sizeof(number));
+    (*pDoc)[number] = (pContact->Flags & SIM800_CONTACT_ADMIN) ? 1 : 0;
   }
-  deserializeJson(Sim800.SavedPhoneNumbers, file);
-  file.close();
 
   return SIM800_RES_OK;
 }
 
 /**
- * @brief 
+ * @brief Adds every number of a { "09xxxxxxxxx": 1 for an admin, 0 otherwise } document
+ *        and writes the phonebook to flash once at the end
  * 
- * @param PhoneNum 
- * @return String 
+ * @param pDoc 
+ * @param pImported numbers added or updated, may be NULL
+ * @return sim800_res_t the first failure, the numbers that could be added are kept
  */
-static sim800_res_t fNormalizedPhoneNumber(String PhoneNumber, String *Normalized) {
+sim800_res_t fSim800_ImportPhoneNumbers(JsonDocument *pDoc, uint16_t *pImported) {
 
-  if(PhoneNumber.length() == 11 && PhoneNumber.startsWith("0")) {
+  sim800_res_t result = SIM800_RES_OK;
+  uint16_t imported = 0;
+
+  if(!Sim800.Init) {
+    return SIM800_RES_INIT_FAIL;
+  }
+
+  for(JsonPair entry : pDoc->as<JsonObject>()) {
+
+    String NormalizedPhoneNumber;
+    sim800_res_t added = fNormalizedPhoneNumber(String(entry.key().c_str()), &NormalizedPhoneNumber);
+    if(added == SIM800_RES_OK) {
+      added = fPhonebook_Add(NormalizedPhoneNumber.c_str(), entry.value().as<int>() ? SIM800_CONTACT_ADMIN : 0);
+    } else {
+      added = SIM800_RES_PHONENUMBER_INVALID;
+    }
+
+    if(added == SIM800_RES_OK) {
+      imported++;
+    } else if(result == SIM800_RES_OK) {
+      result = added;
+    }
+  }
+
+  if(pImported != NULL) {
+    *pImported = imported;
+  }
+
+  if(imported > 0 && fPhonebookLog_Compact() != SIM800_RES_OK) {
+    return SIM800_RES_SAVE_JSON_FAIL;
+  }
+
+  return result;
+}
+
+/**
+ * @brief Adds a handler for one command type, eNO_COMMAND for every command.
+ *        The table has no lock: call this before the first fSim800_Run, or from
+ *        the task that runs the handlers, fSim800_DispatchEvents with
+ *        Sim800.DeferEvents set and fSim800_Run without it. A handler may call it.
+ * 
+ * @param Type 
+ * @param pfHandler 
+ * @param pCtx passed back to the handler
+ * @return sim800_res_t SIM800_RES_SUBSCRIBERS_FULL when the type has
+ *         SIM800_EVENT_SUBSCRIBERS handlers already
+ */
+sim800_res_t fSim800_Subscribe(eCommandType Type, pfSim800CommandEvent pfHandler, void *pCtx) {
+
+  if(pfHandler == NULL) {
+    return SIM800_RES_INIT_FAIL;
+  }
+
+  return fEvent_Add(Type, pfHandler, NULL, pCtx);
+}
+
+/**
+ * @brief Removes a handler added with fSim800_Subscribe with the same type,
+ *        function and context. Handlers of the Register functions stay. From the
+ *        same task as fSim800_Subscribe, once it returns the handler is not called.
+ * 
+ * @param Type 
+ * @param pfHandler 
+ * @param pCtx 
+ * @return sim800_res_t SIM800_RES_SUBSCRIBER_NOT_FOUND when there was no such handler
+ */
+sim800_res_t fSim800_Unsubscribe(eCommandType Type, pfSim800CommandEvent pfHandler, void *pCtx) {
+
+  if((unsigned)Type >= eCOMMAND_COUNT || pfHandler == NULL) {
+    return SIM800_RES_INIT_FAIL;
+  }
+
+  for(uint8_t i = 0; i < SIM800_EVENT_SUBSCRIBERS; i++) {
+
+    sSim800Subscriber *pSubscriber = &Sim800.Subscribers[Type][i];
+    if(pSubscriber->pfHandler == pfHandler && pSubscriber->pfPlain == NULL && pSubscriber->pCtx == pCtx) {
+      pSubscriber->pfHandler = NULL;
+      pSubscriber->pCtx = NULL;
+      return SIM800_RES_OK;
+    }
+  }
+
+  return SIM800_RES_SUBSCRIBER_NOT_FOUND;
+}
+
+/**
+ * @brief Runs the handlers of one deferred command. With Sim800.DeferEvents set
+ *        commands are queued instead of handled in fSim800_Run, call this from
+ *        the task that should run the handlers.
+ * 
+ * @param WaitMs how long to wait for a command
+ * @return true when a command was handled
+ */
+bool fSim800_DispatchEvents(uint32_t WaitMs) {
+
+  uint8_t slot;
+
+  if(EventReady == NULL || !SIM800_EVENT_QUEUE_RECEIVE(EventReady, &slot, WaitMs)) {
+    return false;
+  }
+
+  fEvent_Dispatch(&Sim800.EventPool[slot]);
+  (void)SIM800_EVENT_QUEUE_SEND(EventFree, &slot);
+
+  return true;
+}
+
+/**
+ * @brief Sets the handler of every command. It replaces the one set before, the
+ *        handlers added with fSim800_Subscribe stay.
+ * 
+ * @param fpFunc 
+ * @return sim800_res_t 
+ */
+sim800_res_t fSim800_RegisterCommandEvent(void(*fpFunc)(sSim800RecievedMassgeDone *pArgs)) {
+	
+	if(fpFunc == NULL) {
+    return SIM800_RES_INIT_FAIL;
+  }
+
+	return fEvent_Add(eNO_COMMAND, NULL, fpFunc, NULL);
+}
+
+sim800_res_t fSim800_RegisterLampEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e)) {
+
+  return (fpFunc == NULL) ? SIM800_RES_INIT_FAIL : fEvent_Add(eLAMP_COMMAND, NULL, fpFunc, NULL);
+}
+
+sim800_res_t fSim800_RegisterIpEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e)) {
+
+  return (fpFunc == NULL) ? SIM800_RES_INIT_FAIL : fEvent_Add(eIP_COMMAND, NULL, fpFunc, NULL);
+}
+
+sim800_res_t fSim800_RegisterAlarmEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e)) {
+
+  return (fpFunc == NULL) ? SIM800_RES_INIT_FAIL : fEvent_Add(eALARM_COMMAND, NULL, fpFunc, NULL);
+}
+
+sim800_res_t fSim800_RegisterMonixideEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e)) {
+
+  return (fpFunc == NULL) ? SIM800_RES_INIT_FAIL : fEvent_Add(eMONIXIDE_COMMAND, NULL, fpFunc, NULL);
+}
+
+sim800_res_t fSim800_RegisterFireEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e)) {
+
+  return (fpFunc == NULL) ? SIM800_RES_INIT_FAIL : fEvent_Add(eFIRE_COMMAND, NULL, fpFunc, NULL);
+}
+
+sim800_res_t fSim800_RegisterHumidityEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e)) {
+
+  return (fpFunc == NULL) ? SIM800_RES_INIT_FAIL : fEvent_Add(eHUMIDITY_COMMAND, NULL, fpFunc, NULL);
+}
+
+sim800_res_t fSim800_RegisterTempEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e)) {
+
+  return (fpFunc == NULL) ? SIM800_RES_INIT_FAIL : fEvent_Add(eTEMP_COMMAND, NULL, fpFunc, NULL);
+}
+
+/**
+ * @brief Queues an AT command and returns at once, pfDone is called from fSim800_Run.
+ *        The response line must start with pExpected, e.g. "+CSQ:".
+ * 
+ * @param pCommand 
+ * @param pExpected 
+ * @param TimeoutMs 
+ * @param pfDone 
+ * @param pCtx 
+ * @return sim800_res_t 
+ */
+sim800_res_t fSim800_SubmitCommand(const char *pCommand, const char *pExpected, uint32_t TimeoutMs,
+                                   pfSim800CmdDone pfDone, void *pCtx) {
+
+  if(pCommand == NULL || pExpected == NULL) {
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+
+  sSim800Cmd cmd = {};
+  strncpy(cmd.Command, pCommand, sizeof(cmd.Command) - 1);
+  strncpy(cmd.Expected, pExpected, sizeof(cmd.Expected) - 1);
+  cmd.TimeoutMs = TimeoutMs;
+  cmd.Attempts = Sim800.CommandSendRetries;
+  cmd.pfDone = pfDone;
+  cmd.pCtx = pCtx;
+
+  return fCmd_Submit(&cmd);
+}
+
+/**
+ * @brief Routes every unsolicited line starting with pPrefix (text before ':', or the
+ *        whole line for codes such as RING) to pfHandler. One handler per prefix, a
+ *        later registration replaces the earlier one. pPrefix must stay valid.
+ * 
+ * @param pPrefix 
+ * @param pfHandler 
+ * @param pCtx 
+ * @return sim800_res_t 
+ */
+sim800_res_t fSim800_RegisterUrcHandler(const char *pPrefix, pfSim800UrcHandler pfHandler, void *pCtx) {
+
+  return fUrc_Register(pPrefix, pfHandler, pCtx, true);
+}
+
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                            ##### Private Functions #####                        ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+/**
+ * @brief 
+ * 
+ * @param PhoneNum 
+ * @return String 
+ */
+static sim800_res_t fNormalizedPhoneNumber(String PhoneNumber, String *Normalized) {
+
+  if(PhoneNumber.length() == 11 && PhoneNumber.startsWith("0")) {
     *Normalized = PhoneNumber;
   } 
   else if(PhoneNumber.length() == 13 && PhoneNumber.startsWith("+")) {
@@ -531,448 +1134,3297 @@ static sim800_res_t fNormalizedPhoneNumber(String PhoneNumber, String *Normalize
     return SIM800_RES_PHONENUMBER_INVALID;
   }
 
-  return SIM800_RES_OK;
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief 
+ * 
+ * @param me 
+ * @param Command 
+ * @param DesiredResponse 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fSendCommand(String Command, String DesiredResponse, String *pResponse) {
+
+  sSim800Cmd cmd = {};
+  strncpy(cmd.Command, Command.c_str(), sizeof(cmd.Command) - 1);
+  strncpy(cmd.Expected, DesiredResponse.c_str(), sizeof(cmd.Expected) - 1);
+  cmd.TimeoutMs = WAIT_FOR_COMMAND_RESPONSE_MS;
+  cmd.Attempts = Sim800.CommandSendRetries;
+
+  return fSendCommandEx(&cmd, pResponse);
+}
+
+typedef struct {
+
+  bool Done;
+
+  sim800_res_t Result;
+
+  String *pResponse;
+
+}sSendCommandWait;
+
+static void fSendCommand_OnDone(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  sSendCommandWait *pWait = (sSendCommandWait *)pCtx;
+
+  if(Result == SIM800_RES_OK && pWait->pResponse != nullptr) {
+    *pWait->pResponse = pResponse;
+  }
+  pWait->Result = Result;
+  pWait->Done = true;
+}
+
+/**
+ * @brief Blocking wrapper over the command engine, used on init and by the synchronous API.
+ *        Yields to other tasks while waiting and keeps the engine running, so
+ *        commands queued by the SMS sender are still served in order.
+ * 
+ * @param pCmd 
+ * @param pResponse 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fSendCommandEx(const sSim800Cmd *pCmd, String *pResponse) {
+
+  Serial.printf("sending command: %s\n", pCmd->Command);
+  if (Sim800.ComPort == nullptr) {
+    Serial.println("ERROR: ComPort null!");
+    return SIM800_RES_INIT_FAIL;
+  }
+
+  // Waiting here from a callback would run the engine inside itself
+  if(fCmd_Reentered()) {
+    Serial.printf("Request %s : refused, blocking call from a driver callback.\n", pCmd->Command);
+    return SIM800_RES_ENGINE_BUSY;
+  }
+
+  sSendCommandWait wait = { false, SIM800_RES_SEND_COMMAND_FAIL, pResponse };
+
+  sSim800Cmd cmd = *pCmd;
+  cmd.pfDone = fSendCommand_OnDone;
+  cmd.pCtx = &wait;
+
+  if(fCmd_Submit(&cmd) != SIM800_RES_OK) {
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+
+  while(!wait.Done) {
+
+    fCmd_Process();
+    SIM800_WDT_RESET();
+    SIM800_YIELD();
+  }
+
+  if(wait.Result == SIM800_RES_OK) {
+    Serial.printf("Request %s : Success.\n", pCmd->Command);
+  }
+
+  return wait.Result;
+}
+
+static void fCheckCredit_OnDone(sim800_res_t Result, uint32_t Credit, void *pCtx) {
+
+  sCreditWait *pWait = (sCreditWait *)pCtx;
+
+  pWait->Credit = Credit;
+  pWait->Done = true;
+}
+
+/**
+ * @brief Sends the step held for the menu once WAIT_FOR_USSD_MENU_MS passed
+ * 
+ */
+static void fCredit_Process(void) {
+
+  sSim800Credit *pCredit = &Sim800.Credit;
+
+  if(!pCredit->Busy || !pCredit->Waiting) return;
+  if(SIM800_MILLIS() - pCredit->WaitStart < WAIT_FOR_USSD_MENU_MS) return;
+
+  pCredit->Waiting = false;
+  fCredit_Submit();
+}
+
+/**
+ * @brief Queues the current step. A first step the engine cannot take ends the
+ *        check without pfDone, fSim800_CheckCreditAsync reports it instead.
+ * 
+ */
+static void fCredit_Submit(void) {
+
+  sSim800Credit *pCredit = &Sim800.Credit;
+  const sCreditStep *pStep = &CreditSteps[pCredit->Step];
+  sSim800Cmd cmd = {};
+
+  strncpy(cmd.Command, pStep->pCommand, sizeof(cmd.Command) - 1);
+  strncpy(cmd.Expected, pStep->pExpected, sizeof(cmd.Expected) - 1);
+  cmd.TimeoutMs = pStep->Ussd ? WAIT_FOR_USSD_RESPONSE_MS : WAIT_FOR_COMMAND_RESPONSE_MS;
+  cmd.Attempts = pStep->Ussd ? 1 : Sim800.CommandSendRetries;
+  cmd.Flags = pStep->Ussd ? SIM800_CMD_FLAG_RESPONSE_AFTER_OK : 0;
+  cmd.pfDone = fCredit_OnStep;
+
+  if(fCmd_Submit(&cmd) == SIM800_RES_OK) return;
+
+  if(pCredit->Step == 0) {
+    pCredit->Busy = false;
+    return;
+  }
+
+  pCredit->Result = SIM800_RES_SEND_COMMAND_FAIL;
+  fCredit_Finish();
+}
+
+/**
+ * @brief Completion of a step. Only the balance answer decides the result, the
+ *        menu steps go on whatever they got, as the operator's menu varies.
+ * 
+ * @param Result 
+ * @param pResponse 
+ * @param pCtx 
+ */
+static void fCredit_OnStep(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  sSim800Credit *pCredit = &Sim800.Credit;
+
+  if(pCredit->Step == CREDIT_STEP_BALANCE) {
+    pCredit->Result = Result;
+    if(Result == SIM800_RES_OK) {
+      pCredit->Credit = fCredit_Parse(pResponse);
+    }
+  }
+
+  if(++pCredit->Step >= CREDIT_STEP_COUNT) {
+    fCredit_Finish();
+    return;
+  }
+
+  if(CreditSteps[pCredit->Step].Pause) {
+    pCredit->Waiting = true;
+    pCredit->WaitStart = SIM800_MILLIS();
+    return;
+  }
+
+  fCredit_Submit();
+}
+
+/**
+ * @brief Ends the check, a new one may be started from pfDone
+ * 
+ */
+static void fCredit_Finish(void) {
+
+  sSim800Credit *pCredit = &Sim800.Credit;
+  uint32_t credit = (pCredit->Result == SIM800_RES_OK) ? pCredit->Credit : 0;
+
+  pCredit->Busy = false;
+  if(pCredit->Result != SIM800_RES_OK) {
+    Serial.printf("Credit check failed (err=%d).\n", pCredit->Result);
+  }
+
+  if(pCredit->pfDone != NULL) {
+    pCredit->pfDone(pCredit->Result, credit, pCredit->pCtx);
+  }
+}
+
+/**
+ * @brief "+CUSD: 0, \"Credit: 68,734 IRR ...\", 15" to Toman
+ * 
+ * @param pResponse 
+ * @return uint32_t 0 when there is no credit in it
+ */
+static uint32_t fCredit_Parse(const char *pResponse) {
+
+  const char *p = strstr(pResponse, "Credit:");
+  uint32_t rials = 0;
+
+  if(p == NULL) return 0;
+
+  for(p += 7; *p == ' '; p++);
+  for(; (*p >= '0' && *p <= '9') || *p == ','; p++) {
+
+    if(*p == ',') continue;
+    if(rials > (UINT32_MAX - 9) / 10) return 0;
+    rials = rials * 10 + (*p - '0');
+  }
+
+  return rials / 10;
+}
+
+/**
+ * @brief Puts a command at the tail of the engine queue
+ * 
+ * @param pCmd 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fCmd_Submit(const sSim800Cmd *pCmd) {
+
+  sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+
+  if(pEngine->Count >= SIM800_CMD_QUEUE_SIZE) {
+
+    Serial.println("Command queue full!");
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+
+  pEngine->Queue[pEngine->Tail] = *pCmd;
+  if(pEngine->Queue[pEngine->Tail].Attempts == 0) {
+    pEngine->Queue[pEngine->Tail].Attempts = 1;
+  }
+  pEngine->Tail = (pEngine->Tail + 1) % SIM800_CMD_QUEUE_SIZE;
+  pEngine->Count++;
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief One engine step, skipped when a callback of the step in progress gets here
+ * 
+ */
+static void fCmd_Process(void) {
+
+  sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+
+  if(Sim800.ComPort == nullptr || pEngine->Processing) return;
+
+  pEngine->Processing = true;
+  fCmd_Step();
+  pEngine->Processing = false;
+}
+
+/**
+ * @brief True while fSim800_Run or the engine is on the stack, where a blocking
+ *        call would spin the engine from inside one of its callbacks
+ * 
+ * @return bool 
+ */
+static bool fCmd_Reentered(void) {
+
+  return Sim800.Running || Sim800.CmdEngine.Processing;
+}
+
+/**
+ * @brief Drains what the UART already holds, checks the timeout of the command
+ *        in flight, or starts the next queued one
+ * 
+ */
+static void fCmd_Step(void) {
+
+  sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+  const char *pLine;
+
+  fRx_Fill();
+  while(fRx_NextLine(&pLine)) {
+    fCmd_HandleLine(pLine);
+  }
+
+  if(pEngine->State == eCMD_WAIT_RESPONSE) {
+
+    sSim800Cmd *pCmd = &pEngine->Queue[pEngine->Head];
+    if(SIM800_MILLIS() - pEngine->StartTime < pCmd->TimeoutMs) return;
+
+    Serial.printf("Request %s : Timeout.\n", pCmd->Command);
+    fCmd_Retry(pEngine->FinalSeen ? SIM800_RES_UNEXPECTED_RESPONSE : SIM800_RES_CMD_TIMEOUT);
+    return;
+  }
+
+  if(pEngine->Count > 0) {
+
+    pEngine->State = eCMD_WAIT_RESPONSE;
+    pEngine->Tries = 0;
+    Sim800.IsSending = true;
+    fCmd_Transmit();
+  }
+}
+
+/**
+ * @brief (Re)sends the command at the head of the queue
+ * 
+ */
+static void fCmd_Transmit(void) {
+
+  sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+  sSim800Cmd *pCmd = &pEngine->Queue[pEngine->Head];
+
+  pEngine->Tries++;
+  pEngine->PayloadSent = false;
+  pEngine->Matched = false;
+  pEngine->FinalSeen = false;
+  pEngine->Response[0] = '\0';
+  pEngine->StartTime = SIM800_MILLIS();
+
+  // Consecutive configuration commands share one line: AT+CMGF=1;+CSCS="HEX";+CSMP=...
+  size_t len = strlen(pCmd->Command);
+  memcpy(pEngine->Line, pCmd->Command, len + 1);
+  pEngine->BatchCount = 1;
+
+  while((pCmd->Flags & (SIM800_CMD_FLAG_BATCHABLE | SIM800_CMD_FLAG_NO_BATCH)) == SIM800_CMD_FLAG_BATCHABLE &&
+        pEngine->BatchCount < pEngine->Count) {
+
+    sSim800Cmd *pNext = &pEngine->Queue[(pEngine->Head + pEngine->BatchCount) % SIM800_CMD_QUEUE_SIZE];
+    size_t nextLen = strlen(pNext->Command) - 2; // without "AT"
+
+    if((pNext->Flags & (SIM800_CMD_FLAG_BATCHABLE | SIM800_CMD_FLAG_NO_BATCH)) != SIM800_CMD_FLAG_BATCHABLE ||
+       len + 1 + nextLen >= sizeof(pEngine->Line)) {
+      break;
+    }
+
+    pEngine->Line[len++] = ';';
+    memcpy(&pEngine->Line[len], pNext->Command + 2, nextLen + 1);
+    len += nextLen;
+    pEngine->BatchCount++;
+  }
+
+  Serial.printf("\nSending %s  ...(%d) -- desired response: %s\n", pEngine->Line, pEngine->Tries, pCmd->Expected);
+  Sim800.ComPort->println(pEngine->Line);
+}
+
+/**
+ * @brief Sends the command again if the failure is transient and attempts are left,
+ *        otherwise completes it with Result. Nothing is resent once the SMS body went out.
+ *        A failing batch is split and its commands are sent one by one, so the result
+ *        lands on the command that caused it.
+ * 
+ * @param Result 
+ */
+static void fCmd_Retry(sim800_res_t Result) {
+
+  sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+  sSim800Cmd *pCmd = &pEngine->Queue[pEngine->Head];
+
+  if(pEngine->BatchCount > 1) {
+
+    for(uint8_t i = 0; i < pEngine->BatchCount; i++) {
+      pEngine->Queue[(pEngine->Head + i) % SIM800_CMD_QUEUE_SIZE].Flags |= SIM800_CMD_FLAG_NO_BATCH;
+    }
+    pEngine->Tries = 0;
+    fCmd_Transmit();
+    return;
+  }
+
+  if(!fAt_IsTransient(Result) || pEngine->PayloadSent || pEngine->Tries >= pCmd->Attempts) {
+    fCmd_Complete(Result);
+    return;
+  }
+
+  fCmd_Transmit();
+}
+
+/**
+ * @brief Whether pLine is the answer pCmd waits for. Expected has to open the
+ *        line, so an unsolicited code that merely contains it is left for the
+ *        URC table. An answer that itself comes as an unsolicited code (+CUSD)
+ *        must carry the command's own prefix, Expected may follow anywhere.
+ * 
+ * @param pCmd 
+ * @param pLine 
+ * @return bool 
+ */
+static bool fCmd_Matches(const sSim800Cmd *pCmd, const char *pLine) {
+
+  if(!(pCmd->Flags & SIM800_CMD_FLAG_RESPONSE_AFTER_OK)) {
+    return strncmp(pLine, pCmd->Expected, strlen(pCmd->Expected)) == 0;
+  }
+
+  // AT+CUSD=1,"..." is answered by +CUSD: ...
+  const char *pName = pCmd->Command + 2;
+  size_t nameLen = strcspn(pName, "=?");
+
+  return nameLen > 0 && strncmp(pLine, pName, nameLen) == 0 && pLine[nameLen] == ':' &&
+         strstr(pLine + nameLen, pCmd->Expected) != NULL;
+}
+
+/**
+ * @brief Routes one complete response line: the data prompt, the expected
+ *        information line, final result codes, then everything else
+ * 
+ * @param pLine 
+ */
+static void fCmd_HandleLine(const char *pLine) {
+
+  sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+
+  // The line after +CDS: <length> is the report itself, whatever command is in flight
+  if(Sim800.pfUrcBody != NULL) {
+
+    pfSim800UrcHandler pfBody = Sim800.pfUrcBody;
+    Sim800.pfUrcBody = NULL;
+    pfBody(pLine, NULL);
+    return;
+  }
+
+  if(pEngine->State == eCMD_WAIT_RESPONSE) {
+
+    sSim800Cmd *pCmd = &pEngine->Queue[pEngine->Head];
+    bool expectOk = (strcmp(pCmd->Expected, ATOK) == 0);
+
+    if(strcmp(pLine, pEngine->Line) == 0) {
+      return; // echo
+    }
+
+    if(pCmd->pfPayload != NULL && !pEngine->PayloadSent && strcmp(pLine, SEND_SMS_START) == 0) {
+
+      pCmd->pfPayload(pCmd->pCtx);
+      Sim800.ComPort->write(SEND_SMS_END);
+      pEngine->PayloadSent = true;
+      pEngine->StartTime = SIM800_MILLIS();
+      return;
+    }
+
+    if(!expectOk && !pEngine->Matched && fCmd_Matches(pCmd, pLine)) {
+
+      strncpy(pEngine->Response, pLine, sizeof(pEngine->Response) - 1);
+      pEngine->Response[sizeof(pEngine->Response) - 1] = '\0';
+      pEngine->Matched = true;
+
+      // Unsolicited answers (+CUSD) and the bare prompt come after, or instead of, the final code
+      if(pEngine->FinalSeen || strcmp(pLine, SEND_SMS_START) == 0) {
+        fCmd_Complete(SIM800_RES_OK);
+      }
+      return;
+    }
+
+    uint16_t code = 0;
+    eSim800AtFinal final = fAt_Classify(pLine, &code);
+    bool isDial = (strncmp(pCmd->Command, "ATD", 3) == 0 || strncmp(pCmd->Command, "ATA", 3) == 0);
+
+    if(final == eAT_FINAL_OK) {
+
+      if(expectOk) {
+        strncpy(pEngine->Response, ATOK, sizeof(pEngine->Response) - 1);
+      }
+      if(expectOk || pEngine->Matched) {
+        fCmd_Complete(SIM800_RES_OK);
+      } else if(pCmd->Flags & SIM800_CMD_FLAG_RESPONSE_AFTER_OK) {
+        pEngine->FinalSeen = true;
+      } else {
+        Serial.printf("Request %s : OK without %s.\n", pCmd->Command, pCmd->Expected);
+        fCmd_Complete(SIM800_RES_UNEXPECTED_RESPONSE);
+      }
+      return;
+    }
+
+    if(final != eAT_FINAL_NONE && (isDial || final <= eAT_FINAL_CMS_ERROR)) {
+
+      sim800_res_t result = fAt_FinalToResult(final, code);
+
+      Serial.printf("Request %s : %s (err=%d).\n", pCmd->Command, pLine, result);
+      pEngine->LastError = result;
+      pEngine->LastErrorCode = code;
+      fCmd_Retry(result);
+      return;
+    }
+  }
+
+  if(fUrc_Dispatch(pLine)) {
+    return;
+  }
+
+  if(pEngine->State == eCMD_WAIT_RESPONSE) {
+
+    sSim800Cmd *pCmd = &pEngine->Queue[pEngine->Head];
+    if(pCmd->pfLine != NULL) {
+      pCmd->pfLine(pLine, pCmd->pCtx);
+    }
+  }
+}
+
+/**
+ * @brief Recognizes the V.25ter final result codes and the +CME/+CMS error reports
+ * 
+ * @param pLine 
+ * @param pCode numeric <err> of +CME/+CMS ERROR, 0 otherwise
+ * @return eSim800AtFinal 
+ */
+static eSim800AtFinal fAt_Classify(const char *pLine, uint16_t *pCode) {
+
+  *pCode = 0;
+
+  switch(pLine[0]) {
+
+    case 'O':
+      return (strcmp(pLine, "OK") == 0) ? eAT_FINAL_OK : eAT_FINAL_NONE;
+
+    case 'E':
+      return (strcmp(pLine, "ERROR") == 0) ? eAT_FINAL_ERROR : eAT_FINAL_NONE;
+
+    case '+':
+      if(strncmp(pLine, "+CME ERROR:", 11) == 0) {
+        *pCode = (uint16_t)atoi(pLine + 11);
+        return eAT_FINAL_CME_ERROR;
+      }
+      if(strncmp(pLine, "+CMS ERROR:", 11) == 0) {
+        *pCode = (uint16_t)atoi(pLine + 11);
+        return eAT_FINAL_CMS_ERROR;
+      }
+      return eAT_FINAL_NONE;
+
+    case 'N':
+      if(strcmp(pLine, "NO CARRIER") == 0) return eAT_FINAL_NO_CARRIER;
+      if(strcmp(pLine, "NO ANSWER") == 0) return eAT_FINAL_NO_ANSWER;
+      if(strcmp(pLine, "NO DIALTONE") == 0) return eAT_FINAL_NO_DIALTONE;
+      return eAT_FINAL_NONE;
+
+    case 'B':
+      return (strcmp(pLine, "BUSY") == 0) ? eAT_FINAL_BUSY : eAT_FINAL_NONE;
+
+    default:
+      return eAT_FINAL_NONE;
+  }
+}
+
+/**
+ * @brief Maps a failing final result code to a driver result
+ * 
+ * @param Final 
+ * @param Code 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fAt_FinalToResult(eSim800AtFinal Final, uint16_t Code) {
+
+  switch(Final) {
+
+    case eAT_FINAL_OK:          return SIM800_RES_OK;
+    case eAT_FINAL_ERROR:       return SIM800_RES_CMD_ERROR;
+    case eAT_FINAL_NO_CARRIER:  return SIM800_RES_NO_CARRIER;
+    case eAT_FINAL_BUSY:        return SIM800_RES_LINE_BUSY;
+    case eAT_FINAL_NO_ANSWER:   return SIM800_RES_NO_ANSWER;
+    case eAT_FINAL_NO_DIALTONE: return SIM800_RES_NO_DIALTONE;
+
+    case eAT_FINAL_CME_ERROR:
+      switch(Code) {
+        case 3:  case 4:                            return SIM800_RES_OPERATION_NOT_ALLOWED;
+        case 10:                                    return SIM800_RES_SIMCARD_NOT_INSERTED;
+        case 11: case 12: case 16: case 17: case 18: return SIM800_RES_SIM_PIN_REQUIRED;
+        case 13: case 15:                           return SIM800_RES_SIM_FAILURE;
+        case 14:                                    return SIM800_RES_SIM_BUSY;
+        case 20:                                    return SIM800_RES_MEMORY_FULL;
+        case 30: case 32:                           return SIM800_RES_NO_NETWORK;
+        case 31:                                    return SIM800_RES_NETWORK_BUSY;
+        default:                                    return SIM800_RES_CMD_ERROR;
+      }
+
+    case eAT_FINAL_CMS_ERROR:
+      switch(Code) {
+        case 1:   case 28:  case 30:                return SIM800_RES_PHONENUMBER_INVALID;
+        case 8:   case 10:  case 21:  case 29:
+        case 50:  case 330:                         return SIM800_RES_SMS_REJECTED;
+        case 27:  case 38:  case 41:  case 42:
+        case 47:  case 332:                         return SIM800_RES_NETWORK_BUSY;
+        case 302: case 303: case 304: case 305:     return SIM800_RES_OPERATION_NOT_ALLOWED;
+        case 310:                                   return SIM800_RES_SIMCARD_NOT_INSERTED;
+        case 311: case 312: case 316: case 317:
+        case 318:                                   return SIM800_RES_SIM_PIN_REQUIRED;
+        case 313: case 315:                         return SIM800_RES_SIM_FAILURE;
+        case 314:                                   return SIM800_RES_SIM_BUSY;
+        case 322:                                   return SIM800_RES_MEMORY_FULL;
+        case 331:                                   return SIM800_RES_NO_NETWORK;
+        default:                                    return SIM800_RES_CMD_ERROR;
+      }
+
+    default:
+      return SIM800_RES_CMD_ERROR;
+  }
+}
+
+/**
+ * @brief Failures worth another attempt, everything else is permanent and fails fast
+ * 
+ * @param Result 
+ * @return true 
+ * @return false 
+ */
+static bool fAt_IsTransient(sim800_res_t Result) {
+
+  switch(Result) {
+    case SIM800_RES_CMD_ERROR:
+    case SIM800_RES_CMD_TIMEOUT:
+    case SIM800_RES_SIM_BUSY:
+    case SIM800_RES_NO_NETWORK:
+    case SIM800_RES_NETWORK_BUSY:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief FNV-1a over the prefix, folded to the table size
+ * 
+ * @param pPrefix 
+ * @param Len 
+ * @return uint8_t 
+ */
+static uint8_t fUrc_Hash(const char *pPrefix, uint8_t Len) {
+
+  uint32_t hash = 2166136261u;
+
+  for(uint8_t i = 0; i < Len; i++) {
+    hash = (hash ^ (uint8_t)pPrefix[i]) * 16777619u;
+  }
+
+  return (uint8_t)((hash ^ (hash >> 16)) & SIM800_URC_TABLE_MASK);
+}
+
+/**
+ * @brief Inserts a prefix into the open-addressed URC table
+ * 
+ * @param pPrefix 
+ * @param pfHandler 
+ * @param pCtx 
+ * @param Replace false keeps an existing handler of the same prefix
+ * @return sim800_res_t 
+ */
+static sim800_res_t fUrc_Register(const char *pPrefix, pfSim800UrcHandler pfHandler, void *pCtx, bool Replace) {
+
+  if(pPrefix == NULL || pfHandler == NULL) {
+    return SIM800_RES_INIT_FAIL;
+  }
+
+  size_t len = strlen(pPrefix);
+  if(len == 0 || len > 0xFF) {
+    return SIM800_RES_INIT_FAIL;
+  }
+
+  uint8_t slot = fUrc_Hash(pPrefix, len);
+
+  for(uint8_t probe = 0; probe < SIM800_URC_TABLE_SIZE; probe++) {
+
+    sSim800Urc *pUrc = &Sim800.Urc[(slot + probe) & SIM800_URC_TABLE_MASK];
+
+    if(pUrc->pfHandler == NULL) {
+
+      pUrc->pPrefix = pPrefix;
+      pUrc->PrefixLen = (uint8_t)len;
+      pUrc->pfHandler = pfHandler;
+      pUrc->pCtx = pCtx;
+      return SIM800_RES_OK;
+    }
+
+    if(pUrc->PrefixLen == len && memcmp(pUrc->pPrefix, pPrefix, len) == 0) {
+
+      if(Replace) {
+        pUrc->pfHandler = pfHandler;
+        pUrc->pCtx = pCtx;
+      }
+      return SIM800_RES_OK;
+    }
+  }
+
+  Serial.println("URC table full!");
+  return SIM800_RES_INIT_FAIL;
+}
+
+/**
+ * @brief Hands an unsolicited line to its registered handler
+ * 
+ * @param pLine 
+ * @return true when the line was a known URC
+ */
+static bool fUrc_Dispatch(const char *pLine) {
+
+  const char *pColon = strchr(pLine, ':');
+  size_t len = (pColon != NULL) ? (size_t)(pColon - pLine) : strlen(pLine);
+
+  if(len == 0 || len > 0xFF) return false;
+
+  uint8_t slot = fUrc_Hash(pLine, len);
+
+  for(uint8_t probe = 0; probe < SIM800_URC_TABLE_SIZE; probe++) {
+
+    sSim800Urc *pUrc = &Sim800.Urc[(slot + probe) & SIM800_URC_TABLE_MASK];
+
+    if(pUrc->pfHandler == NULL) return false;
+
+    if(pUrc->PrefixLen == len && memcmp(pUrc->pPrefix, pLine, len) == 0) {
+      pUrc->pfHandler(pLine, pUrc->pCtx);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief +CDS: <fo>,<mr>,<ra>,<tora>,<scts>,<dt>,<st> in text mode, +CDS: <length>
+ *        followed by the PDU in PDU mode
+ * 
+ * @param pLine 
+ * @param pCtx 
+ */
+static void fUrc_OnDeliveryReport(const char *pLine, void *pCtx) {
+
+  sSim800SmsHeader report;
+
+  Serial.println("delivery report reviceved");
+
+  if(strchr(pLine, ',') == NULL) {
+    Sim800.pfUrcBody = fReport_OnPdu;
+    return;
+  }
+
+  if(fSmsHeader_Parse(pLine, &report, NULL) == SIM800_RES_OK) {
+    fReport_Match(report.MessageRef, report.Status);
+  }
+}
+
+/**
+ * @brief +CMTI: "SM",<index>, queues the index for fInbox_Read
+ * 
+ * @param pLine 
+ * @param pCtx 
+ */
+static void fUrc_OnNewMessage(const char *pLine, void *pCtx) {
+
+  sSim800Inbox *pInbox = &Sim800.Inbox;
+  const char *pComma = strrchr(pLine, ',');
+
+  Serial.printf("new massage: %s\n", pLine);
+  if(pComma == NULL) return;
+
+  uint16_t index = (uint16_t)atoi(pComma + 1);
+
+  for(uint8_t i = 0; i < pInbox->PendingCount; i++) {
+    if(pInbox->Pending[(pInbox->PendingHead + i) % SIM800_INBOX_PENDING_SIZE] == index) return;
+  }
+
+  if(pInbox->PendingCount >= SIM800_INBOX_PENDING_SIZE) {
+    Serial.println("Inbox queue full, massage left for fSim800_CheckInbox");
+    return;
+  }
+
+  pInbox->Pending[(pInbox->PendingHead + pInbox->PendingCount) % SIM800_INBOX_PENDING_SIZE] = index;
+  pInbox->PendingCount++;
+}
+
+static void fUrc_OnModemEvent(const char *pLine, void *pCtx) {
+
+  Serial.printf("modem event: %s\n", pLine);
+}
+
+/**
+ * @brief The modem lost its configuration (restart, power down), the shadow no longer holds
+ * 
+ * @param pLine 
+ * @param pCtx 
+ */
+static void fUrc_OnModemReset(const char *pLine, void *pCtx) {
+
+  Serial.printf("modem reset: %s\n", pLine);
+  fCfg_Invalidate();
+  Sim800.Config.Resync = true;
+}
+
+/**
+ * @brief Moves whatever the UART already holds into the receive ring, never waits
+ * 
+ */
+static void fRx_Fill(void) {
+
+  sSim800RxFramer *pRx = &Sim800.Rx;
+  int available = Sim800.ComPort->available();
+
+  while(available > 0) {
+
+    uint16_t space = SIM800_RX_RING_SIZE - (uint16_t)(pRx->Head - pRx->Tail);
+    uint16_t pos = pRx->Head & SIM800_RX_RING_MASK;
+    uint16_t chunk = SIM800_RX_RING_SIZE - pos;
+
+    if(space == 0) break;
+    if(chunk > space) chunk = space;
+    if(chunk > available) chunk = available;
+
+    size_t n = Sim800.ComPort->readBytes((char *)&pRx->Ring[pos], chunk);
+    if(n == 0) break;
+
+    pRx->Head += n;
+    available -= n;
+  }
+}
+
+/**
+ * @brief Frames the next complete line out of the receive ring.
+ *        The returned view points into Sim800.Rx.Line and stays valid until the
+ *        next call. Surrounding blanks and empty lines are dropped, an overlong
+ *        line is cut at SIM800_RX_LINE_MAX_LEN, and the unterminated data
+ *        prompt "> " is reported as SEND_SMS_START while a command waits for it.
+ * 
+ * @param ppLine 
+ * @return true when a line was framed
+ */
+static bool fRx_NextLine(const char **ppLine) {
+
+  sSim800RxFramer *pRx = &Sim800.Rx;
+
+  while(pRx->Tail != pRx->Head) {
+
+    char c = (char)pRx->Ring[pRx->Tail & SIM800_RX_RING_MASK];
+    pRx->Tail++;
+
+    if(c == '\n') {
+
+      while(pRx->LineLen > 0 && pRx->Line[pRx->LineLen - 1] == ' ') {
+        pRx->LineLen--;
+      }
+      if(pRx->LineLen == 0) {
+        pRx->Truncated = false;
+        continue;
+      }
+
+      pRx->Line[pRx->LineLen] = '\0';
+      pRx->LineLen = 0;
+      pRx->Truncated = false;
+      *ppLine = pRx->Line;
+      return true;
+    }
+
+    if(c == '\r' || (c == ' ' && pRx->LineLen == 0)) continue;
+
+    if(pRx->LineLen >= SIM800_RX_LINE_MAX_LEN - 1) {
+      if(!pRx->Truncated) {
+        pRx->Truncated = true;
+        pRx->Overflows++;
+      }
+      continue;
+    }
+    pRx->Line[pRx->LineLen++] = c;
+
+    // The data prompt is not terminated by a line break, and only comes after AT+CMGS
+    if(pRx->LineLen == 2 && pRx->Line[0] == '>' && c == ' ' && fRx_PromptDue()) {
+
+      pRx->LineLen = 0;
+      *ppLine = SEND_SMS_START;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief True while the command in flight has a payload still to write, the
+ *        only time "> " is the data prompt and not the start of a line
+ * 
+ * @return bool 
+ */
+static bool fRx_PromptDue(void) {
+
+  const sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+
+  return pEngine->State == eCMD_WAIT_RESPONSE && !pEngine->PayloadSent &&
+         pEngine->Queue[pEngine->Head].pfPayload != NULL;
+}
+
+/**
+ * @brief Retires the command in flight and reports its result
+ * 
+ * @param Result 
+ */
+static void fCmd_Complete(sim800_res_t Result) {
+
+  sSim800CmdEngine *pEngine = &Sim800.CmdEngine;
+  pfSim800CmdDone pfDone[SIM800_CMD_QUEUE_SIZE];
+  void *pCtx[SIM800_CMD_QUEUE_SIZE];
+  char response[SIM800_CMD_RESPONSE_MAX_LEN];
+  uint8_t count = pEngine->BatchCount;
+
+  // Every command of the batch gets this answer, whatever the callbacks start
+  memcpy(response, pEngine->Response, sizeof(response));
+
+  // Retire the whole batch first, the callbacks may queue new commands into the freed slots
+  for(uint8_t i = 0; i < count; i++) {
+
+    pfDone[i] = pEngine->Queue[pEngine->Head].pfDone;
+    pCtx[i] = pEngine->Queue[pEngine->Head].pCtx;
+
+    pEngine->Head = (pEngine->Head + 1) % SIM800_CMD_QUEUE_SIZE;
+    pEngine->Count--;
+  }
+  pEngine->BatchCount = 0;
+  pEngine->State = eCMD_IDLE;
+  Sim800.IsSending = false;
+
+  for(uint8_t i = 0; i < count; i++) {
+    if(pfDone[i] != NULL) {
+      pfDone[i](Result, response, pCtx[i]);
+    }
+  }
+}
+
+/**
+ * @brief 
+ * 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fGSM_Init(void) {
+
+  if(fSendCommand(AT, ATOK) != SIM800_RES_OK) {
+    Sim800.IsSending = false;
+    // RestartGSM();
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+  sim800_res_t simResult = fSendCommand(CHECK_SIMCARD_INSERTED, SIMCARD_INSERTED);
+  if(simResult != SIM800_RES_OK) {
+    Sim800.IsSending = false;
+    if(simResult == SIM800_RES_UNEXPECTED_RESPONSE) {
+      return SIM800_RES_SIM_PIN_REQUIRED; // +CPIN answered, but not READY
+    }
+    if(simResult == SIM800_RES_SIM_PIN_REQUIRED || simResult == SIM800_RES_SIM_FAILURE) {
+      return simResult;
+    }
+    return SIM800_RES_SIMCARD_NOT_INSERTED;
+  }
+  if(fSendCommand(RESET_FACTORY, ATOK) != SIM800_RES_OK) {
+    Sim800.IsSending = false;
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+  fCfg_Invalidate();
+  // if(fSendCommand(IRANCELL, ATOK) != SIM800_RES_OK) {
+  //   Sim800.IsSending = false;
+  //   return SIM800_RES_SEND_COMMAND_FAIL;
+  // }
+
+  // Deleting old messages and every setting go out as a single command line
+  sSim800Cmd cmd = {};
+  sSendCommandWait deleteWait = { false, SIM800_RES_SEND_COMMAND_FAIL, nullptr };
+  strncpy(cmd.Command, DELETE_ALL_MSGS, sizeof(cmd.Command) - 1);
+  strncpy(cmd.Expected, ATOK, sizeof(cmd.Expected) - 1);
+  cmd.TimeoutMs = WAIT_FOR_COMMAND_RESPONSE_MS;
+  cmd.Attempts = Sim800.CommandSendRetries;
+  cmd.Flags = SIM800_CMD_FLAG_BATCHABLE;
+  cmd.pfDone = fSendCommand_OnDone;
+  cmd.pCtx = &deleteWait;
+
+  if(fCmd_Submit(&cmd) != SIM800_RES_OK) {
+    Sim800.IsSending = false;
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+  fCfg_Sync(NULL);
+
+  while(Sim800.Config.Syncing || !deleteWait.Done) {
+
+    fCmd_Process();
+    SIM800_WDT_RESET();
+    SIM800_YIELD();
+  }
+
+  if(deleteWait.Result != SIM800_RES_OK) {
+    Sim800.IsSending = false;
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+  for(uint8_t i = 0; i < eCFG_INDICATION; i++) {
+    if(Sim800.Config.Applied[i] == NULL) {
+      Sim800.IsSending = false;
+      return SIM800_RES_SEND_COMMAND_FAIL;
+    }
+  }
+  // +CMTI announces new messages, +CDS the delivery reports when enabled
+  if(Sim800.Config.Applied[eCFG_INDICATION] == NULL) {
+    Sim800.IsSending = false;
+    return SIM800_RES_SEND_SMS_FAIL;
+  }
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief The value each setting must have for the next SMS, or for reading one in text mode
+ * 
+ * @param Setting 
+ * @return const char* 
+ */
+static const char *fCfg_Desired(eSim800Setting Setting) {
+
+  switch(Setting) {
+    case eCFG_MSG_FORMAT:     return Sim800.Config.PduMode ? SET_PDU_MODE : SET_TEXT_MODE;
+    case eCFG_CHARSET:        return SET_TEXT_HEX_MODE;
+    case eCFG_SMS_PARAMS:     return SET_TEXT_HEX_MODE_CONFIG;
+    case eCFG_HEADER_DETAILS: return SHOW_TEXT_HEADER;
+    case eCFG_INDICATION:     return Sim800.EnableDeliveryReport ? DELIVERY_ENABLE : NEW_MSG_INDICATION;
+    default:                  return NULL;
+  }
+}
+
+/**
+ * @brief Forgets the whole shadow, every setting is sent again on the next sync
+ * 
+ */
+static void fCfg_Invalidate(void) {
+
+  for(uint8_t i = 0; i < eCFG_COUNT; i++) {
+    Sim800.Config.Applied[i] = NULL;
+  }
+}
+
+/**
+ * @brief Non-blocking: queues the settings that differ from the shadow, then calls pfDone.
+ *        They are queued back to back so the engine can send them as one line.
+ * 
+ * @param pfDone 
+ */
+static void fCfg_Sync(void(*pfDone)(sim800_res_t Result)) {
+
+  sSim800ModemCfg *pCfg = &Sim800.Config;
+
+  pCfg->Syncing = true;
+  pCfg->Pending = 0;
+  pCfg->SyncResult = SIM800_RES_OK;
+  pCfg->pfSyncDone = pfDone;
+
+  for(uint8_t i = 0; i < eCFG_COUNT; i++) {
+
+    const char *pDesired = fCfg_Desired((eSim800Setting)i);
+
+    if(pCfg->Applied[i] != NULL && strcmp(pCfg->Applied[i], pDesired) == 0) continue;
+
+    sSim800Cmd cmd = {};
+    strncpy(cmd.Command, pDesired, sizeof(cmd.Command) - 1);
+    strncpy(cmd.Expected, ATOK, sizeof(cmd.Expected) - 1);
+    cmd.TimeoutMs = WAIT_FOR_COMMAND_RESPONSE_MS;
+    cmd.Attempts = Sim800.CommandSendRetries;
+    cmd.Flags = SIM800_CMD_FLAG_BATCHABLE;
+    cmd.pfDone = fCfg_OnSync;
+    cmd.pCtx = (void *)(uintptr_t)i;
+
+    if(fCmd_Submit(&cmd) == SIM800_RES_OK) {
+      pCfg->Pending++;
+    } else {
+      pCfg->SyncResult = SIM800_RES_SEND_COMMAND_FAIL;
+    }
+  }
+
+  if(pCfg->Pending == 0) {
+    fCfg_SyncDone();
+  }
+}
+
+static void fCfg_OnSync(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  sSim800ModemCfg *pCfg = &Sim800.Config;
+  eSim800Setting setting = (eSim800Setting)(uintptr_t)pCtx;
+
+  pCfg->Applied[setting] = (Result == SIM800_RES_OK) ? fCfg_Desired(setting) : NULL;
+  if(Result != SIM800_RES_OK && pCfg->SyncResult == SIM800_RES_OK) {
+    pCfg->SyncResult = Result;
+  }
+
+  if(--pCfg->Pending == 0) {
+    fCfg_SyncDone();
+  }
+}
+
+static void fCfg_SyncDone(void) {
+
+  sSim800ModemCfg *pCfg = &Sim800.Config;
+
+  pCfg->Syncing = false;
+  if(pCfg->pfSyncDone != NULL) {
+    pCfg->pfSyncDone(pCfg->SyncResult);
+  }
+}
+
+/**
+ * @brief Reads the next message announced by +CMTI, one at a time
+ * 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fInbox_Read(void) {
+
+  sSim800Inbox *pInbox = &Sim800.Inbox;
+
+  if(pInbox->Busy || pInbox->PendingCount == 0) {
+    return SIM800_RES_QUEUE_EMPTY;
+  }
+
+  if(!fInbox_UseTextMode()) {
+    return SIM800_RES_SIM_BUSY;
+  }
+
+  sSim800Cmd cmd = {};
+  snprintf(cmd.Command, sizeof(cmd.Command), READ_MSG "%u", pInbox->Pending[pInbox->PendingHead]);
+  strncpy(cmd.Expected, ATOK, sizeof(cmd.Expected) - 1);
+  cmd.TimeoutMs = WAIT_FOR_COMMAND_RESPONSE_MS;
+  cmd.Attempts = Sim800.CommandSendRetries;
+  cmd.pfLine = fInbox_OnLine;
+  cmd.pfDone = fInbox_OnReadDone;
+
+  if(fCmd_Submit(&cmd) != SIM800_RES_OK) {
+    return SIM800_RES_SEND_COMMAND_FAIL;
+  }
+
+  pInbox->Index = pInbox->Pending[pInbox->PendingHead];
+  pInbox->PendingHead = (pInbox->PendingHead + 1) % SIM800_INBOX_PENDING_SIZE;
+  pInbox->PendingCount--;
+  pInbox->State = SMS_IDLE;
+  pInbox->Busy = true;
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Messages are read in text mode. Switches back from PDU mode unless a PDU
+ *        is between its AT+CMGF=0 and AT+CMGS, the sync is queued ahead of the read.
+ * 
+ * @return true when the read can be queued now
+ */
+static bool fInbox_UseTextMode(void) {
+
+  if(!Sim800.Config.PduMode) return true;
+
+  if(Sim800.Config.Syncing || Sim800.SmsTx.State == eSMS_TX_SETUP || Sim800.SmsTx.State == eSMS_TX_SUBMIT) {
+    return false;
+  }
+
+  Sim800.Config.PduMode = false;
+  fCfg_Sync(NULL);
+
+  return true;
+}
+
+/**
+ * @brief Body text as UTF-8. AT+CSCS="HEX" shows a UCS2 message as four digits
+ *        per character and a GSM-7 one as two; a message with a user data
+ *        header comes as its user data octets, header first. A body that is
+ *        not all hex came before the charset was set and is kept as it is.
+ *        The <fo> and <dcs> of a +CMGR decide. A +CMGL has neither: only a
+ *        concatenation header is recognised then and the alphabet is guessed,
+ *        a GSM-7 body puts printable characters (0x21 and up) on the high bytes
+ *        a UCS2 reading would see, UCS2 text in Latin, Persian or punctuation does not.
+ * 
+ * @param pLine 
+ * @param pHeader the header the body came under
+ * @param pConcat concatenation header, Total 0 when there is none
+ * @return const char* Sim800.Inbox.Body
+ */
+static const char *fInbox_DecodeBody(const char *pLine, const sSim800SmsHeader *pHeader, sSmsConcatInfo *pConcat) {
+
+  char *pBody = Sim800.Inbox.Body;
+  uint16_t len = 0;
+  uint8_t header = 0;
+  uint8_t alphabet;
+  bool hex = true;
+
+  pConcat->Total = 0;
+
+  for(; pLine[len] != '\0'; len++) {
+    hex = hex && isxdigit((uint8_t)pLine[len]);
+  }
+
+  if(!hex || len == 0 || (len & 1)) {
+    strncpy(pBody, pLine, sizeof(Sim800.Inbox.Body) - 1);
+    pBody[sizeof(Sim800.Inbox.Body) - 1] = '\0';
+    return pBody;
+  }
+
+  if(pHeader->HasCoding) {
+
+    alphabet = fInbox_Alphabet(pHeader->Dcs);
+    if(pHeader->FirstOctet & SMS_FO_UDHI) {
+      header = fInbox_UserDataHeader(pLine, len, pConcat);
+    }
+
+  } else {
+
+    // UDHL 05, IEI 00, 8-bit reference or UDHL 06, IEI 08, 16-bit reference
+    uint8_t udh[7];
+    if(len >= 14 && fCodec_HexDecode(pLine, 14, udh, sizeof(udh)) == 7) {
+
+      if(udh[0] == 0x05 && udh[1] == 0x00 && udh[2] == 0x03) {
+        pConcat->Ref = udh[3];
+        pConcat->Total = udh[4];
+        pConcat->Part = udh[5];
+        header = 6;
+      } else if(udh[0] == 0x06 && udh[1] == 0x08 && udh[2] == 0x04) {
+        pConcat->Ref = (uint16_t)((udh[3] << 8) | udh[4]);
+        pConcat->Total = udh[5];
+        pConcat->Part = udh[6];
+        header = 7;
+      }
+    }
+
+    bool ucs2 = ((len - 2 * header) % 4) == 0;
+    for(uint16_t i = 2 * header; i < len && ucs2; i += 4) {
+
+      uint8_t unit[2];
+      fCodec_HexDecode(&pLine[i], 4, unit, sizeof(unit));
+      if(header == 0 && (unit[0] >= 0x80 || unit[1] >= 0x80)) break;   // GSM-7 never goes past 0x7F
+      ucs2 = (unit[0] < 0x21) || (unit[0] >= 0xD8 && unit[0] <= 0xDF);
+    }
+    alphabet = ucs2 ? SMS_ALPHABET_UCS2 : SMS_ALPHABET_GSM7;
+  }
+
+  pLine += 2 * header;
+  len -= 2 * header;
+
+  if(alphabet == SMS_ALPHABET_UCS2) {
+    fCodec_Ucs2HexToUtf8(pLine, len, pBody, sizeof(Sim800.Inbox.Body));
+  } else if(alphabet == SMS_ALPHABET_8BIT) {
+    // Data, not text: handed over as the hex it came in
+    strncpy(pBody, pLine, sizeof(Sim800.Inbox.Body) - 1);
+    pBody[sizeof(Sim800.Inbox.Body) - 1] = '\0';
+  } else if(header > 0) {
+    // Septets start at the next septet boundary after the header
+    fCodec_Gsm7PackedHexToUtf8(pLine, len, (7 - (header * 8) % 7) % 7, pBody, sizeof(Sim800.Inbox.Body));
+  } else {
+    fCodec_Gsm7HexToUtf8(pLine, len, pBody, sizeof(Sim800.Inbox.Body));
+  }
+
+  return pBody;
+}
+
+/**
+ * @brief Alphabet of a TP-DCS (3GPP TS 23.038): bits 3-2 of the general coding
+ *        groups, bit 2 of the data coding group, fixed by the message waiting ones
+ * 
+ * @param Dcs 
+ * @return uint8_t SMS_ALPHABET_GSM7, SMS_ALPHABET_8BIT or SMS_ALPHABET_UCS2
+ */
+static uint8_t fInbox_Alphabet(uint8_t Dcs) {
+
+  uint8_t alphabet;
+
+  if((Dcs & 0x80) == 0) {
+    alphabet = Dcs & 0x0C;
+  } else if((Dcs & 0xF0) == 0xF0) {
+    alphabet = Dcs & 0x04;
+  } else if((Dcs & 0xF0) == 0xE0) {
+    alphabet = SMS_ALPHABET_UCS2;
+  } else {
+    alphabet = SMS_ALPHABET_GSM7;
+  }
+
+  // 0x0C is reserved, read as the default alphabet
+  return (alphabet == 0x0C) ? SMS_ALPHABET_GSM7 : alphabet;
+}
+
+/**
+ * @brief Walks the information elements of a user data header. A concatenation
+ *        element, IEI 00 or 08, fills pConcat; every other element is skipped.
+ * 
+ * @param pHex the body, UDHL first
+ * @param Len hex digits
+ * @param pConcat 
+ * @return uint8_t octets of the header with its UDHL, 0 when it does not fit the body
+ */
+static uint8_t fInbox_UserDataHeader(const char *pHex, uint16_t Len, sSmsConcatInfo *pConcat) {
+
+  uint8_t udh[SIM800_PDU_USER_DATA_MAX_LEN];
+  uint8_t udhl;
+
+  if(Len < 2 || fCodec_HexDecode(pHex, 2, &udhl, 1) != 1) return 0;
+  if(udhl + 1u > sizeof(udh) || Len < 2u * (udhl + 1)) return 0;
+
+  fCodec_HexDecode(pHex, 2 * (udhl + 1), udh, sizeof(udh));
+
+  for(uint8_t pos = 1; pos + 2 <= udhl + 1; ) {
+
+    uint8_t iei = udh[pos];
+    uint8_t iedl = udh[pos + 1];
+    const uint8_t *pData = &udh[pos + 2];
+
+    if(pos + 2 + iedl > udhl + 1) break;
+
+    if(iei == 0x00 && iedl == 3) {
+      pConcat->Ref = pData[0];
+      pConcat->Total = pData[1];
+      pConcat->Part = pData[2];
+    } else if(iei == 0x08 && iedl == 4) {
+      pConcat->Ref = (uint16_t)((pData[0] << 8) | pData[1]);
+      pConcat->Total = pData[2];
+      pConcat->Part = pData[3];
+    }
+    pos += 2 + iedl;
+  }
+
+  return udhl + 1;
+}
+
+/**
+ * @brief Deletes every read message in one command, used after a listing sweep
+ * 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fInbox_Clear(void) {
+
+  return fSim800_SubmitCommand(DELETE_ALL_READED_MSGS, ATOK, WAIT_FOR_COMMAND_RESPONSE_MS, NULL, NULL);
+}
+
+/**
+ * @brief Line handler of AT+CMGR and AT+CMGL, a header line followed by the body
+ * 
+ * @param pLine 
+ * @param pCtx 
+ */
+static void fInbox_OnLine(const char *pLine, void *pCtx) {
+
+  if(strncmp(pLine, "+CMGL:", 6) == 0 || strncmp(pLine, "+CMGR:", 6) == 0) {
+
+    Serial.print("parsing line: ");Serial.println(pLine);
+
+    if(fRecivedSms_Parse(pLine) == SIM800_RES_OK) {
+      Sim800.Inbox.State = SMS_BODY;//next lines are body
+    }else {
+      Sim800.Inbox.State = SMS_IDLE;
+    }
+
+  } else if(Sim800.Inbox.State == SMS_BODY) {
+
+    Serial.println("----------New massage-----------");
+    Serial.println(pLine);
+    // This is SMS body
+    sSmsConcatInfo concat = {};
+    const char *pText = fInbox_DecodeBody(pLine, &Sim800._args.MassageData.Header, &concat);
+
+    // A part waits for the rest, the message is handled when the last one comes
+    if(concat.Total > 1) {
+      pText = fConcat_Add(&concat, Sim800._args.MassageData.Header.Number, pText);
+      if(pText == NULL) {
+        Sim800.Inbox.Handled++;
+        Sim800.Inbox.State = SMS_IDLE;
+        return;
+      }
+    }
+    Sim800._args.MassageData.Massage = pText;
+
+    Serial.printf("SMS (index %d) from %s : %s\n",
+      Sim800._args.MassageData.index,
+      Sim800._args.MassageData.phoneNumber.c_str(),
+      Sim800._args.MassageData.Massage.c_str()
+    );
+
+    // process SMS
+    fRecivedSms_CheckCommand();
+
+    Sim800.Inbox.Handled++;
+    Sim800.Inbox.State = SMS_IDLE;
+  }
+}
+
+/**
+ * @brief End of AT+CMGR, the message is deleted whether or not it held a command
+ * 
+ * @param Result 
+ * @param pResponse 
+ * @param pCtx 
+ */
+static void fInbox_OnReadDone(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  sSim800Inbox *pInbox = &Sim800.Inbox;
+
+  pInbox->State = SMS_IDLE;
+  pInbox->Busy = false;
+
+  if(Result != SIM800_RES_OK || pInbox->Index < 0) return;
+
+  Serial.printf("deleting massage index %d\n", pInbox->Index);
+  char deleteCmd[24];
+  snprintf(deleteCmd, sizeof(deleteCmd), DELETE_MSG "%d,0", pInbox->Index);
+  fSim800_SubmitCommand(deleteCmd, ATOK, WAIT_FOR_COMMAND_RESPONSE_MS, NULL, NULL);
+  pInbox->Index = -1;
+}
+
+/**
+ * @brief End of the unread listing, the listed messages are now read and go in one batch
+ * 
+ * @param Result 
+ * @param pResponse 
+ * @param pCtx 
+ */
+static void fInbox_OnListDone(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  Sim800.Inbox.State = SMS_IDLE;
+  Sim800.Inbox.Busy = false;
+
+  if (Sim800.Inbox.Handled > 0) {
+
+    Serial.printf("deleting %d read massages\n", Sim800.Inbox.Handled);
+    fInbox_Clear();
+  }
+}
+
+/**
+ * @brief Fills the message data from a +CMGL or +CMGR header, the caller already
+ *        set the index of a +CMGR
+ * 
+ * @param pLine 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fRecivedSms_Parse(const char *pLine) {
+
+  sSmsData *pData = &Sim800._args.MassageData;
+  sSim800SmsHeader *pHeader = &pData->Header;
+  const char *pTime = NULL;
+  char number[SIM800_PHONE_MAX_DIGITS + 1];
+  char time[SMS_TIMESTAMP_LEN + 1];
+  uint16_t position;
+
+  pHeader->Index = (uint16_t)Sim800.Inbox.Index;
+  if(fSmsHeader_Parse(pLine, pHeader, &pTime) != SIM800_RES_OK) {
+    return SIM800_RES_REVIEVED_SMS_INVALID;
+  }
+
+  if(!pHeader->NumberValid) {
+    return SIM800_RES_PHONENUMBER_INVALID;
+  }
+
+  pData->index = pHeader->Index;
+  pData->IsAdmin = fPhonebook_Find(pHeader->Number, &position) &&
+                   (Sim800.Phonebook.Entries[position].Flags & SIM800_CONTACT_ADMIN);
+
+  // The String fields stay for the command callback
+  fCodec_BcdUnpack(pHeader->Number, SIM800_PHONE_BCD_LEN, number, sizeof(number));
+  pData->phoneNumber = number;
+  if(pTime != NULL) {
+    memcpy(time, pTime, SMS_TIMESTAMP_LEN);
+    time[SMS_TIMESTAMP_LEN] = '\0';
+    pData->dateTime = time;
+  }
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Reads a header line where it is, nothing is copied or allocated
+ *        +CMGL: <index>,<stat>,<oa>,<alpha>,<scts>[,<tooa>,<length>]
+ *        +CMGR: <stat>,<oa>,<alpha>,<scts>[,<tooa>,<fo>,<pid>,<dcs>,<sca>,<tosca>,<length>]
+ *        +CDS: <fo>,<mr>,<ra>,<tora>,<scts>,<dt>,<st>
+ *        The bracketed fields come with AT+CSDH=1.
+ * 
+ * @param pLine 
+ * @param pHeader 
+ * @param ppTime the time stamp text inside pLine, may be NULL
+ * @return sim800_res_t 
+ */
+static sim800_res_t fSmsHeader_Parse(const char *pLine, sSim800SmsHeader *pHeader, const char **ppTime) {
+
+  sSmsField fields[SMS_HEADER_MAX_FIELDS];
+  const sSmsField *pNumber;
+  const sSmsField *pTime;
+  uint32_t value;
+  uint8_t count = fSmsHeader_Fields(pLine, fields, SMS_HEADER_MAX_FIELDS);
+
+  pHeader->HasCoding = false;
+
+  if(strncmp(pLine, "+CDS:", 5) == 0) {
+
+    if(count < 7 || !fSmsHeader_Uint(&fields[1], &value) || value > 0xFF) return SIM800_RES_REVIEVED_SMS_INVALID;
+    pHeader->MessageRef = (uint8_t)value;
+
+    if(!fSmsHeader_Uint(&fields[6], &value) || value > 0xFF) return SIM800_RES_REVIEVED_SMS_INVALID;
+    pHeader->Status = (uint8_t)value;
+
+    pNumber = &fields[2];
+    pTime = &fields[4];
+
+  } else {
+
+    const sSmsField *pStat;
+
+    if(strncmp(pLine, "+CMGL:", 6) == 0) {
+
+      if(count < 5 || !fSmsHeader_Uint(&fields[0], &value) || value > 0xFFFF) return SIM800_RES_REVIEVED_SMS_INVALID;
+      pHeader->Index = (uint16_t)value;
+      pStat = &fields[1];
+
+    } else if(strncmp(pLine, "+CMGR:", 6) == 0) {
+
+      if(count < 4) return SIM800_RES_REVIEVED_SMS_INVALID;
+      pStat = &fields[0];
+
+      uint32_t dcs;
+      if(count >= 8 && fSmsHeader_Uint(&fields[5], &value) && value <= 0xFF &&
+         fSmsHeader_Uint(&fields[7], &dcs) && dcs <= 0xFF) {
+        pHeader->FirstOctet = (uint8_t)value;
+        pHeader->Dcs = (uint8_t)dcs;
+        pHeader->HasCoding = true;
+      }
+
+    } else {
+      return SIM800_RES_REVIEVED_SMS_INVALID;
+    }
+
+    pHeader->Status = eSMS_STAT_UNKNOWN;
+    for(uint8_t i = 0; i < sizeof(SmsStatNames) / sizeof(SmsStatNames[0]); i++) {
+      if(pStat->Len == strlen(SmsStatNames[i]) && memcmp(pStat->p, SmsStatNames[i], pStat->Len) == 0) {
+        pHeader->Status = i;
+        break;
+      }
+    }
+    pHeader->MessageRef = 0;
+
+    pNumber = pStat + 1;
+    pTime = pStat + 3;
+  }
+
+  pHeader->NumberValid = fSmsHeader_Number(pNumber, pHeader->Number);
+  pHeader->Time = fSmsHeader_Time(pTime);
+
+  if(ppTime != NULL) {
+    *ppTime = (pTime->Len == SMS_TIMESTAMP_LEN) ? pTime->p : NULL;
+  }
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Splits what follows "+XXXX: " at the commas outside quotes
+ * 
+ * @param pLine 
+ * @param pFields 
+ * @param Max 
+ * @return uint8_t fields found, at most Max
+ */
+static uint8_t fSmsHeader_Fields(const char *pLine, sSmsField *pFields, uint8_t Max) {
+
+  const char *p = strchr(pLine, ':');
+  uint8_t count = 0;
+
+  if(p == NULL) return 0;
+
+  p++;
+  while(*p == ' ') p++;
+
+  while(count < Max) {
+
+    const char *pEnd;
+
+    if(*p == '"') {
+      p++;
+      pEnd = strchr(p, '"');
+      if(pEnd == NULL) break;   // unterminated quote, the field is damaged
+      pFields[count].p = p;
+      pFields[count].Len = (uint8_t)((pEnd - p) > 0xFF ? 0xFF : (pEnd - p));
+      pEnd++;
+    } else {
+      pEnd = p;
+      while(*pEnd != ',' && *pEnd != '\0') pEnd++;
+      pFields[count].p = p;
+      pFields[count].Len = (uint8_t)((pEnd - p) > 0xFF ? 0xFF : (pEnd - p));
+    }
+    count++;
+
+    if(*pEnd != ',') break;
+    p = pEnd + 1;
+  }
+
+  return count;
+}
+
+static bool fSmsHeader_Uint(const sSmsField *pField, uint32_t *pValue) {
+
+  uint32_t value = 0;
+
+  if(pField->Len == 0 || pField->Len > 9) return false;
+
+  for(uint8_t i = 0; i < pField->Len; i++) {
+    if(pField->p[i] < '0' || pField->p[i] > '9') return false;
+    value = value * 10 + (pField->p[i] - '0');
+  }
+
+  *pValue = value;
+  return true;
+}
+
+/**
+ * @brief Packs a number the way fNormalizedPhoneNumber writes it, 0xxxxxxxxxx
+ *        as it is and +98xxxxxxxxxx as 0xxxxxxxxxx
+ * 
+ * @param pField 
+ * @param pBcd 
+ * @return true when the number could be normalized
+ */
+static bool fSmsHeader_Number(const sSmsField *pField, uint8_t *pBcd) {
+
+  char digits[SIM800_PHONE_MAX_DIGITS + 1];
+
+  if(pField->Len == SIM800_PHONE_MAX_DIGITS && pField->p[0] == '0') {
+    memcpy(digits, pField->p, SIM800_PHONE_MAX_DIGITS);
+  } else if(pField->Len == SIM800_PHONE_MAX_DIGITS + 2 && pField->p[0] == '+') {
+    digits[0] = '0';
+    memcpy(&digits[1], &pField->p[3], SIM800_PHONE_MAX_DIGITS - 1);
+  } else {
+    return false;
+  }
+  digits[SIM800_PHONE_MAX_DIGITS] = '\0';
+
+  return fCodec_BcdPack(digits, pBcd, SIM800_PHONE_BCD_LEN) == SIM800_PHONE_MAX_DIGITS;
+}
+
+/**
+ * @brief yy/MM/dd,hh:mm:ss+zz to seconds since 1970, zz is the zone in quarter hours
+ * 
+ * @param pField 
+ * @return uint32_t 0 when the field is not a time stamp
+ */
+static uint32_t fSmsHeader_Time(const sSmsField *pField) {
+
+  static const uint8_t offsets[6] = { 0, 3, 6, 9, 12, 15 };
+  static const char separators[5] = { '/', '/', ',', ':', ':' };
+  static const uint16_t daysBefore[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+  const char *p = pField->p;
+  uint8_t part[7];
+
+  if(pField->Len != SMS_TIMESTAMP_LEN || (p[17] != '+' && p[17] != '-')) return 0;
+
+  for(uint8_t i = 0; i < 7; i++) {
+
+    uint8_t at = (i < 6) ? offsets[i] : 18;
+    if(p[at] < '0' || p[at] > '9' || p[at + 1] < '0' || p[at + 1] > '9') return 0;
+    if(i < 5 && p[at + 2] != separators[i]) return 0;
+    part[i] = (p[at] - '0') * 10 + (p[at + 1] - '0');
+  }
+
+  uint8_t month = part[1];
+  if(month < 1 || month > 12 || part[2] < 1 || part[2] > 31 || part[3] > 23 || part[4] > 59 || part[5] > 59) return 0;
+
+  // Years 2000-2099, every fourth one is a leap year
+  uint32_t days = 10957 + part[0] * 365u + (part[0] + 3) / 4 + daysBefore[month - 1] + part[2] - 1;
+  if(month > 2 && (part[0] % 4) == 0) days++;
+
+  int32_t zone = part[6] * 15 * 60;
+  if(p[17] == '-') zone = -zone;
+
+  return days * 86400u + part[3] * 3600u + part[4] * 60u + part[5] - zone;
+}
+
+/**
+ * @brief 
+ * 
+ * @param pRecSms 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fRecivedSms_CheckCommand(void) {
+
+  uint16_t position;
+
+  if(fPhonebook_Find(Sim800._args.MassageData.Header.Number, &position)) {
+
+    Serial.println("Recived sms from admin, check command");
+
+    if(fCommand_Parse(Sim800._args.MassageData.Massage.c_str(), &Sim800._args)) {
+
+      Sim800.IsSending = false;
+      fEvent_Post(&Sim800._args);
+      return SIM800_RES_OK;
+
+    } else {
+      return SIM800_RES_REVIEVED_SMS_INVALID;
+    }
+
+  } else {
+    return SIM800_RES_PHONENUMBER_INVALID;
+  }
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Reads a command body in one pass. Words are runs of letters, compared
+ *        whole and in lower case, so "ip" does not match inside "high". UTF-8
+ *        sequences count as letters, so Persian words match the same way. The
+ *        first command word, the first on/off and the first number are kept.
+ *        A first number too big for Value leaves HasValue false, no number is
+ *        taken in its place.
+ * 
+ * @param pText 
+ * @param pArgs 
+ * @return true when the body holds a command word
+ */
+static bool fCommand_Parse(const char *pText, sSim800RecievedMassgeDone *pArgs) {
+
+  char word[SMS_KEYWORD_MAX_LEN + 1];
+  uint8_t len = 0;
+  bool tooLong = false;
+  bool numberSeen = false;
+
+  pArgs->CommandType = eNO_COMMAND;
+  pArgs->Switch = eSWITCH_NONE;
+  pArgs->HasValue = false;
+  pArgs->Value = 0;
+
+  for(const char *p = pText; ; p++) {
+
+    char c = *p;
+
+    if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (uint8_t)c >= 0x80) {
+
+      if(len < sizeof(word)) {
+        word[len++] = ((uint8_t)c < 0x80) ? (c | 0x20) : c;
+      } else {
+        tooLong = true;   // longer than any keyword
+      }
+      continue;
+    }
+
+    if(len > 0) {
+
+      const sSmsKeyword *pKeyword = tooLong ? NULL : fCommand_Lookup(word, len);
+      if(pKeyword != NULL) {
+        if(pKeyword->Command != eNO_COMMAND && pArgs->CommandType == eNO_COMMAND) {
+          pArgs->CommandType = pKeyword->Command;
+        }
+        if(pKeyword->Switch != eSWITCH_NONE && pArgs->Switch == eSWITCH_NONE) {
+          pArgs->Switch = pKeyword->Switch;
+        }
+      }
+      len = 0;
+      tooLong = false;
+    }
+
+    if(c >= '0' && c <= '9' && !numberSeen) {
+
+      bool negative = (p > pText) && (p[-1] == '-');
+      bool overflow = false;
+      int32_t value = 0;
+
+      for(; *p >= '0' && *p <= '9'; p++) {
+        if(value > (INT32_MAX - (*p - '0')) / 10) {
+          overflow = true;
+        } else if(!overflow) {
+          value = value * 10 + (*p - '0');
+        }
+      }
+      p--;
+
+      numberSeen = true;
+      if(!overflow) {
+        pArgs->Value = negative ? -value : value;
+        pArgs->HasValue = true;
+      }
+    }
+
+    if(c == '\0') break;
+  }
+
+  return pArgs->CommandType != eNO_COMMAND;
+}
+
+static const sSmsKeyword *fCommand_Lookup(const char *pWord, uint8_t Len) {
+
+  for(size_t i = 0; i < SMS_KEYWORD_COUNT; i++) {
+    if(SmsKeywords[i].Len == Len && memcmp(SmsKeywords[i].pWord, pWord, Len) == 0) {
+      return &SmsKeywords[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Queues a message to one number
+ * 
+ * @param pNumber normalized number
+ * @param pText 
+ * @param Len 
+ * @param Priority 
+ * @param pTicket NULL, or gets the ticket of the message
+ * @return sim800_res_t 
+ */
+static sim800_res_t fEnqueueMsg(const char *pNumber, const char *pText, uint16_t Len, eSim800SmsPriority Priority,
+                                uint16_t *pTicket) {
+
+  sSmsJob job = {};
+  job.Priority = Priority;
+
+  if(fCodec_BcdPack(pNumber, job.Number, sizeof(job.Number)) == 0) {
+    return SIM800_RES_PHONENUMBER_INVALID;
+  }
+
+  sim800_res_t res = fAllocMsg(pText, Len, Priority, &job.Slot);
+  if(res != SIM800_RES_OK) {
+    return res;
+  }
+
+  if(fEnqueueJob(&job) != SIM800_RES_OK) {
+    fReleaseMsg(job.Slot);
+    return SIM800_RES_ENQUEUE_FAIL;
+  }
+
+  Sim800.SmsQueue[job.Slot].Ticket = fTicket_Open();
+  if(pTicket != NULL) *pTicket = Sim800.SmsQueue[job.Slot].Ticket;
+  fQueueLog_Enqueue(&job);
+
+  Serial.printf("Enqueued SMS to %s. QueueCount=%d\n", pNumber, Sim800.QueueCount);
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Next recipient and its payload. A single send leaves the queue, a broadcast
+ *        stays at the head until its cursor has passed the last phonebook number.
+ *        The caller gets a reference to the slot and gives it back with fReleaseMsg.
+ * 
+ * @param pSlot 
+ * @param pNumber 
+ * @param Size 
+ * @param pPriority class it was queued in
+ * @param pRecipient phonebook entries of a broadcast handed out with this one, 0 for a single send
+ * @return sim800_res_t 
+ */
+static sim800_res_t fDequeueMsg(uint8_t *pSlot, char *pNumber, uint8_t Size, eSim800SmsPriority *pPriority,
+                                uint16_t *pRecipient) {
+
+  sSmsJobQueue *pQueue;
+
+  while((pQueue = fPickJobQueue()) != NULL) {
+
+    sSmsJob *pJob = &pQueue->Jobs[pQueue->Head];
+    bool found;
+
+    *pPriority = pJob->Priority;
+    *pRecipient = 0;
+
+    if(pJob->Broadcast) {
+      found = fPhonebook_At(pJob->Cursor++, pNumber, Size);
+      *pRecipient = pJob->Cursor;
+      if(found) {
+        Sim800.SmsQueue[pJob->Slot].RefCount++;
+        if(fPhonebook_At(pJob->Cursor, NULL, 0)) {
+          *pSlot = pJob->Slot;
+          pJob->Queued = SIM800_MILLIS(); // ages again from here, like a new message
+          return SIM800_RES_OK; // more recipients, the job stays
+        }
+      }
+    } else {
+      found = true;
+      fCodec_BcdUnpack(pJob->Number, sizeof(pJob->Number), pNumber, Size);
+      Sim800.SmsQueue[pJob->Slot].RefCount++;
+    }
+
+    *pSlot = pJob->Slot;
+    pQueue->Head = (pQueue->Head + 1) % SIM800_SMS_QUEUE_SIZE;
+    pQueue->Count--;
+    Sim800.QueueCount--;
+    fReleaseMsg(pJob->Slot); // the job's own reference
+
+    if(found) {
+      Serial.printf("Message dequeued: slot %d, text: %s\n", *pSlot, Sim800.SmsQueue[*pSlot].Text);
+      return SIM800_RES_OK;
+    }
+  }
+
+  return SIM800_RES_QUEUE_EMPTY;
+}
+
+/**
+ * @brief Copies the UTF-8 text into a free slot, nothing references it yet.
+ *        The encoding is picked here, the text is encoded only when it is sent.
+ *        A backlog of other messages cannot take the slots kept for alarms.
+ * 
+ * @param pText 
+ * @param Len 
+ * @param Priority 
+ * @param pSlot 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fAllocMsg(const char *pText, uint16_t Len, eSim800SmsPriority Priority, uint8_t *pSlot) {
+
+  uint8_t reserved = (Priority == eSMS_PRIORITY_ALARM) ? 0 : SIM800_SMS_ALARM_RESERVED_SLOTS;
+
+  if(Sim800.FreeCount <= reserved) {
+
+    Serial.println("SMS queue full!");
+    return SIM800_RES_ENQUEUE_FAIL;
+  }
+
+  if(Len > SIM800_SMS_TEXT_MAX_LEN) {
+
+    Serial.printf("SMS text is %u bytes, a slot holds %u\n", Len, SIM800_SMS_TEXT_MAX_LEN);
+    return SIM800_RES_SMS_TOO_LONG;
+  }
+
+  sSim800TextInfo info;
+  fCodec_Analyze(pText, Len, &info);
+
+  // Nothing is cut off later, a text the parts cannot carry is refused here
+  if(info.Segments == 0 || info.Segments > SIM800_SMS_MAX_PARTS) {
+
+    Serial.printf("SMS text takes more than %u parts\n", SIM800_SMS_MAX_PARTS);
+    return SIM800_RES_SMS_TOO_LONG;
+  }
+
+  *pSlot = Sim800.SmsFree[--Sim800.FreeCount];
+  sSmsMessage *pMsg = &Sim800.SmsQueue[*pSlot];
+
+  memcpy(pMsg->Text, pText, Len);
+  pMsg->Text[Len] = '\0';
+  pMsg->TextLen = Len;
+  pMsg->Dcs = info.Dcs;
+  pMsg->Segments = info.Segments;
+  pMsg->Ticket = 0;
+  pMsg->RefCount = 1; // the caller's, handed to the job it queues
+  Sim800.TicketHooks[*pSlot].pfDone = NULL;
+  Sim800.TicketHooks[*pSlot].pCtx = NULL;
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Queues a job, it takes over the caller's reference to the slot
+ * 
+ * @param pJob 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fEnqueueJob(const sSmsJob *pJob) {
+
+  sSmsJobQueue *pQueue = &Sim800.SmsJobs[pJob->Priority];
+
+  if(pQueue->Count >= SIM800_SMS_QUEUE_SIZE) {
+
+    Serial.println("SMS queue full!");
+    return SIM800_RES_ENQUEUE_FAIL;
+  }
+
+  pQueue->Jobs[pQueue->Tail] = *pJob;
+  pQueue->Jobs[pQueue->Tail].Queued = SIM800_MILLIS();
+  pQueue->Tail = (pQueue->Tail + 1) % SIM800_SMS_QUEUE_SIZE;
+  pQueue->Count++;
+  Sim800.QueueCount++;
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Line the next send comes from: alarms first, then the oldest head of
+ *        the other classes that waited past SIM800_SMS_AGING_MS, then by class
+ * 
+ * @return sSmsJobQueue* NULL when nothing is waiting
+ */
+static sSmsJobQueue *fPickJobQueue(void) {
+
+  sSmsJobQueue *pAged = NULL;
+  unsigned long now = SIM800_MILLIS();
+
+  if(Sim800.SmsJobs[eSMS_PRIORITY_ALARM].Count > 0) {
+    return &Sim800.SmsJobs[eSMS_PRIORITY_ALARM];
+  }
+
+  for(uint8_t i = eSMS_PRIORITY_ALARM + 1; i < eSMS_PRIORITY_COUNT; i++) {
+
+    sSmsJobQueue *pQueue = &Sim800.SmsJobs[i];
+    if(pQueue->Count == 0) continue;
+
+    unsigned long queued = pQueue->Jobs[pQueue->Head].Queued;
+    if(now - queued >= SIM800_SMS_AGING_MS &&
+       (pAged == NULL || (long)(queued - pAged->Jobs[pAged->Head].Queued) < 0)) {
+      pAged = pQueue;
+    }
+  }
+
+  if(pAged != NULL) return pAged;
+
+  for(uint8_t i = eSMS_PRIORITY_ALARM + 1; i < eSMS_PRIORITY_COUNT; i++) {
+    if(Sim800.SmsJobs[i].Count > 0) return &Sim800.SmsJobs[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Drops one reference, the slot goes back to the pool with the last one
+ * 
+ * @param Slot 
+ */
+static void fReleaseMsg(uint8_t Slot) {
+
+  if(--Sim800.SmsQueue[Slot].RefCount > 0) return;
+
+  Sim800.SmsFree[Sim800.FreeCount++] = Slot;
+  fTicket_Close(Slot);
+}
+
+/**
+ * @brief Phonebook number at a position, in the order the phonebook is stored
+ * 
+ * @param Index 
+ * @param pNumber NULL to only check that the entry exists
+ * @param Size 
+ * @return true when there is such an entry
+ */
+static bool fPhonebook_At(uint16_t Index, char *pNumber, uint8_t Size) {
+
+  if(Index >= Sim800.Phonebook.Count) return false;
+
+  if(pNumber != NULL) {
+    fCodec_BcdUnpack(Sim800.Phonebook.Entries[Index].Number, SIM800_PHONE_BCD_LEN, pNumber, Size);
+  }
+
+  return true;
+}
+
+/**
+ * @brief Binary search. Normalized numbers all have the same digit count, so the
+ *        packed bytes compare like the numbers.
+ * 
+ * @param pBcd 
+ * @param pIndex where the number is, or where it would be inserted
+ * @return true when it is in the phonebook
+ */
+static bool fPhonebook_Find(const uint8_t *pBcd, uint16_t *pIndex) {
+
+  uint16_t low = 0;
+  uint16_t high = Sim800.Phonebook.Count;
+
+  while(low < high) {
+
+    uint16_t mid = low + (high - low) / 2;
+    int cmp = memcmp(Sim800.Phonebook.Entries[mid].Number, pBcd, SIM800_PHONE_BCD_LEN);
+
+    if(cmp == 0) {
+      *pIndex = mid;
+      return true;
+    }
+    if(cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  *pIndex = low;
+  return false;
+}
+
+/**
+ * @brief Contact of a normalized number
+ * 
+ * @param pNumber 
+ * @return const sSim800Contact* NULL when the number is not in the phonebook
+ */
+static const sSim800Contact *fPhonebook_Lookup(const char *pNumber) {
+
+  uint8_t bcd[SIM800_PHONE_BCD_LEN];
+  uint16_t index;
+
+  if(fCodec_BcdPack(pNumber, bcd, sizeof(bcd)) == 0 || !fPhonebook_Find(bcd, &index)) {
+    return NULL;
+  }
+
+  return &Sim800.Phonebook.Entries[index];
+}
+
+/**
+ * @brief Inserts a normalized number in order, or updates its flags when it is there
+ * 
+ * @param pNumber 
+ * @param Flags 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fPhonebook_Add(const char *pNumber, uint8_t Flags) {
+
+  sSim800Phonebook *pBook = &Sim800.Phonebook;
+  uint8_t bcd[SIM800_PHONE_BCD_LEN];
+  uint16_t index;
+
+  if(fCodec_BcdPack(pNumber, bcd, sizeof(bcd)) != SIM800_PHONE_MAX_DIGITS) {
+    return SIM800_RES_PHONENUMBER_INVALID;
+  }
+
+  if(fPhonebook_Find(bcd, &index)) {
+    pBook->Entries[index].Flags = Flags;
+    return SIM800_RES_OK;
+  }
+
+  if(pBook->Count >= SIM800_PHONEBOOK_SIZE) {
+    return SIM800_RES_PHONEBOOK_FULL;
+  }
+
+  memmove(&pBook->Entries[index + 1], &pBook->Entries[index], (pBook->Count - index) * sizeof(sSim800Contact));
+  memcpy(pBook->Entries[index].Number, bcd, sizeof(bcd));
+  pBook->Entries[index].Flags = Flags;
+  pBook->Count++;
+
+  return SIM800_RES_OK;
+}
+
+static sim800_res_t fPhonebook_Remove(const char *pNumber) {
+
+  sSim800Phonebook *pBook = &Sim800.Phonebook;
+  uint8_t bcd[SIM800_PHONE_BCD_LEN];
+  uint16_t index;
+
+  if(fCodec_BcdPack(pNumber, bcd, sizeof(bcd)) == 0 || !fPhonebook_Find(bcd, &index)) {
+    return SIM800_RES_PHONENUMBER_NOT_FOUND;
+  }
+
+  pBook->Count--;
+  memmove(&pBook->Entries[index], &pBook->Entries[index + 1], (pBook->Count - index) * sizeof(sSim800Contact));
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Builds the dial command for a normalized (09xxxxxxxxx) number
+ * 
+ * @param pNormalized 
+ * @param pCmd 
+ */
+static void fCall_BuildCommand(const char *pNormalized, sSim800Cmd *pCmd) {
+
+  snprintf(pCmd->Command, sizeof(pCmd->Command), "ATD+98%s;", pNormalized + 1);
+  strncpy(pCmd->Expected, ATOK, sizeof(pCmd->Expected) - 1);
+  pCmd->TimeoutMs = WIAT_FOR_CALL_RESPONSE;
+  pCmd->Attempts = 1;
+}
+
+/**
+ * @brief SMS sender tick: when idle, resends a message whose delivery report did
+ *        not come, or picks the next queued one. Every other transition happens
+ *        in the command callbacks below.
+ * 
+ */
+static void fSmsTx_Process(void) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+
+  if(pTx->State != eSMS_TX_IDLE || Sim800.Config.Syncing) return;
+
+  fReport_Expire();
+
+  if(fReport_Resend()) {
+
+    if(pTx->Attempts >= SIM800_SEND_SMS_ATTEMPTS) {
+      Serial.printf("No delivery report received within timeout after %d times.\n", pTx->Attempts);
+      fSmsTx_Finish(SIM800_RES_DELIVERY_REPORT_FAIL);
+      return;
+    }
+
+  } else {
+
+    // Every confirmed send needs an in-flight entry, hold new ones until reports free some
+    if(Sim800.EnableDeliveryReport && !fReport_HasRoom()) return;
+
+    if(fDequeueMsg(&pTx->Slot, pTx->Number, sizeof(pTx->Number), &pTx->Priority, &pTx->Recipient) != SIM800_RES_OK) {
+      return;
+    }
+    pTx->Attempts = 0;
+  }
+
+  sSmsMessage *pMsg = &Sim800.SmsQueue[pTx->Slot];
+
+  Serial.print("Sending sms to ");Serial.println(pTx->Number);
+  fTicket_Phase(pMsg->Ticket, eSMS_STATUS_SENDING);
+
+  // Text mode sends one UCS2 message, anything longer goes as PDU parts whatever UsePduMode says
+  bool fitsText = fCodec_Ucs2Length(pMsg->Text, pMsg->TextLen) <= SIM800_UCS2_MAX_CHARS;
+
+  pTx->PduMode = false;
+  if(Sim800.UsePduMode || !fitsText) {
+
+    pTx->Dcs = pMsg->Dcs;
+    pTx->PartCount = pMsg->Segments;
+    pTx->PartIndex = 0;
+    pTx->PartOffset = 0;
+    pTx->ConcatRef++;
+
+    pTx->PduMode = pTx->PartCount != 0 && pTx->PartCount <= SIM800_SMS_MAX_PARTS && fSmsTx_BuildPdu();
+    if(!pTx->PduMode && !fitsText) {
+      Serial.println("message does not fit the PDU parts or one text mode SMS");
+      fSmsTx_Finish(SIM800_RES_SMS_TOO_LONG);
+      return;
+    }
+    if(!pTx->PduMode) {
+      Serial.println("message does not fit the PDU parts, sending it in text mode");
+    }
+  }
+  Sim800.Config.PduMode = pTx->PduMode;
+
+  pTx->Retries = 0;
+  pTx->State = eSMS_TX_SETUP;
+  fCfg_Sync(fSmsTx_OnSetupDone);
+}
+
+/**
+ * @brief Encodes the current part of the message as an SMS-SUBMIT. Only the last
+ *        part asks for a status report, it is the one the sender waits for.
+ * 
+ * @return false when the number or the text does not fit
+ */
+static bool fSmsTx_BuildPdu(void) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+  const sSmsMessage *pMsg = &Sim800.SmsQueue[pTx->Slot];
+  char number[24];
+  bool last = pTx->PartIndex + 1 >= pTx->PartCount;
+
+  snprintf(number, sizeof(number), "98%s", pTx->Number + 1);
+
+  sSim800PduSubmit submit = {};
+  submit.pNumber = number;
+  submit.pText = pMsg->Text + pTx->PartOffset;
+  submit.Dcs = pTx->Dcs;
+  submit.MessageRef = pTx->MessageRef;
+  submit.StatusReport = Sim800.EnableDeliveryReport && last;
+  submit.ConcatRef = pTx->ConcatRef;
+  submit.PartCount = pTx->PartCount;
+  submit.PartNumber = pTx->PartIndex + 1;
+
+  uint16_t remaining = pMsg->TextLen - pTx->PartOffset;
+  if(pTx->PartCount > 1) {
+    uint16_t units = (pTx->Dcs == eSMS_DCS_GSM7) ? SIM800_GSM7_CONCAT_SEPTETS : SIM800_UCS2_CONCAT_CHARS;
+    pTx->PartLen = fCodec_FitPrefix(submit.pText, remaining, pTx->Dcs, units);
+  } else {
+    pTx->PartLen = remaining;
+  }
+  submit.TextLen = pTx->PartLen;
+
+  pTx->PduLen = fPdu_BuildSubmit(&submit, pTx->Pdu, sizeof(pTx->Pdu));
+
+  return pTx->PduLen != 0;
+}
+
+/**
+ * @brief Queues AT+CMGS, the body is written from fSmsTx_WritePayload on the prompt
+ * 
+ */
+static void fSmsTx_Submit(void) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+  sSim800Cmd cmd = {};
+
+  if(pTx->PduMode) {
+    pTx->Pdu[SIM800_PDU_MR_OFFSET] = pTx->MessageRef++; // every submission gets its own reference
+    snprintf(cmd.Command, sizeof(cmd.Command), SET_PDU_LENGTH "%u", pTx->PduLen - 1);
+  } else {
+    snprintf(cmd.Command, sizeof(cmd.Command), SET_PHONE_NUM "+98%s\"", pTx->Number + 1);
+  }
+  strncpy(cmd.Expected, "+CMGS:", sizeof(cmd.Expected) - 1);
+  cmd.TimeoutMs = WAIT_FOR_SIM800_SMS_SUBMIT;
+  cmd.Attempts = 1;
+  cmd.pfPayload = fSmsTx_WritePayload;
+  cmd.pfDone = fSmsTx_OnSubmit;
+
+  pTx->State = eSMS_TX_SUBMIT;
+
+  if(fCmd_Submit(&cmd) != SIM800_RES_OK) {
+    fSmsTx_Finish(SIM800_RES_SEND_SMS_FAIL);
+  }
+}
+
+/**
+ * @brief Submits again until SIM800_SEND_SMS_ATTEMPTS is used up
+ * 
+ * @param Result 
+ */
+static void fSmsTx_Retry(sim800_res_t Result) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+
+  pTx->Retries++;
+  if(pTx->Retries < SIM800_SEND_SMS_ATTEMPTS) {
+    fSmsTx_Submit();
+    return;
+  }
+
+  fSmsTx_Finish(Result);
+}
+
+/**
+ * @brief Ends the current message, escalating to a call when delivery could not be confirmed
+ * 
+ * @param Result 
+ */
+static void fSmsTx_Finish(sim800_res_t Result) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+
+  Serial.printf("sending while finished with delivery status %d\n", Result == SIM800_RES_OK);
+
+  if (Result == SIM800_RES_OK) {
+
+    Serial.println("SMS sent successfully.");
+
+  } else {
+
+    Serial.printf("Failed to send SMS to %s (err=%d).\n", pTx->Number, Result);
+    if(Sim800.EnableDeliveryReport && Result != SIM800_RES_PHONENUMBER_INVALID && Result != SIM800_RES_SMS_REJECTED &&
+       Result != SIM800_RES_SMS_TOO_LONG) {
+
+      Serial.println("All SMS retries failed");
+
+      sSim800Cmd cmd = {};
+      fCall_BuildCommand(pTx->Number, &cmd);
+      cmd.pfDone = fSmsTx_OnCall;
+
+      if(fCmd_Submit(&cmd) == SIM800_RES_OK) {
+        fTicket_Phase(Sim800.SmsQueue[pTx->Slot].Ticket, eSMS_STATUS_CALLED);
+        pTx->State = eSMS_TX_CALL;
+        return;
+      }
+    }
+    fTicket_Outcome(Sim800.SmsQueue[pTx->Slot].Ticket, eSMS_STATUS_FAILED);
+  }
+
+  fReleaseMsg(pTx->Slot);
+  pTx->State = eSMS_TX_IDLE;
+}
+
+/**
+ * @brief Only the settings the modem lost are sent before the message
+ * 
+ * @param Result 
+ */
+static void fSmsTx_OnSetupDone(sim800_res_t Result) {
+
+  if(Result != SIM800_RES_OK) {
+    fSmsTx_Finish(SIM800_RES_SEND_COMMAND_FAIL);
+    return;
+  }
+
+  fSmsTx_Submit();
+}
+
+static void fSmsTx_OnSubmit(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+
+  if(Result == SIM800_RES_PHONENUMBER_INVALID || Result == SIM800_RES_SMS_REJECTED) {
+    fSmsTx_Finish(Result); // the network refused this message, resending cannot help
+    return;
+  }
+
+  if(Result != SIM800_RES_OK) {
+    fSmsTx_Retry(Sim800.EnableDeliveryReport ? SIM800_RES_DELIVERY_REPORT_FAIL : SIM800_RES_SEND_SMS_FAIL);
+    return;
+  }
+
+  // Next part right away, the modem is already set up for it
+  if(pTx->PduMode && pTx->PartIndex + 1 < pTx->PartCount) {
+
+    pTx->PartOffset += pTx->PartLen;
+    pTx->PartIndex++;
+    pTx->Retries = 0;
+    if(!fSmsTx_BuildPdu()) {
+      fSmsTx_Finish(SIM800_RES_SEND_SMS_FAIL);
+      return;
+    }
+    fSmsTx_Submit();
+    return;
+  }
+
+  // The report is matched when it comes, the sender goes on with the next message
+  uint16_t ticket = Sim800.SmsQueue[pTx->Slot].Ticket;
+  if(pTx->Recipient > 0) {
+    fQueueLog_Sent(ticket, pTx->Recipient);
+  }
+  if(Sim800.EnableDeliveryReport && fReport_Track(pResponse)) {
+    fTicket_Phase(ticket, eSMS_STATUS_SENT);
+  } else {
+    if(Sim800.EnableDeliveryReport) {
+      Serial.println("delivery of this message is not tracked.");
+    }
+    fTicket_Outcome(ticket, eSMS_STATUS_SENT);
+  }
+
+  fSmsTx_Finish(SIM800_RES_OK);
+}
+
+static void fSmsTx_OnCall(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+  uint16_t ticket = Sim800.SmsQueue[pTx->Slot].Ticket;
+
+  if(Result == SIM800_RES_OK) {
+
+    Serial.println("ReEnqueue massage...");
+    fTicket_Outcome(ticket, eSMS_STATUS_CALLED);
+
+    // Back to this one number even when it came from a broadcast
+    sSmsJob job = {};
+    job.Slot = pTx->Slot;
+    job.Priority = pTx->Priority;
+    fCodec_BcdPack(pTx->Number, job.Number, sizeof(job.Number));
+    if(fEnqueueJob(&job) == SIM800_RES_OK) {
+      Sim800.SmsQueue[pTx->Slot].RefCount++;
+      fTicket_Phase(ticket, eSMS_STATUS_QUEUED);
+    }
+
+  } else {
+    fTicket_Outcome(ticket, eSMS_STATUS_FAILED);
+  }
+
+  fReleaseMsg(pTx->Slot);
+
+  pTx->State = eSMS_TX_IDLE;
+}
+
+/**
+ * @brief Writes the SMS body: the hex PDU, or the text as AT+CSCS="HEX" wants it
+ * 
+ * @param pCtx 
+ */
+static void fSmsTx_WritePayload(void *pCtx) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+  const sSmsMessage *pMsg = &Sim800.SmsQueue[pTx->Slot];
+  char chunk[64];
+
+  if(!pTx->PduMode) {
+
+    // Text mode has no concatenation, fSmsTx_Process only sends messages that fit one UCS2 SMS here
+    const char *pText = pMsg->Text;
+    const char *pEnd = pText + pMsg->TextLen;
+    uint16_t len;
+
+    while((len = fCodec_Ucs2Hex(&pText, pEnd, chunk, sizeof(chunk))) != 0) {
+      Sim800.ComPort->write((const uint8_t *)chunk, len);
+    }
+    return;
+  }
+
+  for(uint16_t i = 0; i < pTx->PduLen; i += sizeof(chunk) / 2) {
+
+    uint16_t count = pTx->PduLen - i;
+    if(count > sizeof(chunk) / 2) count = sizeof(chunk) / 2;
+    Sim800.ComPort->write((const uint8_t *)chunk, fCodec_HexEncode(&pTx->Pdu[i], count, chunk));
+  }
+}
+
+/**
+ * @brief Remembers the message just sent under the reference in +CMGS: <mr>. The
+ *        entry takes its own reference to the payload, the sender releases its one.
+ * 
+ * @param pResponse the +CMGS line
+ * @return false when the line has no reference or the table is full
+ */
+static bool fReport_Track(const char *pResponse) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+  const char *pMr = strchr(pResponse, ':');
+  sSmsInFlight *pFree = NULL;
+
+  if(pMr == NULL) return false;
+  uint8_t mr = (uint8_t)atoi(pMr + 1);
+
+  for(uint8_t i = 0; i < SIM800_SMS_INFLIGHT_SIZE; i++) {
+
+    sSmsInFlight *pEntry = &Sim800.InFlight[i];
+
+    // The reference wrapped (or the modem restarted), a report for the old one cannot be told apart
+    if(pEntry->State == eREPORT_WAITING && pEntry->MessageRef == mr) {
+      pEntry->State = eREPORT_EXPIRED;
+    }
+    if(pEntry->State == eREPORT_FREE && pFree == NULL) {
+      pFree = pEntry;
+    }
+  }
+
+  if(pFree == NULL) return false;
+
+  pFree->State = eREPORT_WAITING;
+  pFree->MessageRef = mr;
+  pFree->Slot = pTx->Slot;
+  pFree->Priority = pTx->Priority;
+  pFree->Attempts = pTx->Attempts + 1;
+  pFree->Sent = SIM800_MILLIS();
+  fCodec_BcdPack(pTx->Number, pFree->Number, sizeof(pFree->Number));
+  Sim800.SmsQueue[pTx->Slot].RefCount++;
+
+  Serial.printf("waiting for delivery report (mr=%u).\n", mr);
+  return true;
+}
+
+/**
+ * @brief Settles the in-flight message a report belongs to
+ * 
+ * @param MessageRef 
+ * @param Status TP-ST
+ */
+static void fReport_Match(uint8_t MessageRef, uint8_t Status) {
+
+  for(uint8_t i = 0; i < SIM800_SMS_INFLIGHT_SIZE; i++) {
+
+    sSmsInFlight *pEntry = &Sim800.InFlight[i];
+
+    if(pEntry->State != eREPORT_WAITING || pEntry->MessageRef != MessageRef) continue;
+
+    if(Status < 0x20) {
+
+      Serial.printf("SMS delivery confirmed (mr=%u).\n", MessageRef);
+      fTicket_Outcome(Sim800.SmsQueue[pEntry->Slot].Ticket, eSMS_STATUS_DELIVERED);
+      fReleaseMsg(pEntry->Slot);
+      pEntry->State = eREPORT_FREE;
+
+    } else if(Status < 0x40) {
+
+      // The service centre is still trying, the final report comes later
+      pEntry->Sent = SIM800_MILLIS();
+
+    } else {
+
+      Serial.printf("SMS delivery failed (mr=%u, st=%u).\n", MessageRef, Status);
+      pEntry->State = eREPORT_EXPIRED;
+    }
+    return;
+  }
+
+  Serial.printf("delivery report of an unknown message (mr=%u).\n", MessageRef);
+}
+
+static void fReport_OnPdu(const char *pLine, void *pCtx) {
+
+  uint8_t mr;
+  uint8_t status;
+
+  if(fPdu_ParseStatusReport(pLine, strlen(pLine), &mr, &status)) {
+    fReport_Match(mr, status);
+  }
+}
+
+/**
+ * @brief Gives up on reports that took longer than WAIT_FOR_SIM800_SEND_SMS_DELIVERY
+ * 
+ */
+static void fReport_Expire(void) {
+
+  unsigned long now = SIM800_MILLIS();
+
+  for(uint8_t i = 0; i < SIM800_SMS_INFLIGHT_SIZE; i++) {
+
+    sSmsInFlight *pEntry = &Sim800.InFlight[i];
+
+    if(pEntry->State == eREPORT_WAITING && now - pEntry->Sent >= WAIT_FOR_SIM800_SEND_SMS_DELIVERY) {
+      Serial.printf("No delivery report received within timeout (mr=%u).\n", pEntry->MessageRef);
+      pEntry->State = eREPORT_EXPIRED;
+    }
+  }
+}
+
+/**
+ * @brief Hands the most urgent unconfirmed message back to the sender, with its
+ *        reference to the payload. Waiting alarms go before resends of other classes.
+ * 
+ * @return true when SmsTx was loaded with a resend
+ */
+static bool fReport_Resend(void) {
+
+  sSim800SmsTx *pTx = &Sim800.SmsTx;
+  sSmsInFlight *pPick = NULL;
+
+  for(uint8_t i = 0; i < SIM800_SMS_INFLIGHT_SIZE; i++) {
+
+    sSmsInFlight *pEntry = &Sim800.InFlight[i];
+
+    if(pEntry->State == eREPORT_EXPIRED && (pPick == NULL || pEntry->Priority < pPick->Priority)) {
+      pPick = pEntry;
+    }
+  }
+
+  if(pPick == NULL) return false;
+  if(pPick->Priority != eSMS_PRIORITY_ALARM && Sim800.SmsJobs[eSMS_PRIORITY_ALARM].Count > 0) return false;
+
+  pTx->Slot = pPick->Slot;
+  pTx->Priority = pPick->Priority;
+  pTx->Attempts = pPick->Attempts;
+  pTx->Recipient = 0;
+  fCodec_BcdUnpack(pPick->Number, sizeof(pPick->Number), pTx->Number, sizeof(pTx->Number));
+  pPick->State = eREPORT_FREE;
+
+  return true;
+}
+
+static bool fReport_HasRoom(void) {
+
+  for(uint8_t i = 0; i < SIM800_SMS_INFLIGHT_SIZE; i++) {
+    if(Sim800.InFlight[i].State == eREPORT_FREE) return true;
+  }
+
+  return false;
+}
+
+/**
+ * @brief New ticket in the entry its id maps to. Entries of unfinished tickets
+ *        are skipped, there are never more of them than payload slots.
+ * 
+ * @return uint16_t never 0
+ */
+static uint16_t fTicket_Open(void) {
+
+  sSmsTicket *pTicket;
+
+  do {
+    if(++Sim800.NextTicket == 0) Sim800.NextTicket = 1;
+    pTicket = &Sim800.Tickets[Sim800.NextTicket & SIM800_SMS_TICKET_TABLE_MASK];
+  } while(pTicket->Id != 0 && !pTicket->Done);
+
+  pTicket->Id = Sim800.NextTicket;
+  pTicket->Status = eSMS_STATUS_QUEUED;
+  pTicket->Outcome = eSMS_STATUS_UNKNOWN;
+  pTicket->Done = false;
+
+  return pTicket->Id;
+}
+
+static sSmsTicket *fTicket_Find(uint16_t Id) {
+
+  sSmsTicket *pTicket = &Sim800.Tickets[Id & SIM800_SMS_TICKET_TABLE_MASK];
+
+  return (Id != 0 && pTicket->Id == Id) ? pTicket : NULL;
 }
 
 /**
- * @brief 
+ * @brief What the message is doing now, shown until it is done
  * 
- * @param me 
- * @param Command 
- * @param DesiredResponse 
- * @return sim800_res_t 
+ * @param Id 
+ * @param Status 
  */
-static sim800_res_t fSendCommand(String Command, String DesiredResponse, String *pResponse) {
+static void fTicket_Phase(uint16_t Id, eSim800SmsStatus Status) {
 
-  Serial.printf("sending command: %s\n", Command.c_str());
-  if (Sim800.ComPort == nullptr) {
-    Serial.println("ERROR: ComPort null!");
-    return SIM800_RES_INIT_FAIL;
+  sSmsTicket *pTicket = fTicket_Find(Id);
+
+  if(pTicket != NULL && !pTicket->Done) {
+    pTicket->Status = Status;
   }
+}
 
-  bool commandResponsed = false;
-  int commandTries = 0;
+/**
+ * @brief Result for one recipient, the ticket keeps the worst
+ * 
+ * @param Id 
+ * @param Status 
+ */
+static void fTicket_Outcome(uint16_t Id, eSim800SmsStatus Status) {
 
-  unsigned long startTime = millis();
+  sSmsTicket *pTicket = fTicket_Find(Id);
 
-  while(Sim800.IsSending && millis() - startTime < WAIT_FOR_SIM800_READY_SEND_COMMAND){};
-  
-  if(Sim800.IsSending) {
+  if(pTicket != NULL && !pTicket->Done && fTicket_Rank(Status) > fTicket_Rank(pTicket->Outcome)) {
+    pTicket->Outcome = Status;
+  }
+}
 
-    Serial.println("Failed to send command: device is sending...");
-    return SIM800_RES_SEND_COMMAND_FAIL;
+static uint8_t fTicket_Rank(uint8_t Status) {
+
+  switch(Status) {
+    case eSMS_STATUS_DELIVERED: return 1;
+    case eSMS_STATUS_SENT:      return 2;
+    case eSMS_STATUS_CALLED:    return 3;
+    case eSMS_STATUS_FAILED:    return 4;
+    default:                    return 0;
   }
+}
 
-  while(!commandResponsed && commandTries < Sim800.CommandSendRetries) {
-    
-    esp_task_wdt_reset();
-    commandTries++;
-    Sim800.IsSending = true;
-    
-    Serial.printf("\nSending %s  ...(%d) -- desired response: %s\n", Command.c_str(), commandTries, DesiredResponse);
+/**
+ * @brief The payload was released, nothing more happens to its message
+ * 
+ * @param Slot 
+ */
+static void fTicket_Close(uint8_t Slot) {
+
+  uint16_t id = Sim800.SmsQueue[Slot].Ticket;
+  sSmsTicket *pTicket = fTicket_Find(id);
+
+  if(pTicket == NULL || pTicket->Done) return;
 
-    Sim800.ComPort->println(Command);
-    unsigned long startTime = millis();
+  fQueueLog_Done(id);
 
-    while(!commandResponsed && ((millis() - startTime) < WAIT_FOR_COMMAND_RESPONSE_MS)) {
+  pTicket->Status = pTicket->Outcome;
+  if(pTicket->Outcome == eSMS_STATUS_UNKNOWN) {
+    pTicket->Status = eSMS_STATUS_FAILED; // nothing was sent, e.g. a broadcast that found no valid number
+  }
+  pTicket->Done = true;
 
-      esp_task_wdt_reset();
-      while(Sim800.ComPort->available() > 0) {  
+  if(Sim800.TicketHooks[Slot].pfDone != NULL) {
+    Sim800.TicketHooks[Slot].pfDone(id, (eSim800SmsStatus)pTicket->Status, Sim800.TicketHooks[Slot].pCtx);
+  }
+}
 
-        esp_task_wdt_reset();
+/**
+ * @brief Logs a queued message before anything is sent, an alarm goes to flash right away
+ * 
+ * @param pJob 
+ */
+static void fQueueLog_Enqueue(const sSmsJob *pJob) {
 
-        String line = Sim800.ComPort->readString();
+  const sSmsMessage *pMsg = &Sim800.SmsQueue[pJob->Slot];
+  static uint8_t record[QUEUE_LOG_TEXT_OFFSET + SIM800_SMS_TEXT_MAX_LEN];   // a compaction may follow, kept off the stack
 
-        Serial.println("==== readed data =====");  
-        Serial.println(line);
-        Serial.print("line indexOf(DesiredRes): ");
-        Serial.println(line.indexOf(DesiredResponse));
+  if(Sim800.QueueLog.pPath == NULL) return;
 
-        if (line.indexOf(DesiredResponse) != -1) {
+  record[0] = (uint8_t)pJob->Priority;
+  record[1] = pJob->Broadcast ? QUEUE_LOG_FLAG_BROADCAST : 0;
+  memcpy(&record[2], pJob->Number, SIM800_PHONE_BCD_LEN);
+  memcpy(&record[QUEUE_LOG_TEXT_OFFSET], pMsg->Text, pMsg->TextLen);
 
-          Serial.printf("Request %s : Success.\n", Command.c_str());
-          if(pResponse != nullptr) {
-            *pResponse = line;
-          }
-          commandResponsed = true;
-          break;
-        }
-      }
-    }
-    delay(10);
+  fQueueLog_Write(eQUEUE_LOG_ENQUEUE, pMsg->Ticket, record, QUEUE_LOG_TEXT_OFFSET + pMsg->TextLen,
+                  pJob->Priority == eSMS_PRIORITY_ALARM);
+}
 
-    // if(!commandResponsed) {
+/**
+ * @brief How far a broadcast got, a replay goes on from there
+ * 
+ * @param Ticket 
+ * @param Recipients 
+ */
+static void fQueueLog_Sent(uint16_t Ticket, uint16_t Recipients) {
 
-    //   Sim800.IsSending = false;
-    //   fGSM_Init(); //reinit
-    // }
-  }
+  uint8_t record[2] = { (uint8_t)Recipients, (uint8_t)(Recipients >> 8) };
 
-  Sim800.IsSending = false;
+  fQueueLog_Write(eQUEUE_LOG_SENT, Ticket, record, sizeof(record), false);
+}
 
-  if(commandResponsed == true) {
-    return SIM800_RES_OK;
-  } else {
-	  return SIM800_RES_SEND_COMMAND_FAIL;
-  }
+static void fQueueLog_Done(uint16_t Ticket) {
+
+  fQueueLog_Write(eQUEUE_LOG_DONE, Ticket, NULL, 0, false);
 }
 
 /**
- * @brief 
+ * @brief Adds a record to the queue log. When the log cannot take it, the log is
+ *        rewritten, which also writes out the batch, and the record goes in after.
  * 
- * @return sim800_res_t 
+ * @param Type 
+ * @param Ticket 
+ * @param pData 
+ * @param Len 
+ * @param Flush write it to flash now
  */
-static sim800_res_t fGSM_Init(void) {
+static void fQueueLog_Write(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, bool Flush) {
 
-  if(fSendCommand(AT, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    // RestartGSM();
-    return SIM800_RES_SEND_COMMAND_FAIL;
+  sSim800Wal *pLog = &Sim800.QueueLog;
+
+  if(pLog->pPath == NULL) return;
+
+  if(!fWal_Append(pLog, Type, Ticket, pData, Len)) {
+    if(!fQueueLog_Compact(false) || !fWal_Append(pLog, Type, Ticket, pData, Len)) {
+      Serial.printf("queue log record %u of ticket %u lost\n", Type, Ticket);
+      return;
+    }
   }
-  if(fSendCommand(CHECK_SIMCARD_INSERTED, SIMCARD_INSERTED) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SIMCARD_NOT_INSERTED;
+
+  // A failed write keeps the batch, the rewrite takes it along
+  if(Flush && !fWal_Flush(pLog)) {
+    fQueueLog_Compact(false);
   }
-  if(fSendCommand(RESET_FACTORY, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
+}
+
+/**
+ * @brief Writes batched records once they waited SIM800_QUEUE_LOG_FLUSH_MS and
+ *        keeps the log short: dropped when nothing is queued, rewritten with only
+ *        the live messages when it grew past SIM800_QUEUE_LOG_COMPACT_SIZE
+ * 
+ */
+static void fQueueLog_Process(void) {
+
+  sSim800Wal *pLog = &Sim800.QueueLog;
+
+  if(pLog->pPath == NULL) return;
+
+  if(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE) {
+    if(pLog->Size > 0 || pLog->Used > 0) {
+      fWal_Clear(pLog);
+    }
+    return;
   }
-  // if(fSendCommand(IRANCELL, ATOK) != SIM800_RES_OK) {
-  //   Sim800.IsSending = false;
-  //   return SIM800_RES_SEND_COMMAND_FAIL;
-  // }
-  if(fSendCommand(DELETE_ALL_MSGS, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
+
+  if(pLog->Used > 0 && SIM800_MILLIS() - pLog->Pending >= SIM800_QUEUE_LOG_FLUSH_MS && !fWal_Flush(pLog) &&
+     !fQueueLog_Compact(false)) {
+    pLog->Pending = SIM800_MILLIS(); // tried again SIM800_QUEUE_LOG_FLUSH_MS from now
   }
-  if(fSendCommand(SET_TEXT_MODE, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
+
+  if(pLog->Size >= SIM800_QUEUE_LOG_COMPACT_SIZE) {
+    fQueueLog_Compact(false);
   }
-  if(fSendCommand(SET_TEXT_HEX_MODE, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
+}
+
+/**
+ * @brief Rewrites the log with only the messages not done yet. The first pass
+ *        finds them, the second copies their ENQUEUE records and progress.
+ *        Both read the file and the batch, so records a failed write left
+ *        in RAM are kept. On replay the messages are queued again and logged
+ *        under their new tickets.
+ * 
+ * @param Replay 
+ * @return false when the log could not be rewritten, the old one and the batch stay
+ */
+static bool fQueueLog_Compact(bool Replay) {
+
+  sQueueLogScan scan;
+
+  scan.Count = 0;
+  scan.Record = 0;
+  scan.Replay = Replay;
+  scan.Failed = false;
+
+  (void)fWal_Flush(&Sim800.QueueLog); // a batch it cannot write is copied from RAM
+  fWal_ScanLog(&Sim800.QueueLog, fQueueLog_OnLive, &scan);
+
+  scan.Record = 0;
+  fWal_BeginRewrite(&scan.Out, SmsQueueLogTmpPath);
+  fWal_ScanLog(&Sim800.QueueLog, fQueueLog_OnCopy, &scan);
+
+  if(scan.Failed) {
+    SIM800_FS.remove(SmsQueueLogTmpPath);
+    Serial.println("queue log rewrite failed");
+    return false;
   }
-  if(fSendCommand(SET_TEXT_HEX_MODE_CONFIG, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
+
+  if(!fWal_CommitRewrite(&Sim800.QueueLog, &scan.Out)) {
+    Serial.println("queue log rewrite failed");
+    return false;
   }
-  if(Sim800.EnableDeliveryReport) {
-    if(fSendCommand(DELIVERY_ENABLE, ATOK) != SIM800_RES_OK) {
-      Sim800.IsSending = false;
-      return SIM800_RES_SEND_SMS_FAIL;
-    }
+
+  if(Replay && scan.Count > 0) {
+    Serial.printf("%u queued messages restored from flash\n", scan.Count);
   }
 
-  return SIM800_RES_OK;
+  return true;
 }
 
-static sim800_res_t fRecivedSms_Parse(const String *pLine) {
+static void fQueueLog_OnLive(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx) {
 
-  if (!pLine->startsWith("+CMGL:")) {
-    return SIM800_RES_REVIEVED_SMS_INVALID;
+  sQueueLogScan *pScan = (sQueueLogScan *)pCtx;
+  uint16_t record = pScan->Record++;
+  sQueueLogLive *pLive = NULL;
+
+  for(uint8_t i = 0; i < pScan->Count; i++) {
+    if(pScan->Live[i].Ticket == Ticket) {
+      pLive = &pScan->Live[i];
+      break;
+    }
   }
 
-  // Example: +CMGL: 1,"REC UNREAD","+989123456789","","25/09/12,21:32:15+14"
-  int firstComma = pLine->indexOf(',');
-  if (firstComma == -1) return SIM800_RES_REVIEVED_SMS_INVALID;
+  if(Type == eQUEUE_LOG_ENQUEUE) {
 
-  // Extract index
-  String idxStr = pLine->substring(6, firstComma);
-  Sim800._args.MassageData.index = idxStr.toInt();
+    if(pLive == NULL) {
+      if(pScan->Count >= SIM800_SMS_QUEUE_SIZE) return;
+      pLive = &pScan->Live[pScan->Count++];
+    }
+    pLive->Ticket = Ticket;
+    pLive->Recipients = 0;
+    pLive->Record = record;
 
-  // Extract phone number (inside 3rd quoted string)
-  int firstQuote = pLine->indexOf('"', firstComma + 1);   // "REC UNREAD"
-  int secondQuote = pLine->indexOf('"', firstQuote + 1);
+  } else if(Type == eQUEUE_LOG_SENT && pLive != NULL && Len >= 2) {
 
-  int thirdQuote = pLine->indexOf('"', secondQuote + 1);  // phone number
-  int fourthQuote = pLine->indexOf('"', thirdQuote + 1);
+    uint16_t recipients = (uint16_t)(pData[0] | (pData[1] << 8));
+    if(recipients > pLive->Recipients) pLive->Recipients = recipients;
 
-  if (thirdQuote == -1 || fourthQuote == -1) return SIM800_RES_REVIEVED_SMS_INVALID;
-  String phoneNumber = pLine->substring(thirdQuote + 1, fourthQuote);
+  } else if(Type == eQUEUE_LOG_DONE && pLive != NULL) {
 
-  if(fNormalizedPhoneNumber(phoneNumber, &Sim800._args.MassageData.phoneNumber) != SIM800_RES_OK) {
-    return SIM800_RES_PHONENUMBER_INVALID;
+    *pLive = pScan->Live[--pScan->Count];
   }
+}
+
+static void fQueueLog_OnCopy(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx) {
 
-  Sim800._args.MassageData.IsAdmin = Sim800.SavedPhoneNumbers[Sim800._args.MassageData.phoneNumber];  
+  sQueueLogScan *pScan = (sQueueLogScan *)pCtx;
+  uint16_t record = pScan->Record++;
+  const sQueueLogLive *pLive = NULL;
 
-  // Extract datetime (last quoted string)
-  int lastQuoteOpen = pLine->lastIndexOf('"');
-  int lastQuoteClose = pLine->lastIndexOf('"', lastQuoteOpen - 1);
-  if (lastQuoteOpen > lastQuoteClose) {
-    Sim800._args.MassageData.dateTime = pLine->substring(lastQuoteClose + 1, lastQuoteOpen);
+  if(Type != eQUEUE_LOG_ENQUEUE) return;
+
+  for(uint8_t i = 0; i < pScan->Count; i++) {
+    if(pScan->Live[i].Record == record) {
+      pLive = &pScan->Live[i];
+      break;
+    }
   }
 
-  return SIM800_RES_OK;
+  if(pLive == NULL) return;
+
+  if(pScan->Replay && fQueueLog_Restore(pData, Len, pLive->Recipients, &Ticket) != SIM800_RES_OK) {
+    Serial.println("a logged message could not be queued again");
+    return;
+  }
+
+  if(!fWal_Append(&pScan->Out, eQUEUE_LOG_ENQUEUE, Ticket, pData, Len)) pScan->Failed = true;
+  if(pLive->Recipients > 0) {
+    uint8_t sent[2] = { (uint8_t)pLive->Recipients, (uint8_t)(pLive->Recipients >> 8) };
+    if(!fWal_Append(&pScan->Out, eQUEUE_LOG_SENT, Ticket, sent, sizeof(sent))) pScan->Failed = true;
+  }
 }
 
 /**
- * @brief 
+ * @brief Queues a logged message again, a broadcast goes on after the recipients it reached
  * 
- * @param pRecSms 
+ * @param pData ENQUEUE record
+ * @param Len 
+ * @param Recipients 
+ * @param pTicket gets the new ticket
  * @return sim800_res_t 
  */
-static sim800_res_t fRecivedSms_CheckCommand(void) {
-
-  if(Sim800.SavedPhoneNumbers.containsKey(Sim800._args.MassageData.phoneNumber)) {
+static sim800_res_t fQueueLog_Restore(const uint8_t *pData, uint16_t Len, uint16_t Recipients, uint16_t *pTicket) {
 
-    Serial.println("Recived sms from admin, check command");
+  sSmsJob job = {};
 
-    Sim800._args.MassageData.Massage.toLowerCase();
-    bool commandIsValid = false;
+  if(Len < QUEUE_LOG_TEXT_OFFSET || pData[0] >= eSMS_PRIORITY_COUNT) return SIM800_RES_ENQUEUE_FAIL;
 
-    if(Sim800._args.MassageData.Massage.indexOf(SYSTEM) != -1) {
+  job.Priority = (eSim800SmsPriority)pData[0];
+  job.Broadcast = (pData[1] & QUEUE_LOG_FLAG_BROADCAST) != 0;
+  job.Cursor = Recipients;
+  memcpy(job.Number, &pData[2], SIM800_PHONE_BCD_LEN);
 
-      Sim800._args.CommandType = eSYSTEM_COMMAND;
-      commandIsValid = true;
-    
-    } else if(Sim800._args.MassageData.Massage.indexOf(LAMP) != -1) {
+  // Everything here was queued before, the slots kept for alarms are for new messages
+  if(fAllocMsg((const char *)&pData[QUEUE_LOG_TEXT_OFFSET], Len - QUEUE_LOG_TEXT_OFFSET, eSMS_PRIORITY_ALARM,
+               &job.Slot) != SIM800_RES_OK) {
+    return SIM800_RES_ENQUEUE_FAIL;
+  }
 
-      Sim800._args.CommandType = eLAMP_COMMAND;
-      commandIsValid = true;
+  if(fEnqueueJob(&job) != SIM800_RES_OK) {
+    fReleaseMsg(job.Slot);
+    return SIM800_RES_ENQUEUE_FAIL;
+  }
 
-    } else if(Sim800._args.MassageData.Massage.indexOf(SMSIP) != -1) {
+  Sim800.SmsQueue[job.Slot].Ticket = fTicket_Open();
+  *pTicket = Sim800.SmsQueue[job.Slot].Ticket;
 
-      Sim800._args.CommandType = eIP_COMMAND;
-      commandIsValid = true;
+  return SIM800_RES_OK;
+}
 
-    } else if (Sim800._args.MassageData.Massage.indexOf(ALARM) != -1) {
+/**
+ * @brief Rebuilds the phonebook from its log, record by record. A phonebook still
+ *        in the old JSON file is moved into the log the first time.
+ * 
+ */
+static void fPhonebookLog_Load(void) {
 
-      Sim800._args.CommandType = eALARM_COMMAND;
-      commandIsValid = true;
+  sSim800Wal *pLog = &Sim800.PhonebookLog;
 
-    } else if (Sim800._args.MassageData.Massage.indexOf(MONOXIDE)!=-1) {
+  Sim800.Phonebook.Count = 0;
+  fWal_Open(pLog, PhonebookLogPath, PhonebookLogTmpPath);
 
-      Sim800._args.CommandType = eMONIXIDE_COMMAND;
-      commandIsValid = true;
+  if(pLog->Size == 0) {
 
-    } else if(Sim800._args.MassageData.Massage.indexOf(FIRE)!=-1) {
+    if(SIM800_FS.exists(SavedPhoneNumbersPath)) {
+      fPhonebookLog_ImportJson(SavedPhoneNumbersPath);
+      if(fPhonebookLog_Compact() == SIM800_RES_OK) {
+        SIM800_FS.remove(SavedPhoneNumbersPath);
+      }
+    }
+    return;
+  }
 
-      Sim800._args.CommandType = eFIRE_COMMAND;
-      commandIsValid = true;
+  // Appending after a damaged record would hide everything written later
+  if(fWal_Scan(pLog->pPath, fPhonebookLog_OnRecord, NULL) != pLog->Size) {
+    Serial.println("phonebook log damaged, rewriting it");
+    fPhonebookLog_Compact();
+  }
+}
 
-    } else if(Sim800._args.MassageData.Massage.indexOf(HUMIDITY)!=-1) {
-      
-      Sim800._args.CommandType = eHUMIDITY_COMMAND;
-      commandIsValid = true;
-    } else if (Sim800._args.MassageData.Massage.indexOf(TEMP)!=-1) {
+/**
+ * @brief Writes one change to the end of the log, a log grown past
+ *        SIM800_PHONEBOOK_LOG_COMPACT_SIZE is rewritten instead
+ * 
+ * @param Type 
+ * @param pNumber normalized
+ * @return sim800_res_t 
+ */
+static sim800_res_t fPhonebookLog_Append(uint8_t Type, const char *pNumber) {
 
-      Sim800._args.CommandType = eTEMP_COMMAND;
-      commandIsValid = true;
-    }
-    
-    if(commandIsValid) {
+  sSim800Wal *pLog = &Sim800.PhonebookLog;
+  uint8_t record[SIM800_PHONE_BCD_LEN + 1];
+  uint16_t len = SIM800_PHONE_BCD_LEN;
 
-      Sim800.IsSending = false;
-      fNotifyEventCommand_();
-      return SIM800_RES_OK;
+  if(pLog->Size >= SIM800_PHONEBOOK_LOG_COMPACT_SIZE) {
+    return fPhonebookLog_Compact();
+  }
 
-    } else {
-      return SIM800_RES_REVIEVED_SMS_INVALID;
-    }
+  fCodec_BcdPack(pNumber, record, SIM800_PHONE_BCD_LEN);
+  if(Type == ePHONEBOOK_LOG_ADD) {
+    const sSim800Contact *pContact = fPhonebook_Lookup(pNumber);
+    record[len++] = (pContact != NULL) ? pContact->Flags : 0;
+  }
 
-  } else {
-    return SIM800_RES_PHONENUMBER_INVALID;
+  // A change that did not reach the log is written with the rest of the phonebook
+  if(!fWal_Append(pLog, Type, 0, record, len) || !fWal_Flush(pLog)) {
+    return fPhonebookLog_Compact();
   }
 
   return SIM800_RES_OK;
 }
 
 /**
- * @brief 
+ * @brief Replaces the log with one ADD record per contact, through a temporary
+ *        file so a reset keeps either the old log or the new one
  * 
- * @param PhoneNumber 
- * @param Text 
  * @return sim800_res_t 
  */
-static sim800_res_t fEnqueueMsg(String PhoneNumber, String Text) {
+static sim800_res_t fPhonebookLog_Compact(void) {
+
+  sSim800Wal out;
+  uint8_t record[SIM800_PHONE_BCD_LEN + 1];
 
-  if(Sim800.QueueCount >= SIM800_SMS_QUEUE_SIZE) {
+  fWal_BeginRewrite(&out, PhonebookLogTmpPath);
+  for(uint16_t i = 0; i < Sim800.Phonebook.Count; i++) {
 
-      Serial.println("SMS queue full!");
-      return SIM800_RES_ENQUEUE_FAIL;
+    const sSim800Contact *pContact = &Sim800.Phonebook.Entries[i];
+    memcpy(record, pContact->Number, SIM800_PHONE_BCD_LEN);
+    record[SIM800_PHONE_BCD_LEN] = pContact->Flags;
+
+    if(!fWal_Append(&out, ePHONEBOOK_LOG_ADD, 0, record, sizeof(record))) {
+      SIM800_FS.remove(PhonebookLogTmpPath);
+      Serial.println("phonebook log rewrite failed");
+      return SIM800_RES_SAVE_JSON_FAIL;
     }
-    Serial.printf("queue tail = %d\n", Sim800.QueueTail);
-    Sim800.SmsQueue[Sim800.QueueTail].PhoneNumber = PhoneNumber;
-    Sim800.SmsQueue[Sim800.QueueTail].Text = Text;
-    Sim800.QueueTail = (Sim800.QueueTail + 1) % SIM800_SMS_QUEUE_SIZE;
-    Sim800.QueueCount++;
-    Serial.printf("Enqueued SMS to %s. QueueCount=%d\n", PhoneNumber.c_str(), Sim800.QueueCount);
+  }
 
-    return SIM800_RES_OK;
+  if(!fWal_CommitRewrite(&Sim800.PhonebookLog, &out)) {
+    Serial.println("phonebook log rewrite failed");
+    return SIM800_RES_SAVE_JSON_FAIL;
+  }
+
+  return SIM800_RES_OK;
+}
+
+static void fPhonebookLog_OnRecord(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx) {
+
+  char number[SIM800_PHONE_MAX_DIGITS + 1];
+
+  if(Len < SIM800_PHONE_BCD_LEN) return;
+
+  fCodec_BcdUnpack(pData, SIM800_PHONE_BCD_LEN, number, sizeof(number));
+
+  if(Type == ePHONEBOOK_LOG_ADD && Len > SIM800_PHONE_BCD_LEN) {
+    fPhonebook_Add(number, pData[SIM800_PHONE_BCD_LEN]);
+  } else if(Type == ePHONEBOOK_LOG_REMOVE) {
+    fPhonebook_Remove(number);
+  }
 }
 
 /**
- * @brief 
+ * @brief Reads the flat { "09xxxxxxxxx": 1, ... } file the phonebook used to be
+ *        saved in, a character at a time
  * 
- * @param msg 
- * @return sim800_res_t 
+ * @param pPath 
  */
-static sim800_res_t fDequeueMsg(sSmsMessage *msg) {
-
-  if(Sim800.QueueCount == 0) {
-    return SIM800_RES_QUEUE_EMPTY;
+static void fPhonebookLog_ImportJson(const char *pPath) {
+
+  char number[SIM800_PHONE_MAX_DIGITS + 2];   // one more, so a longer key does not pass as a number
+  uint8_t len = 0;
+  bool inKey = false;
+  bool haveKey = false;
+  int c;
+
+  File file = SIM800_FS.open(pPath, FILE_READ);
+  if(!file) return;
+
+  while((c = file.read()) >= 0) {
+
+    if(inKey) {
+      if(c == '"') {
+        number[len] = '\0';
+        inKey = false;
+        haveKey = true;
+      } else if(len < sizeof(number) - 1) {
+        number[len++] = (char)c;
+      }
+    } else if(c == '"') {
+      inKey = true;
+      haveKey = false;
+      len = 0;
+    } else if(haveKey && c >= '0' && c <= '9') {
+      fPhonebook_Add(number, (c != '0') ? SIM800_CONTACT_ADMIN : 0);
+      haveKey = false;
+    }
   }
 
-   *msg = (Sim800.SmsQueue[Sim800.QueueHead]);
-   if(msg == NULL) {
-    return SIM800_RES_QUEUE_EMPTY;
-   }
-   
-   Sim800.QueueHead = (Sim800.QueueHead + 1) % SIM800_SMS_QUEUE_SIZE;
-   Sim800.QueueCount--;
-
-   Serial.printf("Message dequeued: phone num:%s , text: %s\n", msg->PhoneNumber.c_str(), msg->Text.c_str());
-  
-  return SIM800_RES_OK;
+  file.close();
 }
 
 /**
- * @brief 
+ * @brief Keeps one part of a multipart message. Parts are matched by sender and
+ *        reference; with every slot taken the one idle longest makes room.
  * 
- * @param PhoneNumber 
- * @param Text 
- * @return sim800_res_t 
+ * @param pInfo 
+ * @param pNumber sender, packed BCD
+ * @param pText the part, UTF-8
+ * @return const char* the whole message in Sim800.Inbox.Body once the last part
+ *         is in, NULL until then
  */
-static sim800_res_t fSim800_SMSSend_Immediate(String PhoneNumber, String Text) {
+static const char *fConcat_Add(const sSmsConcatInfo *pInfo, const uint8_t *pNumber, const char *pText) {
 
-  int retryCount = 0;
-  bool deliveryReceived = false;
+  sSmsConcat *pSlot = NULL;
+  sSmsConcat *pOldest = NULL;
 
-  Serial.print("Sending sms to ");Serial.println(PhoneNumber);
-
-  unsigned long startTime = millis();
-  while(Sim800.IsSending && (millis() - startTime < WAIT_FOR_SIM800_READY_SEND_COMMAND)){};
-  if(Sim800.IsSending) {
-    return SIM800_RES_SEND_SMS_FAIL;
+  if(pInfo->Total > SIM800_INBOX_CONCAT_PARTS || pInfo->Part == 0 || pInfo->Part > pInfo->Total) {
+    Serial.printf("multipart massage part %u of %u dropped\n", pInfo->Part, pInfo->Total);
+    return NULL;
   }
 
-  Serial.println("Start sending");
+  for(uint8_t i = 0; i < SIM800_INBOX_CONCAT_SLOTS; i++) {
 
-  if(fSendCommand(SET_TEXT_MODE, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
-  }
+    sSmsConcat *pEntry = &Sim800.Inbox.Concat[i];
 
-  if(fSendCommand(SET_TEXT_HEX_MODE, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
+    if(!pEntry->Used) {
+      if(pSlot == NULL) pSlot = pEntry;
+      continue;
+    }
+    if(pEntry->Ref == pInfo->Ref && pEntry->Total == pInfo->Total &&
+       memcmp(pEntry->Number, pNumber, SIM800_PHONE_BCD_LEN) == 0) {
+      pSlot = pEntry;
+      break;
+    }
+    if(pOldest == NULL || (long)(pEntry->Touched - pOldest->Touched) < 0) {
+      pOldest = pEntry;
+    }
   }
 
-  if(fSendCommand(SET_TEXT_HEX_MODE_CONFIG, ATOK) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_SEND_COMMAND_FAIL;
+  if(pSlot == NULL) {
+    Serial.printf("multipart massage %u evicted for a new one\n", pOldest->Ref);
+    pSlot = pOldest;
+    pSlot->Used = false;
   }
 
-  if(Sim800.EnableDeliveryReport) {
-    if(fSendCommand(DELIVERY_ENABLE, ATOK) != SIM800_RES_OK) {
-      Sim800.IsSending = false;
-      return SIM800_RES_SEND_SMS_FAIL;
-    }
+  if(!pSlot->Used) {
+    pSlot->Used = true;
+    memcpy(pSlot->Number, pNumber, SIM800_PHONE_BCD_LEN);
+    pSlot->Ref = pInfo->Ref;
+    pSlot->Total = pInfo->Total;
+    pSlot->Received = 0;
   }
 
-  String NormalizedPhoneNum;
-  if(fNormalizedPhoneNumber(PhoneNumber, &NormalizedPhoneNum) != SIM800_RES_OK) {
-    Sim800.IsSending = false;
-    return SIM800_RES_PHONENUMBER_INVALID;
+  uint8_t part = pInfo->Part - 1;
+  size_t len = strlen(pText);
+  if(len > SIM800_INBOX_PART_MAX_LEN) len = SIM800_INBOX_PART_MAX_LEN;
+
+  memcpy(pSlot->Text[part], pText, len);
+  pSlot->Len[part] = (uint8_t)len;
+  pSlot->Received |= 1 << part;
+  pSlot->Touched = SIM800_MILLIS();
+
+  if(pSlot->Received != (uint8_t)((1u << pSlot->Total) - 1)) return NULL;
+
+  char *pBody = Sim800.Inbox.Body;
+  uint16_t used = 0;
+
+  for(uint8_t i = 0; i < pSlot->Total; i++) {
+    memcpy(&pBody[used], pSlot->Text[i], pSlot->Len[i]);
+    used += pSlot->Len[i];
   }
+  pBody[used] = '\0';
+  pSlot->Used = false;
 
-  while(retryCount < SIM800_SEND_SMS_ATTEMPTS && !deliveryReceived) {
+  return pBody;
+}
 
-    esp_task_wdt_reset();
+/**
+ * @brief Drops multipart messages whose missing parts did not come within
+ *        SIM800_INBOX_CONCAT_TIMEOUT_MS
+ * 
+ */
+static void fConcat_Expire(void) {
 
-    String TargetPhoneNumber = String(SET_PHONE_NUM) + "+98" + NormalizedPhoneNum.substring(1) + "\"";
-    if(fSendCommand(TargetPhoneNumber, SEND_SMS_START) != SIM800_RES_OK) {
+  unsigned long now = SIM800_MILLIS();
 
-      Sim800.IsSending = false;
-      retryCount++;
-      continue;
-    }
+  for(uint8_t i = 0; i < SIM800_INBOX_CONCAT_SLOTS; i++) {
 
-    Sim800.IsSending = true;
-    Sim800.ComPort->print(Text);
-    Sim800.ComPort->write(SEND_SMS_END);
-    delay(100);
-    Sim800.IsSending = false;
+    sSmsConcat *pSlot = &Sim800.Inbox.Concat[i];
 
-    if(Sim800.EnableDeliveryReport) {
+    if(pSlot->Used && now - pSlot->Touched >= SIM800_INBOX_CONCAT_TIMEOUT_MS) {
+      Serial.printf("multipart massage %u incomplete, dropped\n", pSlot->Ref);
+      pSlot->Used = false;
+    }
+  }
+}
 
-      Serial.println("delivery is enable.");
-      if(fCheckForDeliveryReport() == SIM800_RES_OK) {
+/**
+ * @brief Puts a handler in a free slot of its type, a handler already there is
+ *        kept once. A plain handler takes the place of the plain one before it.
+ * 
+ * @param Type 
+ * @param pfHandler 
+ * @param pfPlain used when pfHandler is NULL
+ * @param pCtx 
+ * @return sim800_res_t 
+ */
+static sim800_res_t fEvent_Add(eCommandType Type, pfSim800CommandEvent pfHandler,
+                               void(*pfPlain)(sSim800RecievedMassgeDone *pArgs), void *pCtx) {
 
-        Serial.println("SMS delivery confirmed.");
-        deliveryReceived = true;
-        break;
+  sSim800Subscriber *pFree = NULL;
 
-      } else {
-        Serial.printf("No delivery report received within timeout after %d times.\n", retryCount + 1);
-      }
+  if((unsigned)Type >= eCOMMAND_COUNT) {
+    return SIM800_RES_INIT_FAIL;
+  }
 
-    } else {
+  for(uint8_t i = 0; i < SIM800_EVENT_SUBSCRIBERS; i++) {
 
-      deliveryReceived = true; // No delivery report check, assume success
-      break;
+    sSim800Subscriber *pSubscriber = &Sim800.Subscribers[Type][i];
+
+    if(pSubscriber->pfHandler == NULL && pSubscriber->pfPlain == NULL) {
+      if(pFree == NULL) pFree = pSubscriber;
+      continue;
+    }
+    if(pfPlain != NULL && pSubscriber->pfPlain != NULL) {
+      pSubscriber->pfPlain = pfPlain;
+      return SIM800_RES_OK;
+    }
+    if(pSubscriber->pfHandler == pfHandler && pSubscriber->pfPlain == pfPlain && pSubscriber->pCtx == pCtx) {
+      return SIM800_RES_OK;
     }
-    
-    retryCount++;
   }
 
-  Serial.printf("sending while finished with delivery status %d\n", deliveryReceived);
+  if(pFree == NULL) {
+    return SIM800_RES_SUBSCRIBERS_FULL;
+  }
 
-  Sim800.IsSending = false;
-  return deliveryReceived ? SIM800_RES_OK : SIM800_RES_DELIVERY_REPORT_FAIL;
+  pFree->pCtx = pCtx;
+  pFree->pfPlain = pfPlain;
+  pFree->pfHandler = pfHandler;
+
+  return SIM800_RES_OK;
 }
 
 /**
- * @brief Function to convert Persian string to UCS2 HEX format
+ * @brief Hands a command to its handlers, now or through the deferred queue. When
+ *        every pool slot is still being handled the command is dropped rather
+ *        than holding up the UART.
  * 
- * @param text 
- * @return String 
+ * @param pArgs 
  */
-static String fTextToHex(String text) {
+static void fEvent_Post(sSim800RecievedMassgeDone *pArgs) {
 
-  String output = "";
-  int len = text.length();
+  uint8_t slot;
 
-  for (int i = 0; i < len; ) {
+  if(!Sim800.DeferEvents || EventFree == NULL) {
+    fEvent_Dispatch(pArgs);
+    return;
+  }
 
-    uint32_t codepoint = 0;
-    uint8_t c = text[i];
+  if(!SIM800_EVENT_QUEUE_RECEIVE(EventFree, &slot, 0)) {
+    Serial.printf("command event queue full, command %d dropped\n", pArgs->CommandType);
+    return;
+  }
 
-    // 1-byte UTF-8 (ASCII)
-    if (c < 0x80) {
+  // Into the buffers reserved at init, the texts are never longer
+  sSim800RecievedMassgeDone *pSlot = &Sim800.EventPool[slot];
+  pSlot->MassageData.index = pArgs->MassageData.index;
+  pSlot->MassageData.Header = pArgs->MassageData.Header;
+  pSlot->MassageData.IsAdmin = pArgs->MassageData.IsAdmin;
+  pSlot->MassageData.phoneNumber = pArgs->MassageData.phoneNumber.c_str();
+  pSlot->MassageData.dateTime = pArgs->MassageData.dateTime.c_str();
+  pSlot->MassageData.Massage = pArgs->MassageData.Massage.c_str();
+  pSlot->CommandType = pArgs->CommandType;
+  pSlot->Switch = pArgs->Switch;
+  pSlot->HasValue = pArgs->HasValue;
+  pSlot->Value = pArgs->Value;
+  (void)SIM800_EVENT_QUEUE_SEND(EventReady, &slot);
+}
 
-      codepoint = c;
-      i += 1;
-    }
-    // 2-byte UTF-8
-    else if ((c & 0xE0) == 0xC0) {
+/**
+ * @brief Calls the handlers of the command type, then those of every command
+ * 
+ * @param pArgs 
+ */
+static void fEvent_Dispatch(sSim800RecievedMassgeDone *pArgs) {
 
-      codepoint = ((c & 0x1F) << 6) |
-        (text[i+1] & 0x3F);
-      i += 2;
-    }
-    // 3-byte UTF-8 (Persian chars are here)
-    else if ((c & 0xF0) == 0xE0) {
+  const eCommandType types[2] = { pArgs->CommandType, eNO_COMMAND };
 
-      codepoint = ((c & 0x0F) << 12) |
-        ((text[i+1] & 0x3F) << 6) |
-        (text[i+2] & 0x3F);
-      i += 3;
+  for(uint8_t t = 0; t < 2; t++) {
 
-    } else {
-      i++; // skip unsupported
-      continue;
+    if((unsigned)types[t] >= eCOMMAND_COUNT) continue;
+
+    for(uint8_t i = 0; i < SIM800_EVENT_SUBSCRIBERS; i++) {
+
+      const sSim800Subscriber *pSubscriber = &Sim800.Subscribers[types[t]][i];
+
+      if(pSubscriber->pfHandler != NULL) {
+        pSubscriber->pfHandler(pArgs, pSubscriber->pCtx);
+      } else if(pSubscriber->pfPlain != NULL) {
+        pSubscriber->pfPlain(pArgs);
+      }
     }
 
-    // Convert to UTF-16BE hex
-    char buffer[5];
-    sprintf(buffer, "%04X", codepoint);
-    output += buffer;
+    if(types[t] == eNO_COMMAND) break;
   }
-
-  return output;
 }
 
 /**End of Group_Name
@@ -26,8 +26,10 @@
 /* Includes ------------------------------------------------------------------*/
 #include <ArduinoJson.h>
 
+#include "Sim800_codec.h"
 #include "Sim800_defs.h"
 #include "Sim800_texts.h"
+#include "Sim800_wal.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,6 +43,37 @@ extern "C" {
 #define WIAT_FOR_CALL_RESPONSE                  5000
 #define SIM800_SEND_SMS_ATTEMPTS                3
 #define SIM800_SMS_QUEUE_SIZE                   10
+#define WAIT_FOR_SIM800_SMS_SUBMIT              20000
+#define WAIT_FOR_USSD_RESPONSE_MS               10000
+#define WAIT_FOR_USSD_MENU_MS                   2000  /* after the language switch, before the balance query */
+#define SIM800_CMD_QUEUE_SIZE                   8
+#define SIM800_CMD_MAX_LEN                      96
+#define SIM800_CMD_LINE_MAX_LEN                 160
+#define SIM800_CMD_EXPECT_MAX_LEN               24
+#define SIM800_CMD_RESPONSE_MAX_LEN             192
+#define SIM800_RX_RING_SIZE                     256
+#define SIM800_RX_LINE_MAX_LEN                  256
+#define SIM800_URC_TABLE_SIZE                   32
+#define SIM800_INBOX_PENDING_SIZE               16
+#define SIM800_INBOX_CONCAT_SLOTS               3     /* multipart messages collected at the same time */
+#define SIM800_INBOX_CONCAT_PARTS               4     /* longest multipart message taken, up to 8 */
+#define SIM800_INBOX_PART_MAX_LEN               160   /* UTF-8 bytes kept of one part */
+#define SIM800_INBOX_CONCAT_TIMEOUT_MS          300000
+#define SIM800_EVENT_SUBSCRIBERS                4     /* handlers per command type */
+#define SIM800_EVENT_QUEUE_LEN                  8     /* deferred commands waiting for fSim800_DispatchEvents */
+#define SIM800_INBOX_BODY_SIZE                  (SIM800_INBOX_CONCAT_PARTS * SIM800_INBOX_PART_MAX_LEN + 1)
+#define SIM800_SMS_MAX_PARTS                    8
+#define SIM800_SMS_INFLIGHT_SIZE                8     /* sent messages waiting for their +CDS */
+#define SIM800_SMS_TICKET_TABLE_SIZE            16    /* power of two, larger than SIM800_SMS_QUEUE_SIZE */
+#define SIM800_SMS_AGING_MS                     60000
+#define SIM800_SMS_ALARM_RESERVED_SLOTS         2     /* only alarms may take the last free slots */
+#define SIM800_SMS_TEXT_MAX_LEN                 (SIM800_SMS_MAX_PARTS * SIM800_GSM7_CONCAT_SEPTETS)   /* UTF-8 bytes, also every UCS2 part of a two-byte script */
+#define SIM800_QUEUE_LOG_FLUSH_MS               500   /* longest a queue record waits in RAM, alarms are written at once */
+#define SIM800_QUEUE_LOG_COMPACT_SIZE           8192  /* log bytes that trigger a rewrite with only the live messages */
+#define SIM800_PHONE_MAX_DIGITS                 11    /* normalized, 09xxxxxxxxx */
+#define SIM800_PHONE_BCD_LEN                    ((SIM800_PHONE_MAX_DIGITS + 1) / 2)
+#define SIM800_PHONEBOOK_SIZE                   256
+#define SIM800_PHONEBOOK_LOG_COMPACT_SIZE       8192  /* log bytes that trigger a rewrite with one record per contact */
 
 /**
  * @brief Return codes for sim800 operations
@@ -64,21 +97,200 @@ typedef uint8_t sim800_res_t;
 #define SIM800_RES_CALL_INITIAL_FAILD           ((sim800_res_t)13)
 #define SIM800_RES_ENQUEUE_FAIL                 ((sim800_res_t)14)
 #define SIM800_RES_QUEUE_EMPTY                  ((sim800_res_t)15)
+#define SIM800_RES_CMD_ERROR                    ((sim800_res_t)16)
+#define SIM800_RES_CMD_TIMEOUT                  ((sim800_res_t)17)
+#define SIM800_RES_UNEXPECTED_RESPONSE          ((sim800_res_t)18)
+#define SIM800_RES_OPERATION_NOT_ALLOWED        ((sim800_res_t)19)
+#define SIM800_RES_SIM_PIN_REQUIRED             ((sim800_res_t)20)
+#define SIM800_RES_SIM_FAILURE                  ((sim800_res_t)21)
+#define SIM800_RES_SIM_BUSY                     ((sim800_res_t)22)
+#define SIM800_RES_MEMORY_FULL                  ((sim800_res_t)23)
+#define SIM800_RES_NO_NETWORK                   ((sim800_res_t)24)
+#define SIM800_RES_NETWORK_BUSY                 ((sim800_res_t)25)
+#define SIM800_RES_SMS_REJECTED                 ((sim800_res_t)26)
+#define SIM800_RES_NO_CARRIER                   ((sim800_res_t)27)
+#define SIM800_RES_LINE_BUSY                    ((sim800_res_t)28)
+#define SIM800_RES_NO_ANSWER                    ((sim800_res_t)29)
+#define SIM800_RES_NO_DIALTONE                  ((sim800_res_t)30)
+#define SIM800_RES_TICKET_NOT_FOUND             ((sim800_res_t)31)
+#define SIM800_RES_PHONEBOOK_FULL               ((sim800_res_t)32)
+#define SIM800_RES_SUBSCRIBERS_FULL             ((sim800_res_t)33)
+#define SIM800_RES_ENGINE_BUSY                  ((sim800_res_t)34)  /* blocking call made from a driver callback */
+#define SIM800_RES_SUBSCRIBER_NOT_FOUND         ((sim800_res_t)35)
+#define SIM800_RES_SMS_TOO_LONG                 ((sim800_res_t)36)  /* more than a slot or SIM800_SMS_MAX_PARTS parts */
+#define SIM800_RES_CREDIT_BUSY                  ((sim800_res_t)37)  /* a credit check is running already */
+
+/**
+ * @brief Command flags
+ * 
+ */
+#define SIM800_CMD_FLAG_RESPONSE_AFTER_OK       0x01  /* expected line is unsolicited and follows the final OK (+CUSD) */
+#define SIM800_CMD_FLAG_BATCHABLE               0x02  /* extended command expecting OK, may share a line with its neighbours */
+#define SIM800_CMD_FLAG_NO_BATCH                0x04  /* its batch failed, sent alone to find the culprit */
+
+/**
+ * @brief Contact roles
+ * 
+ */
+#define SIM800_CONTACT_ADMIN                    0x01
 
 /* Exported macro ------------------------------------------------------------*/    
 /* Exported types ------------------------------------------------------------*/
 /**
- * @brief 
+ * @brief One slot of the SMS payload pool, filled in place on enqueue and sent from
+ *        where it is. Shared by every job and send that references it.
  * 
 */
 typedef struct {
 
-  String PhoneNumber;
+  uint8_t RefCount;
+
+  eSim800SmsDcs Dcs;                      /* how the text goes out in PDU mode */
+
+  uint8_t Segments;
 
-  String Text;
+  uint16_t TextLen;                       /* UTF-8, encoded only while it is written to the modem */
+
+  uint16_t Ticket;                        /* given to the caller, 0 until the message is queued */
+
+  char Text[SIM800_SMS_TEXT_MAX_LEN + 1];
     
 }sSmsMessage;
 
+/**
+ * @brief Send order. Alarms always go first, a lower class that waited
+ *        SIM800_SMS_AGING_MS goes before newer messages of the classes above it.
+ * 
+ */
+typedef enum {
+
+  eSMS_PRIORITY_ALARM = 0,    /* life safety: fire, CO, intrusion */
+  eSMS_PRIORITY_NORMAL,
+  eSMS_PRIORITY_LOW,          /* confirmations */
+  eSMS_PRIORITY_COUNT
+
+}eSim800SmsPriority;
+
+/**
+ * @brief Where a queued message is. The last three are outcomes, a broadcast
+ *        ends with the worst one among its recipients.
+ * 
+ */
+typedef enum {
+
+  eSMS_STATUS_UNKNOWN = 0,    /* no such ticket, or its entry was reused */
+  eSMS_STATUS_QUEUED,
+  eSMS_STATUS_SENDING,
+  eSMS_STATUS_SENT,           /* accepted by the network, final when delivery reports are off */
+  eSMS_STATUS_DELIVERED,
+  eSMS_STATUS_CALLED,         /* delivery was not confirmed in time, the recipient was called */
+  eSMS_STATUS_FAILED
+
+}eSim800SmsStatus;
+
+/**
+ * @brief Called once when the message of a ticket is done with
+ * 
+ */
+typedef void(*pfSim800SmsDone)(uint16_t Ticket, eSim800SmsStatus Status, void *pCtx);
+
+/**
+ * @brief Result of fSim800_CheckCreditAsync, Credit in Toman and 0 unless Result
+ *        is SIM800_RES_OK. Runs inside the driver, like pfSim800CmdDone.
+ * 
+ */
+typedef void(*pfSim800CreditDone)(sim800_res_t Result, uint32_t Credit, void *pCtx);
+
+/**
+ * @brief Progress of one send, found at Id & (SIM800_SMS_TICKET_TABLE_SIZE - 1).
+ *        6 bytes, the done callback is kept with the payload slot instead.
+ * 
+ */
+typedef struct {
+
+  uint16_t Id;
+
+  uint8_t Status;             /* eSim800SmsStatus, the outcome once Done */
+
+  uint8_t Outcome;            /* worst result so far */
+
+  bool Done;
+
+}sSmsTicket;
+
+/**
+ * @brief fSim800_SMSOnDone callback of the open ticket of a payload slot, only
+ *        open tickets have one and there is one open ticket per slot at most
+ * 
+ */
+typedef struct {
+
+  pfSim800SmsDone pfDone;
+
+  void *pCtx;
+
+}sSmsTicketHook;
+
+/**
+ * @brief One waiting send: a payload slot and who gets it
+ * 
+ */
+typedef struct {
+
+  uint8_t Slot;
+
+  eSim800SmsPriority Priority;
+
+  unsigned long Queued;                   /* when it reached the head of the line, for aging */
+
+  bool Broadcast;                         /* every phonebook number, expanded one at a time */
+
+  uint16_t Cursor;                        /* next phonebook entry of a broadcast */
+
+  uint8_t Number[SIM800_PHONE_BCD_LEN];   /* normalized number of a single send, packed BCD */
+
+}sSmsJob;
+
+/**
+ * @brief Waiting sends of one priority class
+ * 
+ */
+typedef struct {
+
+  sSmsJob Jobs[SIM800_SMS_QUEUE_SIZE];
+
+  uint8_t Head;
+
+  uint8_t Tail;
+
+  uint8_t Count;
+
+}sSmsJobQueue;
+
+/**
+ * @brief One phonebook entry, 7 bytes
+ * 
+ */
+typedef struct {
+
+  uint8_t Number[SIM800_PHONE_BCD_LEN];   /* normalized, packed BCD */
+
+  uint8_t Flags;                          /* SIM800_CONTACT_* */
+
+}sSim800Contact;
+
+/**
+ * @brief Contacts sorted by number for binary search, broadcasts walk them in this order
+ * 
+ */
+typedef struct {
+
+  sSim800Contact Entries[SIM800_PHONEBOOK_SIZE];
+
+  uint16_t Count;
+
+}sSim800Phonebook;
+
 typedef enum {
   
   eNO_COMMAND = 0,
@@ -89,10 +301,304 @@ typedef enum {
   eMONIXIDE_COMMAND,
   eFIRE_COMMAND,
   eHUMIDITY_COMMAND,
-  eTEMP_COMMAND
+  eTEMP_COMMAND,
+  eCOMMAND_COUNT
   
 }eCommandType;
 
+/**
+ * @brief The on/off word of a command, when it has one
+ * 
+ */
+typedef enum {
+
+  eSWITCH_NONE = 0,
+  eSWITCH_ON,
+  eSWITCH_OFF
+
+}eSim800Switch;
+
+/**
+ * @brief Completion callback of a queued AT command. pResponse is valid for the
+ *        call only. Runs inside the driver, blocking API calls from it fail
+ *        with SIM800_RES_ENGINE_BUSY; queue follow-up commands instead.
+ * 
+ */
+typedef void(*pfSim800CmdDone)(sim800_res_t Result, const char *pResponse, void *pCtx);
+
+/**
+ * @brief Called for every response line of a command that is not its final answer
+ * 
+ */
+typedef void(*pfSim800CmdLine)(const char *pLine, void *pCtx);
+
+/**
+ * @brief Called on the "> " prompt to write the data part of a command (SMS body)
+ * 
+ */
+typedef void(*pfSim800CmdPayload)(void *pCtx);
+
+/**
+ * @brief Handler of an unsolicited result code, gets the whole line
+ * 
+ */
+typedef void(*pfSim800UrcHandler)(const char *pLine, void *pCtx);
+
+/**
+ * @brief One slot of the URC dispatch table, keyed by the text before ':'
+ * 
+ */
+typedef struct {
+
+  const char *pPrefix;
+
+  uint8_t PrefixLen;
+
+  pfSim800UrcHandler pfHandler;
+
+  void *pCtx;
+
+}sSim800Urc;
+
+/**
+ * @brief One queued AT command
+ * 
+ */
+typedef struct {
+
+  char Command[SIM800_CMD_MAX_LEN];
+
+  char Expected[SIM800_CMD_EXPECT_MAX_LEN];
+
+  uint32_t TimeoutMs;
+
+  uint8_t Attempts;
+
+  uint8_t Flags;
+
+  pfSim800CmdPayload pfPayload;
+
+  pfSim800CmdLine pfLine;
+
+  pfSim800CmdDone pfDone;
+
+  void *pCtx;
+
+}sSim800Cmd;
+
+typedef enum {
+
+  eCMD_IDLE = 0,
+  eCMD_WAIT_RESPONSE
+
+}eSim800CmdState;
+
+/**
+ * @brief Non-blocking AT command engine, advanced one step per fSim800_Run()
+ * 
+ */
+typedef struct {
+
+  sSim800Cmd Queue[SIM800_CMD_QUEUE_SIZE];
+
+  uint8_t Head;
+
+  uint8_t Tail;
+
+  uint8_t Count;
+
+  eSim800CmdState State;
+
+  uint8_t Tries;
+
+  uint8_t BatchCount;
+
+  bool PayloadSent;
+
+  bool Matched;
+
+  bool FinalSeen;
+
+  bool Processing;                              /* fCmd_Process is on the stack */
+
+  unsigned long StartTime;
+
+  sim800_res_t LastError;
+
+  uint16_t LastErrorCode;
+
+  char Line[SIM800_CMD_LINE_MAX_LEN];
+
+  char Response[SIM800_CMD_RESPONSE_MAX_LEN];
+
+}sSim800CmdEngine;
+
+/**
+ * @brief UART receive ring and CR/LF line framer, lines are handed out as views into Line
+ * 
+ */
+typedef struct {
+
+  uint8_t Ring[SIM800_RX_RING_SIZE];
+
+  uint16_t Head;
+
+  uint16_t Tail;
+
+  char Line[SIM800_RX_LINE_MAX_LEN];
+
+  uint16_t LineLen;
+
+  bool Truncated;
+
+  uint32_t Overflows;
+
+}sSim800RxFramer;
+
+/**
+ * @brief Modem settings the driver depends on
+ * 
+ */
+typedef enum {
+
+  eCFG_MSG_FORMAT = 0,    /* AT+CMGF */
+  eCFG_CHARSET,           /* AT+CSCS */
+  eCFG_SMS_PARAMS,        /* AT+CSMP */
+  eCFG_HEADER_DETAILS,    /* AT+CSDH, <fo> and <dcs> in +CMGR */
+  eCFG_INDICATION,        /* AT+CNMI */
+  eCFG_COUNT
+
+}eSim800Setting;
+
+/**
+ * @brief Shadow of the modem configuration, only settings that differ are sent.
+ *        A NULL entry is unknown, e.g. after AT&F or a modem restart.
+ * 
+ */
+typedef struct {
+
+  const char *Applied[eCFG_COUNT];
+
+  bool PduMode;            /* AT+CMGF wanted by the current user, PDU to send, text to read */
+
+  bool Syncing;
+
+  bool Resync;
+
+  uint8_t Pending;
+
+  sim800_res_t SyncResult;
+
+  void(*pfSyncDone)(sim800_res_t Result);
+
+}sSim800ModemCfg;
+
+typedef enum {
+
+  eSMS_TX_IDLE = 0,
+  eSMS_TX_SETUP,
+  eSMS_TX_SUBMIT,
+  eSMS_TX_CALL
+
+}eSmsTxState;
+
+/**
+ * @brief Outgoing SMS state machine
+ * 
+ */
+typedef struct {
+
+  eSmsTxState State;
+
+  uint8_t Slot;             /* SmsQueue slot being sent, the sender holds a reference until it finishes */
+
+  eSim800SmsPriority Priority;
+
+  char Number[SIM800_PHONE_MAX_DIGITS + 1];
+
+  bool PduMode;
+
+  eSim800SmsDcs Dcs;
+
+  uint8_t Pdu[SIM800_PDU_MAX_LEN];
+
+  uint16_t PduLen;
+
+  uint8_t MessageRef;
+
+  uint8_t ConcatRef;
+
+  uint8_t PartCount;
+
+  uint8_t PartIndex;
+
+  uint16_t PartOffset;      /* bytes of Msg.Text sent in earlier parts */
+
+  uint16_t PartLen;
+
+  uint8_t Retries;          /* of the current submission */
+
+  uint8_t Attempts;         /* earlier sends of this message that got no delivery report */
+
+  uint16_t Recipient;       /* phonebook entries of a broadcast handed out up to this one, 0 for a single send */
+
+}sSim800SmsTx;
+
+/**
+ * @brief USSD dialogue of a credit check, one AT+CUSD step at a time
+ * 
+ */
+typedef struct {
+
+  bool Busy;
+
+  uint8_t Step;             /* of CreditSteps, the one queued or waited for */
+
+  bool Waiting;             /* the step goes out WAIT_FOR_USSD_MENU_MS after WaitStart */
+
+  unsigned long WaitStart;
+
+  sim800_res_t Result;
+
+  uint32_t Credit;
+
+  pfSim800CreditDone pfDone;
+
+  void *pCtx;
+
+}sSim800Credit;
+
+typedef enum {
+
+  eREPORT_FREE = 0,
+  eREPORT_WAITING,
+  eREPORT_EXPIRED           /* no report in time or a failed one, the sender resends it */
+
+}eSmsReportState;
+
+/**
+ * @brief A sent message waiting for its delivery report, matched by the
+ *        reference +CMGS returned. Holds a reference to the payload slot.
+ * 
+ */
+typedef struct {
+
+  eSmsReportState State;
+
+  uint8_t MessageRef;
+
+  uint8_t Slot;
+
+  eSim800SmsPriority Priority;
+
+  uint8_t Attempts;         /* submissions so far */
+
+  unsigned long Sent;
+
+  uint8_t Number[SIM800_PHONE_BCD_LEN];
+
+}sSmsInFlight;
+
 typedef enum {
   
   SMS_IDLE,
@@ -101,6 +607,96 @@ typedef enum {
 
 }eSmsState;
 
+/**
+ * @brief Parts of one inbound multipart message, kept until all of them are in
+ * 
+ */
+typedef struct {
+
+  bool Used;
+
+  uint8_t Number[SIM800_PHONE_BCD_LEN];
+
+  uint16_t Ref;                                   /* concatenation reference of the sender */
+
+  uint8_t Total;
+
+  uint8_t Received;                               /* bit per part */
+
+  unsigned long Touched;                          /* last part, for the timeout and eviction */
+
+  uint8_t Len[SIM800_INBOX_CONCAT_PARTS];
+
+  char Text[SIM800_INBOX_CONCAT_PARTS][SIM800_INBOX_PART_MAX_LEN];
+
+}sSmsConcat;
+
+/**
+ * @brief Inbox reader, message indexes come from +CMTI and are read one by one with AT+CMGR
+ * 
+ */
+typedef struct {
+
+  eSmsState State;
+
+  uint16_t Pending[SIM800_INBOX_PENDING_SIZE];
+
+  uint8_t PendingHead;
+
+  uint8_t PendingCount;
+
+  bool Busy;
+
+  int Index;
+
+  uint8_t Handled;
+
+  char Body[SIM800_INBOX_BODY_SIZE];    /* body of the message being read, decoded to UTF-8 */
+
+  sSmsConcat Concat[SIM800_INBOX_CONCAT_SLOTS];
+
+}sSim800Inbox;
+
+/**
+ * @brief Storage status of +CMGL and +CMGR
+ * 
+ */
+typedef enum {
+
+  eSMS_STAT_REC_UNREAD = 0,
+  eSMS_STAT_REC_READ,
+  eSMS_STAT_STO_UNSENT,
+  eSMS_STAT_STO_SENT,
+  eSMS_STAT_UNKNOWN
+
+}eSim800SmsStat;
+
+/**
+ * @brief Fields of a +CMGL, +CMGR or +CDS header line, read in place
+ * 
+ */
+typedef struct {
+
+  uint16_t Index;                         /* +CMGL only, left as it was otherwise */
+
+  uint8_t Status;                         /* eSim800SmsStat, the TP-ST of a +CDS */
+
+  uint8_t MessageRef;                     /* +CDS only */
+
+  bool NumberValid;
+
+  uint8_t Number[SIM800_PHONE_BCD_LEN];   /* normalized, packed BCD */
+
+  uint32_t Time;                          /* service centre time stamp, seconds since 1970 UTC, 0 when missing */
+
+  bool HasCoding;                         /* a +CMGR with AT+CSDH=1, FirstOctet and Dcs are set */
+
+  uint8_t FirstOctet;                     /* TP-UDHI (0x40) when the body starts with a user data header */
+
+  uint8_t Dcs;
+
+}sSim800SmsHeader;
+
 /**
  * @brief 
  * 
@@ -108,6 +704,8 @@ typedef enum {
 typedef struct{
   
   int index;
+
+  sSim800SmsHeader Header;
   
   String phoneNumber;
 
@@ -127,10 +725,40 @@ typedef struct {
 
   sSmsData MassageData;
 
-  eCommandType CommandType;
+  eCommandType CommandType;   /* first command word of the body */
+
+  eSim800Switch Switch;       /* first "on" or "off" */
+
+  bool HasValue;
+
+  int32_t Value;              /* first number, e.g. a threshold */
 
 }sSim800RecievedMassgeDone;
 
+/**
+ * @brief Command handler, called with the context it was subscribed with.
+ *        Unless Sim800.DeferEvents is set it runs inside fSim800_Run, where
+ *        blocking calls (fSim800_Call, fSim800_CheckCredit) return at once
+ *        with SIM800_RES_ENGINE_BUSY.
+ * 
+ */
+typedef void(*pfSim800CommandEvent)(sSim800RecievedMassgeDone *pArgs, void *pCtx);
+
+/**
+ * @brief One handler of a command type. The per-type register functions keep
+ *        their one-argument handler in pfPlain.
+ * 
+ */
+typedef struct {
+
+  pfSim800CommandEvent pfHandler;
+
+  void(*pfPlain)(sSim800RecievedMassgeDone *pArgs);
+
+  void *pCtx;
+
+}sSim800Subscriber;
+
 /**
  * @brief sim800 configuration structure
  * 
@@ -141,39 +769,65 @@ typedef struct {
 
     bool IsSending;
 
+    bool Running;                               /* fSim800_Run is on the stack */
+
     sSmsMessage SmsQueue[SIM800_SMS_QUEUE_SIZE];
+
+    sSmsJobQueue SmsJobs[eSMS_PRIORITY_COUNT];  /* waiting sends, one line per priority class */
+
+    uint8_t SmsFree[SIM800_SMS_QUEUE_SIZE];     /* stack of unused slot indexes */
+
+    uint8_t FreeCount;
   
-    uint16_t QueueHead;
-  
-    uint16_t QueueTail;
-  
-    uint16_t QueueCount;
+    uint16_t QueueCount;                        /* all classes */
   
     uint8_t CommandSendRetries;
 
-    JsonDocument SavedPhoneNumbers;
+    sSim800Phonebook Phonebook;
+
+    sSim800Wal PhonebookLog;
 
     bool EnableDeliveryReport;
 
+    bool UsePduMode;                            /* every message as PDU, longer than one text mode SMS always is */
+
+    bool PersistQueue;                          /* keep queued messages in a flash log across resets */
+
+    sSim800Wal QueueLog;
+
     Stream* ComPort;
 
-    void(*_pfCommandEvent)(sSim800RecievedMassgeDone *e);
+    sSim800RxFramer Rx;
 
-    sSim800RecievedMassgeDone _args;
+    sSim800CmdEngine CmdEngine;
+
+    sSim800Urc Urc[SIM800_URC_TABLE_SIZE];
+
+    sSim800ModemCfg Config;
+
+    sSim800SmsTx SmsTx;
+
+    sSim800Credit Credit;
 
-    // void(*_pfLampEvent)(sSim800RecievedMassgeDone *e);
+    sSmsInFlight InFlight[SIM800_SMS_INFLIGHT_SIZE];
 
-    // void(*_pfIpEvent)(sSim800RecievedMassgeDone *e);
+    pfSim800UrcHandler pfUrcBody;               /* takes the line after a two-line URC */
 
-    // void(*_pfAlarmEvent)(sSim800RecievedMassgeDone *e);
+    sSmsTicket Tickets[SIM800_SMS_TICKET_TABLE_SIZE];
 
-    // void(*_pfMonixideEvent)(sSim800RecievedMassgeDone *e);
+    sSmsTicketHook TicketHooks[SIM800_SMS_QUEUE_SIZE];   /* by payload slot */
 
-    // void(*_pfFireEvent)(sSim800RecievedMassgeDone *e);
+    uint16_t NextTicket;
 
-    // void(*_pfHumidityEvent)(sSim800RecievedMassgeDone *e);
+    sSim800Inbox Inbox;
 
-    // void(*_pfTempEvent)(sSim800RecievedMassgeDone *e);
+    sSim800Subscriber Subscribers[eCOMMAND_COUNT][SIM800_EVENT_SUBSCRIBERS];   /* [eNO_COMMAND] gets every command */
+
+    bool DeferEvents;                           /* handlers run from fSim800_DispatchEvents in another task */
+
+    sSim800RecievedMassgeDone EventPool[SIM800_EVENT_QUEUE_LEN];
+
+    sSim800RecievedMassgeDone _args;
 
 }sSim800;
 
@@ -186,20 +840,36 @@ sim800_res_t fSim800_AddPhoneNumber(String PhoneNumber, bool IsAdmin);
 sim800_res_t fSim800_RemovePhoneNumber(String PhoneNumber);
 sim800_res_t fSim800_RemoveAllPhoneNumbers(void);
 sim800_res_t fSim800_SMSSend(String phoneNumber, String message);
+sim800_res_t fSim800_SMSSendEx(String phoneNumber, String message, eSim800SmsPriority Priority, uint16_t *pTicket);
 sim800_res_t fSim800_SMSSendToAll(String message);
+sim800_res_t fSim800_SMSSendToAllEx(String message, eSim800SmsPriority Priority, uint16_t *pTicket);
+eSim800SmsStatus fSim800_SMSStatus(uint16_t Ticket, bool *pDone);
+sim800_res_t fSim800_SMSOnDone(uint16_t Ticket, pfSim800SmsDone pfDone, void *pCtx);
 sim800_res_t fSim800_Call(String PhoneNumber);
 sim800_res_t fSim800_GetSimcardBalance(uint16_t *pBalance);
 uint32_t fSim800_CheckCredit(void);
+sim800_res_t fSim800_CheckCreditAsync(pfSim800CreditDone pfDone, void *pCtx);
 sim800_res_t fSim800_GetPhoneNumbers(JsonDocument *pDoc);
-
+sim800_res_t fSim800_ImportPhoneNumbers(JsonDocument *pDoc, uint16_t *pImported);
+sim800_res_t fSim800_RegisterUrcHandler(const char *pPrefix, pfSim800UrcHandler pfHandler, void *pCtx);
+sim800_res_t fSim800_SubmitCommand(const char *pCommand, const char *pExpected, uint32_t TimeoutMs,
+                                   pfSim800CmdDone pfDone, void *pCtx);
+
+/* The handler table is not locked, change it from the task that runs the handlers or before fSim800_Run */
+sim800_res_t fSim800_Subscribe(eCommandType Type, pfSim800CommandEvent pfHandler, void *pCtx);
+sim800_res_t fSim800_Unsubscribe(eCommandType Type, pfSim800CommandEvent pfHandler, void *pCtx);
+bool fSim800_DispatchEvents(uint32_t WaitMs);
+
+/* One plain handler per type: registering again replaces it, as the single callback pointer did.
+   The same task rule as fSim800_Subscribe applies */
 sim800_res_t fSim800_RegisterCommandEvent(void(*fpFunc)(sSim800RecievedMassgeDone *pArgs));
-// sim800_res_t fSim800_RegisterLampEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
-// sim800_res_t fSim800_RegisterIpEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
-// sim800_res_t fSim800_RegisterAlarmEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
-// sim800_res_t fSim800_RegisterMonixideEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
-// sim800_res_t fSim800_RegisterFireEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
-// sim800_res_t fSim800_RegisterHumidityEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
-// sim800_res_t fSim800_RegisterTempEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
+sim800_res_t fSim800_RegisterLampEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
+sim800_res_t fSim800_RegisterIpEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
+sim800_res_t fSim800_RegisterAlarmEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
+sim800_res_t fSim800_RegisterMonixideEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
+sim800_res_t fSim800_RegisterFireEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
+sim800_res_t fSim800_RegisterHumidityEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
+sim800_res_t fSim800_RegisterTempEvent(void(*fpFunc)(sSim800RecievedMassgeDone *e));
 
 
 /* Exported variables --------------------------------------------------------*/
@@ -0,0 +1,942 @@
+/**
+ ******************************************************************************
+ * @file           : sim800_codec.c
+ * @brief          : SMS text encodings and SUBMIT PDU builder
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ *
+ ******************************************************************************
+ * @verbatim
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+
+#include "Sim800_codec.h"
+
+/* Private define ------------------------------------------------------------*/
+#define PDU_FO_SMS_SUBMIT                       0x01
+#define PDU_FO_VPF_RELATIVE                     0x10
+#define PDU_FO_SRR                              0x20
+#define PDU_FO_UDHI                             0x40
+#define PDU_FO_MTI_MASK                         0x03
+#define PDU_FO_SMS_STATUS_REPORT                0x02
+#define PDU_TIMESTAMP_LEN                       7
+#define PDU_IEI_CONCAT_8BIT                     0x00
+#define PDU_TOA_INTERNATIONAL                   0x91
+#define PDU_PID_DEFAULT                         0x00
+#define PDU_VP_24_HOURS                         0xA7  /* same validity as AT+CSMP=49,167 */
+#define PDU_NUMBER_MAX_DIGITS                   20
+#define GSM7_EXT_FLAG                           0x80
+#define GSM7_NO_CHAR                            0xFF
+
+/* Private variables ---------------------------------------------------------*/
+/**
+ * @brief GSM 03.38 default alphabet, septet to Unicode (0x1B is the escape to the extension table)
+ *
+ */
+static const uint16_t Gsm7Basic[128] = {
+  0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+  0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+  0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+  0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+  0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+  0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+  0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+  0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+  0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+  0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+  0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+  0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+  0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+  0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+  0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+  0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0,
+};
+
+/**
+ * @brief ASCII to septet, GSM7_EXT_FLAG marks a character of the extension table
+ *        (written as escape + code), GSM7_NO_CHAR one GSM-7 cannot carry
+ *
+ */
+static const uint8_t AsciiToGsm7[128] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0A, 0xFF, 0xFF, 0x0D, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0x20, 0x21, 0x22, 0x23, 0x02, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+  0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+  0x00, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+  0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0xBC, 0xAF, 0xBE, 0x94, 0x11,
+  0xFF, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+  0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0xA8, 0xC0, 0xA9, 0xBD, 0xFF,
+};
+
+/**
+ * @brief Nibble to upper-case hex digit
+ *
+ */
+static const char HexDigits[16] = {
+  '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t fCodec_Utf16Units(uint32_t Codepoint, uint16_t *pUnits);
+static uint8_t fCodec_HexNibble(char c);
+static bool fCodec_HexUnit(const char *pHex, uint8_t Digits, uint16_t *pValue);
+static uint8_t fCodec_PutUtf8(uint32_t Codepoint, char *pOut, uint16_t Room);
+static uint32_t fCodec_Gsm7Codepoint(uint8_t Code, bool Escaped);
+static uint16_t fPdu_PutNumber(const char *pNumber, uint8_t *pOut, uint16_t Size);
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                          ##### Exported Functions #####                         ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+/**
+ * @brief Decodes one UTF-8 sequence and advances *ppText past it.
+ *        A malformed sequence gives U+FFFD and skips one byte.
+ *
+ * @param ppText
+ * @param pEnd
+ * @return uint32_t the code point
+ */
+uint32_t fCodec_NextCodepoint(const char **ppText, const char *pEnd) {
+
+  const uint8_t *p = (const uint8_t *)*ppText;
+  uint8_t c = p[0];
+  uint32_t codepoint;
+  uint8_t len;
+
+  if(c < 0x80) {
+    *ppText += 1;
+    return c;
+  } else if((c & 0xE0) == 0xC0) {
+    codepoint = c & 0x1F;
+    len = 2;
+  } else if((c & 0xF0) == 0xE0) {
+    codepoint = c & 0x0F;
+    len = 3;
+  } else if((c & 0xF8) == 0xF0) {
+    codepoint = c & 0x07;
+    len = 4;
+  } else {
+    *ppText += 1;
+    return 0xFFFD;
+  }
+
+  if((const char *)p + len > pEnd) {
+    *ppText += 1;
+    return 0xFFFD;
+  }
+
+  for(uint8_t i = 1; i < len; i++) {
+
+    if((p[i] & 0xC0) != 0x80) {
+      *ppText += 1;
+      return 0xFFFD;
+    }
+    codepoint = (codepoint << 6) | (p[i] & 0x3F);
+  }
+
+  *ppText += len;
+  return (codepoint > 0x10FFFF) ? 0xFFFD : codepoint;
+}
+
+/**
+ * @brief GSM-7 code of a character
+ *
+ * @param Codepoint
+ * @return uint16_t the septet, escape << 8 | code for the extension table,
+ *                  SIM800_GSM7_NONE when GSM-7 cannot carry it
+ */
+uint16_t fCodec_Gsm7Lookup(uint32_t Codepoint) {
+
+  if(Codepoint < 0x80) {
+
+    uint8_t septet = AsciiToGsm7[Codepoint];
+    if(septet == GSM7_NO_CHAR) return SIM800_GSM7_NONE;
+    if(septet & GSM7_EXT_FLAG) return (SIM800_GSM7_ESCAPE << 8) | (septet & ~GSM7_EXT_FLAG);
+    return septet;
+  }
+
+  if(Codepoint == 0x20AC) return (SIM800_GSM7_ESCAPE << 8) | 0x65; // euro sign
+
+  for(uint8_t i = 0; i < 128; i++) {
+    if(Gsm7Basic[i] == Codepoint && i != SIM800_GSM7_ESCAPE) return i;
+  }
+
+  return SIM800_GSM7_NONE;
+}
+
+/**
+ * @brief Septets the text takes in GSM-7, extension characters count twice
+ *
+ * @param pText
+ * @param Len
+ * @return uint16_t SIM800_GSM7_NONE when some character needs UCS2
+ */
+uint16_t fCodec_Gsm7Length(const char *pText, uint16_t Len) {
+
+  const char *pEnd = pText + Len;
+  uint16_t septets = 0;
+
+  while(pText < pEnd) {
+
+    uint16_t code = fCodec_Gsm7Lookup(fCodec_NextCodepoint(&pText, pEnd));
+    if(code == SIM800_GSM7_NONE) return SIM800_GSM7_NONE;
+    septets += (code > 0x7F) ? 2 : 1;
+  }
+
+  return septets;
+}
+
+/**
+ * @brief Packs the text as GSM-7 septets, eight characters in seven octets
+ *
+ * @param pText
+ * @param Len
+ * @param pOut
+ * @param Size
+ * @param FillBits zero bits before the first septet, so it starts on a septet
+ *                 boundary after a user data header
+ * @return uint16_t octets written, 0 when the text is not GSM-7 or does not fit
+ */
+uint16_t fCodec_Gsm7Pack(const char *pText, uint16_t Len, uint8_t *pOut, uint16_t Size, uint8_t FillBits) {
+
+  const char *pEnd = pText + Len;
+  uint16_t octets = 0;
+  uint16_t bits = 0;
+  uint8_t count = FillBits;
+
+  while(pText < pEnd) {
+
+    uint16_t code = fCodec_Gsm7Lookup(fCodec_NextCodepoint(&pText, pEnd));
+    if(code == SIM800_GSM7_NONE) return 0;
+
+    uint8_t septets[2] = { (uint8_t)(code >> 8), (uint8_t)(code & 0x7F) };
+    for(uint8_t i = (code > 0x7F) ? 0 : 1; i < 2; i++) {
+
+      bits |= (uint16_t)septets[i] << count;
+      count += 7;
+      while(count >= 8) {
+        if(octets >= Size) return 0;
+        pOut[octets++] = (uint8_t)bits;
+        bits >>= 8;
+        count -= 8;
+      }
+    }
+  }
+
+  if(count > 0) {
+    if(octets >= Size) return 0;
+    pOut[octets++] = (uint8_t)bits;
+  }
+
+  return octets;
+}
+
+/**
+ * @brief UTF-16 code units the text takes, characters outside the BMP need two
+ *
+ * @param pText
+ * @param Len
+ * @return uint16_t
+ */
+uint16_t fCodec_Ucs2Length(const char *pText, uint16_t Len) {
+
+  const char *pEnd = pText + Len;
+  uint16_t units = 0;
+
+  while(pText < pEnd) {
+    units += (fCodec_NextCodepoint(&pText, pEnd) > 0xFFFF) ? 2 : 1;
+  }
+
+  return units;
+}
+
+/**
+ * @brief Writes the text as big-endian UTF-16 (what the network calls UCS2)
+ *
+ * @param pText
+ * @param Len
+ * @param pOut
+ * @param Size
+ * @return uint16_t octets written, 0 when it does not fit
+ */
+uint16_t fCodec_Ucs2Encode(const char *pText, uint16_t Len, uint8_t *pOut, uint16_t Size) {
+
+  const char *pEnd = pText + Len;
+  uint16_t octets = 0;
+
+  while(pText < pEnd) {
+
+    uint32_t codepoint = fCodec_NextCodepoint(&pText, pEnd);
+    uint16_t units[2];
+    uint8_t count = fCodec_Utf16Units(codepoint, units);
+
+    if(octets + count * 2 > Size) return 0;
+    for(uint8_t i = 0; i < count; i++) {
+      pOut[octets++] = (uint8_t)(units[i] >> 8);
+      pOut[octets++] = (uint8_t)units[i];
+    }
+  }
+
+  return octets;
+}
+
+/**
+ * @brief Longest prefix that fits MaxUnits, never splitting an escape sequence
+ *        or a surrogate pair
+ *
+ * @param pText
+ * @param Len
+ * @param Dcs
+ * @param MaxUnits septets for GSM-7, UTF-16 code units for UCS2
+ * @return uint16_t bytes of pText
+ */
+uint16_t fCodec_FitPrefix(const char *pText, uint16_t Len, eSim800SmsDcs Dcs, uint16_t MaxUnits) {
+
+  const char *pStart = pText;
+  const char *pEnd = pText + Len;
+  uint16_t units = 0;
+
+  while(pText < pEnd) {
+
+    const char *pNext = pText;
+    uint32_t codepoint = fCodec_NextCodepoint(&pNext, pEnd);
+    uint8_t cost;
+
+    if(Dcs == eSMS_DCS_GSM7) {
+      cost = (fCodec_Gsm7Lookup(codepoint) > 0x7F) ? 2 : 1;
+    } else {
+      cost = (codepoint > 0xFFFF) ? 2 : 1;
+    }
+
+    if(units + cost > MaxUnits) break;
+    units += cost;
+    pText = pNext;
+  }
+
+  return pText - pStart;
+}
+
+/**
+ * @brief Messages the text takes, one or the parts of a concatenated message
+ *
+ * @param pText
+ * @param Len
+ * @param Dcs
+ * @return uint8_t 0 when it would take more than 255 parts
+ */
+uint8_t fCodec_Segments(const char *pText, uint16_t Len, eSim800SmsDcs Dcs) {
+
+  uint16_t single = (Dcs == eSMS_DCS_GSM7) ? SIM800_GSM7_MAX_SEPTETS : SIM800_UCS2_MAX_CHARS;
+  uint16_t part = (Dcs == eSMS_DCS_GSM7) ? SIM800_GSM7_CONCAT_SEPTETS : SIM800_UCS2_CONCAT_CHARS;
+
+  if(fCodec_FitPrefix(pText, Len, Dcs, single) == Len) return 1;
+
+  uint16_t count = 0;
+  while(Len > 0) {
+
+    uint16_t taken = fCodec_FitPrefix(pText, Len, Dcs, part);
+    if(taken == 0 || ++count > 255) return 0;
+    pText += taken;
+    Len -= taken;
+  }
+
+  return (uint8_t)count;
+}
+
+/**
+ * @brief Picks the encoding of a text and counts what it takes, one pass over
+ *        the text unless it is long enough to need concatenation
+ *
+ * @param pText
+ * @param Len
+ * @param pInfo
+ */
+void fCodec_Analyze(const char *pText, uint16_t Len, sSim800TextInfo *pInfo) {
+
+  const char *p = pText;
+  const char *pEnd = pText + Len;
+  uint16_t septets = 0;
+  uint16_t units = 0;
+  bool gsm7 = true;
+
+  while(p < pEnd) {
+
+    uint32_t codepoint = fCodec_NextCodepoint(&p, pEnd);
+    units += (codepoint > 0xFFFF) ? 2 : 1;
+
+    if(gsm7) {
+      uint16_t code = fCodec_Gsm7Lookup(codepoint);
+      if(code == SIM800_GSM7_NONE) {
+        gsm7 = false;
+      } else {
+        septets += (code > 0x7F) ? 2 : 1;
+      }
+    }
+  }
+
+  pInfo->Dcs = gsm7 ? eSMS_DCS_GSM7 : eSMS_DCS_UCS2;
+  pInfo->Units = gsm7 ? septets : units;
+
+  if(pInfo->Units <= (gsm7 ? SIM800_GSM7_MAX_SEPTETS : SIM800_UCS2_MAX_CHARS)) {
+    pInfo->Segments = 1;
+  } else {
+    pInfo->Segments = fCodec_Segments(pText, Len, pInfo->Dcs);
+  }
+}
+
+/**
+ * @brief Writes Len bytes as upper-case hex, two characters per byte, no terminator
+ *
+ * @param pData
+ * @param Len
+ * @param pOut room for 2 * Len characters
+ * @return uint16_t characters written
+ */
+uint16_t fCodec_HexEncode(const uint8_t *pData, uint16_t Len, char *pOut) {
+
+  for(uint16_t i = 0; i < Len; i++) {
+    pOut[2 * i] = HexDigits[pData[i] >> 4];
+    pOut[2 * i + 1] = HexDigits[pData[i] & 0x0F];
+  }
+
+  return 2 * Len;
+}
+
+/**
+ * @brief Hex digits, either case, back to bytes
+ *
+ * @param pHex
+ * @param Len characters
+ * @param pOut
+ * @param Size
+ * @return uint16_t bytes written, 0 on an odd length, a non-hex character or too little room
+ */
+uint16_t fCodec_HexDecode(const char *pHex, uint16_t Len, uint8_t *pOut, uint16_t Size) {
+
+  if((Len & 1) || Len / 2 > Size) return 0;
+
+  for(uint16_t i = 0; i < Len; i += 2) {
+
+    uint8_t high = fCodec_HexNibble(pHex[i]);
+    uint8_t low = fCodec_HexNibble(pHex[i + 1]);
+    if(high > 0x0F || low > 0x0F) return 0;
+    pOut[i / 2] = (high << 4) | low;
+  }
+
+  return Len / 2;
+}
+
+/**
+ * @brief UTF-8 to UCS2 hex as AT+CSCS="HEX" with AT+CSMP=...,8 wants it, four
+ *        characters per UTF-16 code unit. Stops before the first character that
+ *        does not fit and leaves *ppText there, so a long text can be written
+ *        out in chunks. The output is always terminated.
+ *
+ * @param ppText
+ * @param pEnd
+ * @param pOut
+ * @param Size
+ * @return uint16_t characters written, without the terminator
+ */
+uint16_t fCodec_Ucs2Hex(const char **ppText, const char *pEnd, char *pOut, uint16_t Size) {
+
+  uint16_t len = 0;
+
+  if(Size == 0) return 0;
+
+  while(*ppText < pEnd) {
+
+    const char *pNext = *ppText;
+    uint32_t codepoint = fCodec_NextCodepoint(&pNext, pEnd);
+    uint16_t units[2];
+    uint8_t count = fCodec_Utf16Units(codepoint, units);
+
+    if(len + count * 4 + 1 > Size) break;
+
+    for(uint8_t i = 0; i < count; i++) {
+      pOut[len++] = HexDigits[units[i] >> 12];
+      pOut[len++] = HexDigits[(units[i] >> 8) & 0x0F];
+      pOut[len++] = HexDigits[(units[i] >> 4) & 0x0F];
+      pOut[len++] = HexDigits[units[i] & 0x0F];
+    }
+    *ppText = pNext;
+  }
+
+  pOut[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief UCS2 hex, as AT+CSCS="HEX" shows a UCS2 message, to UTF-8. Reads one
+ *        code unit at a time and never writes ahead of what it read, so pOut may
+ *        be pHex to decode in place. An unpaired surrogate gives U+FFFD.
+ *
+ * @param pHex
+ * @param Len characters
+ * @param pOut
+ * @param Size
+ * @return uint16_t bytes written, without the terminator. Stops at a non-hex
+ *         digit or a character that does not fit, the output is always terminated.
+ */
+uint16_t fCodec_Ucs2HexToUtf8(const char *pHex, uint16_t Len, char *pOut, uint16_t Size) {
+
+  uint16_t len = 0;
+  uint16_t i = 0;
+
+  if(Size == 0) return 0;
+
+  while(i + 4 <= Len) {
+
+    uint16_t unit;
+    uint32_t codepoint;
+
+    if(!fCodec_HexUnit(&pHex[i], 4, &unit)) break;
+    i += 4;
+    codepoint = unit;
+
+    if(unit >= 0xD800 && unit <= 0xDBFF) {
+
+      uint16_t low;
+      if(i + 4 <= Len && fCodec_HexUnit(&pHex[i], 4, &low) && low >= 0xDC00 && low <= 0xDFFF) {
+        codepoint = 0x10000 + (((uint32_t)(unit - 0xD800) << 10) | (low - 0xDC00));
+        i += 4;
+      } else {
+        codepoint = 0xFFFD;
+      }
+    } else if(unit >= 0xDC00 && unit <= 0xDFFF) {
+      codepoint = 0xFFFD;
+    }
+
+    uint8_t written = fCodec_PutUtf8(codepoint, &pOut[len], Size - len - 1);
+    if(written == 0) break;
+    len += written;
+  }
+
+  pOut[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief GSM-7 hex, one unpacked septet per two digits as AT+CSCS="HEX" shows a
+ *        GSM-7 message, to UTF-8. Like fCodec_Ucs2HexToUtf8 it may decode in place.
+ *
+ * @param pHex
+ * @param Len characters
+ * @param pOut
+ * @param Size
+ * @return uint16_t bytes written, without the terminator
+ */
+uint16_t fCodec_Gsm7HexToUtf8(const char *pHex, uint16_t Len, char *pOut, uint16_t Size) {
+
+  uint16_t len = 0;
+  uint16_t i = 0;
+
+  if(Size == 0) return 0;
+
+  while(i + 2 <= Len) {
+
+    uint16_t septet;
+    uint32_t codepoint;
+
+    if(!fCodec_HexUnit(&pHex[i], 2, &septet) || septet > 0x7F) break;
+    i += 2;
+    codepoint = fCodec_Gsm7Codepoint((uint8_t)septet, false);
+
+    if(septet == SIM800_GSM7_ESCAPE) {
+
+      uint16_t code;
+      if(i + 2 > Len || !fCodec_HexUnit(&pHex[i], 2, &code) || code > 0x7F) break;
+      i += 2;
+      codepoint = fCodec_Gsm7Codepoint((uint8_t)code, true);
+    }
+
+    uint8_t written = fCodec_PutUtf8(codepoint, &pOut[len], Size - len - 1);
+    if(written == 0) break;
+    len += written;
+  }
+
+  pOut[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief GSM-7 user data as octets in hex, as AT+CSCS="HEX" shows a GSM-7 message
+ *        that carries a user data header, to UTF-8. pOut must not overlap pHex,
+ *        the text can take more bytes than its hex.
+ *
+ * @param pHex the octets after the header
+ * @param Len characters
+ * @param FillBits bits that align the first septet after the header, 0-6
+ * @param pOut
+ * @param Size
+ * @return uint16_t bytes written, without the terminator
+ */
+uint16_t fCodec_Gsm7PackedHexToUtf8(const char *pHex, uint16_t Len, uint8_t FillBits, char *pOut, uint16_t Size) {
+
+  uint16_t len = 0;
+  uint16_t bits = 0;
+  uint8_t count = 0;
+  bool escaped = false;
+
+  if(Size == 0) return 0;
+
+  for(uint16_t i = 0; i + 2 <= Len; i += 2) {
+
+    uint16_t octet;
+    if(!fCodec_HexUnit(&pHex[i], 2, &octet)) break;
+
+    bits |= octet << count;
+    count += 8;
+    if(i == 0) {
+      bits >>= FillBits;
+      count -= FillBits;
+    }
+
+    while(count >= 7) {
+
+      uint8_t septet = bits & 0x7F;
+      bits >>= 7;
+      count -= 7;
+
+      // Seven zero bits left in the last octet are padding, not an '@'
+      if(count == 0 && septet == 0 && i + 4 > Len) break;
+
+      if(septet == SIM800_GSM7_ESCAPE && !escaped) {
+        escaped = true;
+        continue;
+      }
+
+      uint8_t written = fCodec_PutUtf8(fCodec_Gsm7Codepoint(septet, escaped), &pOut[len], Size - len - 1);
+      if(written == 0) {
+        pOut[len] = '\0';
+        return len;
+      }
+      len += written;
+      escaped = false;
+    }
+  }
+
+  pOut[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief Packs a digit string two digits per byte, first digit in the high nibble,
+ *        unused nibbles 0xF
+ *
+ * @param pDigits
+ * @param pOut
+ * @param Size
+ * @return uint8_t digits packed, 0 when not all digits or longer than 2 * Size
+ */
+uint8_t fCodec_BcdPack(const char *pDigits, uint8_t *pOut, uint8_t Size) {
+
+  size_t digits = strlen(pDigits);
+
+  if(digits == 0 || digits > 2u * Size) return 0;
+
+  memset(pOut, 0xFF, Size);
+  for(size_t i = 0; i < digits; i++) {
+
+    if(pDigits[i] < '0' || pDigits[i] > '9') return 0;
+
+    uint8_t nibble = pDigits[i] - '0';
+    if(i & 1) {
+      pOut[i / 2] = (pOut[i / 2] & 0xF0) | nibble;
+    } else {
+      pOut[i / 2] = (pOut[i / 2] & 0x0F) | (nibble << 4);
+    }
+  }
+
+  return (uint8_t)digits;
+}
+
+/**
+ * @brief Digits of a fCodec_BcdPack number, stops at the first 0xF nibble
+ *
+ * @param pBcd
+ * @param Size
+ * @param pOut
+ * @param OutSize
+ * @return uint8_t digits written, the output is always terminated
+ */
+uint8_t fCodec_BcdUnpack(const uint8_t *pBcd, uint8_t Size, char *pOut, uint8_t OutSize) {
+
+  uint8_t len = 0;
+
+  if(OutSize == 0) return 0;
+
+  for(uint8_t i = 0; i < 2 * Size && len + 1 < OutSize; i++) {
+
+    uint8_t nibble = (i & 1) ? (pBcd[i / 2] & 0x0F) : (pBcd[i / 2] >> 4);
+    if(nibble > 9) break;
+    pOut[len++] = '0' + nibble;
+  }
+
+  pOut[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief Builds an SMS-SUBMIT PDU as AT+CMGS expects it in PDU mode. The SMSC
+ *        address is left empty so the one stored on the SIM is used.
+ *
+ * @param pSubmit
+ * @param pPdu
+ * @param Size
+ * @return uint16_t octets written including the SMSC octet (AT+CMGS takes one less),
+ *                  0 when the number is invalid or the text does not fit one message.
+ *                  A part of a concatenated message carries the 8-bit reference UDH.
+ */
+uint16_t fPdu_BuildSubmit(const sSim800PduSubmit *pSubmit, uint8_t *pPdu, uint16_t Size) {
+
+  uint16_t pos = 0;
+  bool concat = pSubmit->PartCount > 1;
+
+  if(Size < 4) return 0;
+
+  pPdu[pos++] = 0x00; // SMSC from the SIM
+  pPdu[pos++] = PDU_FO_SMS_SUBMIT | PDU_FO_VPF_RELATIVE | (pSubmit->StatusReport ? PDU_FO_SRR : 0) |
+                (concat ? PDU_FO_UDHI : 0);
+  pPdu[pos++] = pSubmit->MessageRef;
+
+  uint16_t written = fPdu_PutNumber(pSubmit->pNumber, &pPdu[pos], Size - pos);
+  if(written == 0) return 0;
+  pos += written;
+
+  if(pos + 4 > Size) return 0;
+  pPdu[pos++] = PDU_PID_DEFAULT;
+  pPdu[pos++] = (uint8_t)pSubmit->Dcs;
+  pPdu[pos++] = PDU_VP_24_HOURS;
+
+  uint16_t udlPos = pos++;
+  uint16_t room = Size - pos;
+  if(room > SIM800_PDU_USER_DATA_MAX_LEN) room = SIM800_PDU_USER_DATA_MAX_LEN;
+
+  uint8_t udhLen = 0;
+  if(concat) {
+
+    if(room < SIM800_CONCAT_UDH_LEN || pSubmit->PartNumber == 0 || pSubmit->PartNumber > pSubmit->PartCount) return 0;
+    pPdu[pos++] = SIM800_CONCAT_UDH_LEN - 1;
+    pPdu[pos++] = PDU_IEI_CONCAT_8BIT;
+    pPdu[pos++] = 3;
+    pPdu[pos++] = pSubmit->ConcatRef;
+    pPdu[pos++] = pSubmit->PartCount;
+    pPdu[pos++] = pSubmit->PartNumber;
+    udhLen = SIM800_CONCAT_UDH_LEN;
+    room -= udhLen;
+  }
+
+  if(pSubmit->Dcs == eSMS_DCS_GSM7) {
+
+    // The header is counted in whole septets, the text starts on the next septet boundary
+    uint8_t udhSeptets = (udhLen * 8 + 6) / 7;
+    uint8_t fillBits = udhSeptets * 7 - udhLen * 8;
+
+    uint16_t septets = fCodec_Gsm7Length(pSubmit->pText, pSubmit->TextLen);
+    if(septets == SIM800_GSM7_NONE || septets + udhSeptets > SIM800_GSM7_MAX_SEPTETS) return 0;
+
+    written = fCodec_Gsm7Pack(pSubmit->pText, pSubmit->TextLen, &pPdu[pos], room, fillBits);
+    if(written == 0 && septets > 0) return 0;
+    pPdu[udlPos] = (uint8_t)(udhSeptets + septets);
+
+  } else {
+
+    written = fCodec_Ucs2Encode(pSubmit->pText, pSubmit->TextLen, &pPdu[pos], room);
+    if(written == 0 && pSubmit->TextLen > 0) return 0;
+    pPdu[udlPos] = (uint8_t)(udhLen + written);
+  }
+
+  return pos + written;
+}
+
+/**
+ * @brief Reads TP-MR and TP-ST of an SMS-STATUS-REPORT, the hex line that follows
+ *        +CDS: <length> in PDU mode
+ *
+ * @param pHex
+ * @param Len characters
+ * @param pMessageRef
+ * @param pStatus TP-ST: below 0x20 delivered, 0x20-0x3F still trying, above failed
+ * @return true when it is a complete status report
+ */
+bool fPdu_ParseStatusReport(const char *pHex, uint16_t Len, uint8_t *pMessageRef, uint8_t *pStatus) {
+
+  uint8_t pdu[SIM800_PDU_MAX_LEN];
+  uint16_t size = fCodec_HexDecode(pHex, Len, pdu, sizeof(pdu));
+  uint16_t pos = 0;
+
+  if(size == 0) return false;
+  pos += 1 + pdu[0]; // SMSC address
+
+  if(pos + 3 > size || (pdu[pos] & PDU_FO_MTI_MASK) != PDU_FO_SMS_STATUS_REPORT) return false;
+  *pMessageRef = pdu[pos + 1];
+  pos += 2 + 2 + (pdu[pos + 2] + 1) / 2; // first octet, TP-MR, TP-RA: digit count, type, digits
+
+  pos += 2 * PDU_TIMESTAMP_LEN; // TP-SCTS, TP-DT
+  if(pos >= size) return false;
+  *pStatus = pdu[pos];
+
+  return true;
+}
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                            ##### Private Functions #####                        ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+/**
+ * @brief UTF-16 code units of a code point, a surrogate pair outside the BMP
+ *
+ * @param Codepoint
+ * @param pUnits room for two units
+ * @return uint8_t units written
+ */
+static uint8_t fCodec_Utf16Units(uint32_t Codepoint, uint16_t *pUnits) {
+
+  if(Codepoint > 0xFFFF) {
+    Codepoint -= 0x10000;
+    pUnits[0] = 0xD800 | (uint16_t)(Codepoint >> 10);
+    pUnits[1] = 0xDC00 | (uint16_t)(Codepoint & 0x3FF);
+    return 2;
+  }
+
+  pUnits[0] = (uint16_t)Codepoint;
+  return 1;
+}
+
+/**
+ * @brief Value of a hex digit
+ *
+ * @param c
+ * @return uint8_t 0-15, 0xFF when c is not a hex digit
+ */
+static uint8_t fCodec_HexNibble(char c) {
+
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return 0xFF;
+}
+
+static bool fCodec_HexUnit(const char *pHex, uint8_t Digits, uint16_t *pValue) {
+
+  uint16_t value = 0;
+
+  for(uint8_t i = 0; i < Digits; i++) {
+
+    uint8_t nibble = fCodec_HexNibble(pHex[i]);
+    if(nibble > 0x0F) return false;
+    value = (value << 4) | nibble;
+  }
+
+  *pValue = value;
+  return true;
+}
+
+/**
+ * @brief Character of a septet, Escaped for the one after 0x1B. The extension
+ *        table is the one fCodec_Gsm7Lookup writes, unknown codes read as a space.
+ *
+ * @param Code
+ * @param Escaped
+ * @return uint32_t
+ */
+static uint32_t fCodec_Gsm7Codepoint(uint8_t Code, bool Escaped) {
+
+  if(!Escaped) return Gsm7Basic[Code & 0x7F];
+
+  if(Code == 0x65) return 0x20AC;
+  if(Code >= 0x7F) return 0x0020;   // 0xFF marks the ASCII characters GSM-7 lacks
+
+  for(uint8_t c = 0; c < 128; c++) {
+    if(AsciiToGsm7[c] == (GSM7_EXT_FLAG | Code)) return c;
+  }
+
+  return 0x0020;
+}
+
+/**
+ * @brief UTF-8 of a code point
+ *
+ * @param Codepoint
+ * @param pOut
+ * @param Room
+ * @return uint8_t bytes written, 0 when they do not fit
+ */
+static uint8_t fCodec_PutUtf8(uint32_t Codepoint, char *pOut, uint16_t Room) {
+
+  uint8_t len = (Codepoint < 0x80) ? 1 : (Codepoint < 0x800) ? 2 : (Codepoint < 0x10000) ? 3 : 4;
+
+  if(len > Room) return 0;
+
+  switch(len) {
+    case 1:
+      pOut[0] = (char)Codepoint;
+      break;
+    case 2:
+      pOut[0] = (char)(0xC0 | (Codepoint >> 6));
+      pOut[1] = (char)(0x80 | (Codepoint & 0x3F));
+      break;
+    case 3:
+      pOut[0] = (char)(0xE0 | (Codepoint >> 12));
+      pOut[1] = (char)(0x80 | ((Codepoint >> 6) & 0x3F));
+      pOut[2] = (char)(0x80 | (Codepoint & 0x3F));
+      break;
+    default:
+      pOut[0] = (char)(0xF0 | (Codepoint >> 18));
+      pOut[1] = (char)(0x80 | ((Codepoint >> 12) & 0x3F));
+      pOut[2] = (char)(0x80 | ((Codepoint >> 6) & 0x3F));
+      pOut[3] = (char)(0x80 | (Codepoint & 0x3F));
+      break;
+  }
+
+  return len;
+}
+
+/**
+ * @brief Destination address: digit count, type, then the digits as swapped semi-octets
+ *
+ * @param pNumber
+ * @param pOut
+ * @param Size
+ * @return uint16_t octets written, 0 when the number is empty, too long or not all digits
+ */
+static uint16_t fPdu_PutNumber(const char *pNumber, uint8_t *pOut, uint16_t Size) {
+
+  size_t digits = strlen(pNumber);
+
+  if(digits == 0 || digits > PDU_NUMBER_MAX_DIGITS) return 0;
+  if(Size < 2 + (digits + 1) / 2) return 0;
+
+  pOut[0] = (uint8_t)digits;
+  pOut[1] = PDU_TOA_INTERNATIONAL;
+
+  for(size_t i = 0; i < digits; i++) {
+
+    if(pNumber[i] < '0' || pNumber[i] > '9') return 0;
+
+    uint8_t nibble = pNumber[i] - '0';
+    if(i & 1) {
+      pOut[2 + i / 2] = (pOut[2 + i / 2] & 0x0F) | (nibble << 4);
+    } else {
+      pOut[2 + i / 2] = 0xF0 | nibble;
+    }
+  }
+
+  return 2 + (digits + 1) / 2;
+}
+
+/**End of Group_Name
+  * @}
+  */
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,127 @@
+/**
+******************************************************************************
+* @file           : sim800_codec.h
+* @brief          : SMS text encodings, SUBMIT PDU builder and STATUS-REPORT reader for the sim800 driver
+* @note           : Text comes in as UTF-8 and is written either as GSM 03.38
+*                   septets (160 characters per PDU) or as UCS2 (70 characters).
+* @copyright      : COPYRIGHT© 2025 DiodeGroup
+******************************************************************************
+* @attention
+*
+* <h2><center>&copy; Copyright© 2025 DiodeGroup.
+* All rights reserved.</center></h2>
+*
+* This software is licensed under terms that can be found in the LICENSE file
+* in the root directory of this software component.
+* If no LICENSE file comes with this software, it is provided AS-IS.
+*
+******************************************************************************
+* @verbatim
+* @endverbatim
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef CDRV_SIM800_CODEC_H
+#define CDRV_SIM800_CODEC_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exported defines ----------------------------------------------------------*/
+#define SIM800_PDU_MAX_LEN                      176
+#define SIM800_PDU_USER_DATA_MAX_LEN            140
+#define SIM800_PDU_MR_OFFSET                    2     /* TP-MR, after the SMSC and first octets */
+#define SIM800_GSM7_MAX_SEPTETS                 160
+#define SIM800_UCS2_MAX_CHARS                   70
+#define SIM800_CONCAT_UDH_LEN                   6     /* UDHL, IEI 00, IEDL, reference, parts, part */
+#define SIM800_GSM7_CONCAT_SEPTETS              153   /* 160 less the header and its fill bit */
+#define SIM800_UCS2_CONCAT_CHARS                67
+#define SIM800_GSM7_NONE                        0xFFFF
+#define SIM800_GSM7_ESCAPE                      0x1B
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief Data coding of the user data
+ *
+ */
+typedef enum {
+
+  eSMS_DCS_GSM7 = 0x00,
+  eSMS_DCS_UCS2 = 0x08
+
+}eSim800SmsDcs;
+
+/**
+ * @brief One SMS-SUBMIT, everything fPdu_BuildSubmit needs
+ *
+ */
+typedef struct {
+
+  const char *pNumber;      /* international number, digits only (989121234567) */
+
+  const char *pText;        /* UTF-8 */
+
+  uint16_t TextLen;
+
+  eSim800SmsDcs Dcs;
+
+  uint8_t MessageRef;       /* TP-MR */
+
+  bool StatusReport;        /* TP-SRR */
+
+  uint8_t ConcatRef;        /* same for every part of one message */
+
+  uint8_t PartCount;        /* 0 or 1 for a single message, no UDH */
+
+  uint8_t PartNumber;       /* 1 based */
+
+}sSim800PduSubmit;
+
+/**
+ * @brief What a text costs, from fCodec_Analyze
+ *
+ */
+typedef struct {
+
+  eSim800SmsDcs Dcs;        /* GSM-7 when every character has a GSM-7 code */
+
+  uint16_t Units;           /* septets for GSM-7, UTF-16 code units for UCS2 */
+
+  uint8_t Segments;         /* messages it takes, 0 when more than 255 */
+
+}sSim800TextInfo;
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint32_t fCodec_NextCodepoint(const char **ppText, const char *pEnd);
+uint16_t fCodec_Gsm7Lookup(uint32_t Codepoint);
+uint16_t fCodec_Gsm7Length(const char *pText, uint16_t Len);
+uint16_t fCodec_Gsm7Pack(const char *pText, uint16_t Len, uint8_t *pOut, uint16_t Size, uint8_t FillBits);
+uint16_t fCodec_Ucs2Length(const char *pText, uint16_t Len);
+uint16_t fCodec_Ucs2Encode(const char *pText, uint16_t Len, uint8_t *pOut, uint16_t Size);
+uint16_t fCodec_FitPrefix(const char *pText, uint16_t Len, eSim800SmsDcs Dcs, uint16_t MaxUnits);
+uint8_t fCodec_Segments(const char *pText, uint16_t Len, eSim800SmsDcs Dcs);
+void fCodec_Analyze(const char *pText, uint16_t Len, sSim800TextInfo *pInfo);
+uint16_t fCodec_HexEncode(const uint8_t *pData, uint16_t Len, char *pOut);
+uint16_t fCodec_HexDecode(const char *pHex, uint16_t Len, uint8_t *pOut, uint16_t Size);
+uint16_t fCodec_Ucs2Hex(const char **ppText, const char *pEnd, char *pOut, uint16_t Size);
+uint16_t fCodec_Ucs2HexToUtf8(const char *pHex, uint16_t Len, char *pOut, uint16_t Size);
+uint16_t fCodec_Gsm7HexToUtf8(const char *pHex, uint16_t Len, char *pOut, uint16_t Size);
+uint16_t fCodec_Gsm7PackedHexToUtf8(const char *pHex, uint16_t Len, uint8_t FillBits, char *pOut, uint16_t Size);
+uint8_t fCodec_BcdPack(const char *pDigits, uint8_t *pOut, uint8_t Size);
+uint8_t fCodec_BcdUnpack(const uint8_t *pBcd, uint8_t Size, char *pOut, uint8_t OutSize);
+uint16_t fPdu_BuildSubmit(const sSim800PduSubmit *pSubmit, uint8_t *pPdu, uint16_t Size);
+bool fPdu_ParseStatusReport(const char *pHex, uint16_t Len, uint8_t *pMessageRef, uint8_t *pStatus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CDRV_SIM800_CODEC_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -3,17 +3,23 @@
 #define AT                        "AT"
 #define ECHO_DIABLE               "ATE0"
 #define SET_TEXT_MODE             "AT+CMGF=1"
+#define SET_PDU_MODE              "AT+CMGF=0"
 #define SET_TEXT_HEX_MODE         "AT+CSCS=\"HEX\""
 #define SET_TEXT_MODE_CONFIG      "AT+CSMP=49,167,0,0"
 #define SET_TEXT_HEX_MODE_CONFIG  "AT+CSMP=49,167,0,8"
+#define SHOW_TEXT_HEADER          "AT+CSDH=1"
 #define CHECK_SIMCARD_INSERTED    "AT+CPIN?"
 #define SIMCARD_INSERTED          "+CPIN: READY"
 #define SET_PHONE_NUM             "AT+CMGS=\""
+#define SET_PDU_LENGTH            "AT+CMGS="
 #define SIGNAL_QUALITY            "AT+CSQ"
 #define DELIVERY_ENABLE           "AT+CNMI=2,1,0,1,0"
+#define NEW_MSG_INDICATION        "AT+CNMI=2,1,0,0,0"
 #define SEND_SMS_END              (char)26
 #define SEND_SMS_START            ">"
 #define CHECK_UNREAD_MSG          "AT+CMGL=\"REC UNREAD\""
+#define READ_MSG                  "AT+CMGR="
+#define DELETE_MSG                "AT+CMGD="
 #define DELETE_ALL_MSGS           "AT+CMGD=1,4"
 #define DELETE_ALL_READED_MSGS    "AT+CMGD=1,1"
 #define RESET_SIM800              "AT+CFUN=1,1"
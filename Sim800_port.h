@@ -0,0 +1,104 @@
+/**
+******************************************************************************
+* @file           : sim800_port.h
+* @brief          : Platform abstraction for the sim800 driver
+* @note           : Every ESP32/Arduino specific call the driver makes goes
+*                   through the macros below. A host build (simulator,
+*                   benchmarks) defines SIM800_PORT_HEADER to a header of its
+*                   own that provides the same macros plus Stream/String/
+*                   Serial shims, and points Sim800.ComPort at a simulated
+*                   modem.
+* @copyright      : COPYRIGHT© 2025 DiodeGroup
+******************************************************************************
+* @attention
+*
+* <h2><center>&copy; Copyright© 2025 DiodeGroup.
+* All rights reserved.</center></h2>
+*
+* This software is licensed under terms that can be found in the LICENSE file
+* in the root directory of this software component.
+* If no LICENSE file comes with this software, it is provided AS-IS.
+*
+******************************************************************************
+* @verbatim
+* @endverbatim
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef CDRV_SIM800_PORT_H
+#define CDRV_SIM800_PORT_H
+
+/* Includes ------------------------------------------------------------------*/
+#ifdef SIM800_PORT_HEADER
+
+#include SIM800_PORT_HEADER
+
+#else
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <esp_task_wdt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#endif /* SIM800_PORT_HEADER */
+
+/* Exported defines ----------------------------------------------------------*/
+/**
+ * @brief Monotonic millisecond clock
+ *
+ */
+#ifndef SIM800_MILLIS
+#define SIM800_MILLIS()                         millis()
+#endif
+
+/**
+ * @brief Blocking delay, only used on boot and in blocking wrappers
+ *
+ */
+#ifndef SIM800_DELAY_MS
+#define SIM800_DELAY_MS(ms)                     delay(ms)
+#endif
+
+/**
+ * @brief Give the CPU to other tasks for one scheduler tick
+ *
+ */
+#ifndef SIM800_YIELD
+#define SIM800_YIELD()                          vTaskDelay(1)
+#endif
+
+/**
+ * @brief Feed the task watchdog while waiting on the modem
+ *
+ */
+#ifndef SIM800_WDT_RESET
+#define SIM800_WDT_RESET()                      esp_task_wdt_reset()
+#endif
+
+/**
+ * @brief File system holding the phonebook
+ *
+ */
+#ifndef SIM800_FS
+#define SIM800_FS                               SPIFFS
+#endif
+
+/**
+ * @brief Queue of one-byte items between the driver task and the task that runs
+ *        deferred command events, created on memory the driver owns
+ *
+ */
+#ifndef SIM800_EVENT_QUEUE_T
+#define SIM800_EVENT_QUEUE_T                    QueueHandle_t
+#define SIM800_EVENT_QUEUE_STORAGE_T            StaticQueue_t
+#define SIM800_EVENT_QUEUE_CREATE(len, pBuffer, pStorage) \
+                                                xQueueCreateStatic(len, sizeof(uint8_t), pBuffer, pStorage)
+#define SIM800_EVENT_QUEUE_SEND(queue, pItem)   (xQueueSend(queue, pItem, 0) == pdTRUE)
+#define SIM800_EVENT_QUEUE_RECEIVE(queue, pItem, ms) \
+                                                (xQueueReceive(queue, pItem, pdMS_TO_TICKS(ms)) == pdTRUE)
+#endif
+
+#endif /* CDRV_SIM800_PORT_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
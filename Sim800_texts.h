@@ -8,6 +8,14 @@
 #define ALARM           "alarm"  
 #define ON              "on" 
 #define OFF             "off" 
+#define SYSTEM_FA       "سیستم"
+#define LAMP_FA         "لامپ"
+#define ALARM_FA        "دزدگیر"
+#define FIRE_FA         "آتش"
+#define HUMIDITY_FA     "رطوبت"
+#define TEMP_FA         "دما"
+#define ON_FA           "روشن"
+#define OFF_FA          "خاموش"
 #define ALARMON         "Alarm activated"  
 #define ALARMOFF        "Alarm deactivated"  
 #define LAMPON          "Lamp turned on"   
@@ -26,7 +34,7 @@
 #define DANGER          "Unauthorized presence detection warning!"
 #define TEMP1           "Warning! The temperature is high.("        
 #define TEMP2           ")"
-#define FIRE            "Warning! The density of smoke is high: "   
+#define FIREMSG         "Warning! The density of smoke is high: "   
 #define CO              "Warning! The density of CO is high: "   
 #define HUMIDITY1           "Warning! The humidity is high.("        
 #define HUMIDITY2           "%)"
@@ -0,0 +1,313 @@
+/**
+ ******************************************************************************
+ * @file           : sim800_wal.c
+ * @brief          : Append-only, CRC checked record log on flash
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ *
+ ******************************************************************************
+ * @verbatim
+ * Record: type (1), ticket (2), payload length (2), payload, CRC-16/CCITT (2)
+ * of everything before it. Multi-byte fields are little endian.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+
+#include "Sim800_port.h"
+#include "Sim800_wal.h"
+
+/* Private define ------------------------------------------------------------*/
+#define WAL_CRC_INIT                            0xFFFF
+#define WAL_CRC_POLY                            0x1021
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t fWal_ScanFile(const char *pPath, uint32_t Limit, pfSim800WalRecord pfRecord, void *pCtx);
+static void fWal_PutU16(uint8_t *pOut, uint16_t Value);
+static uint16_t fWal_GetU16(const uint8_t *pIn);
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                          ##### Exported Functions #####                         ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+/**
+ * @brief Attaches to the log at pPath. A rewrite cut short is finished here: the
+ *        new log is kept when the old one was already removed, dropped otherwise.
+ *
+ * @param pWal
+ * @param pPath
+ * @param pTmpPath where fWal_BeginRewrite writes
+ */
+void fWal_Open(sSim800Wal *pWal, const char *pPath, const char *pTmpPath) {
+
+  pWal->pPath = pPath;
+  pWal->Used = 0;
+  pWal->Size = 0;
+  pWal->Damaged = false;
+
+  if(SIM800_FS.exists(pTmpPath)) {
+
+    if(SIM800_FS.exists(pPath)) {
+      SIM800_FS.remove(pTmpPath);
+    } else {
+      SIM800_FS.rename(pTmpPath, pPath);
+    }
+  }
+
+  File file = SIM800_FS.open(pPath, FILE_READ);
+  if(file) {
+    pWal->Size = file.size();
+    file.close();
+  }
+}
+
+/**
+ * @brief Adds a record to the RAM batch, writing the batch out first when it is full
+ *
+ * @param pWal
+ * @param Type
+ * @param Ticket
+ * @param pData
+ * @param Len up to SIM800_WAL_RECORD_MAX_LEN
+ * @return false when the record is too long or the batch could not be written
+ */
+bool fWal_Append(sSim800Wal *pWal, uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len) {
+
+  uint16_t total = SIM800_WAL_HEADER_LEN + Len + SIM800_WAL_CRC_LEN;
+
+  if(Len > SIM800_WAL_RECORD_MAX_LEN) return false;
+
+  if(pWal->Used + total > SIM800_WAL_BUFFER_SIZE && !fWal_Flush(pWal)) return false;
+
+  uint8_t *pOut = &pWal->Buffer[pWal->Used];
+  pOut[0] = Type;
+  fWal_PutU16(&pOut[1], Ticket);
+  fWal_PutU16(&pOut[3], Len);
+  if(Len > 0) {
+    memcpy(&pOut[SIM800_WAL_HEADER_LEN], pData, Len);
+  }
+  fWal_PutU16(&pOut[SIM800_WAL_HEADER_LEN + Len], fWal_Crc16(pOut, SIM800_WAL_HEADER_LEN + Len, WAL_CRC_INIT));
+
+  if(pWal->Used == 0) {
+    pWal->Pending = SIM800_MILLIS();
+  }
+  pWal->Used += total;
+
+  return true;
+}
+
+/**
+ * @brief Writes the batch to the end of the file in one go
+ *
+ * @param pWal
+ * @return false when the file could not be written. The batch is kept and the
+ *         log is left Damaged: the caller rewrites it, fWal_ScanLog still sees
+ *         every record.
+ */
+bool fWal_Flush(sSim800Wal *pWal) {
+
+  if(pWal->Used == 0) return true;
+
+  // Records appended behind a torn one would be lost with it
+  if(pWal->Damaged) return false;
+
+  File file = SIM800_FS.open(pWal->pPath, FILE_APPEND);
+  size_t written = 0;
+
+  if(file) {
+    written = file.write(pWal->Buffer, pWal->Used);
+    file.close();
+  }
+
+  if(written != pWal->Used) {
+    Serial.printf("%s: write failed (%u of %u bytes)\n", pWal->pPath, (unsigned)written, pWal->Used);
+    pWal->Damaged = true;
+    return false;
+  }
+
+  pWal->Size += written;
+  pWal->Used = 0;
+  return true;
+}
+
+/**
+ * @brief Drops the file and the batch, for when no record is needed any more
+ *
+ * @param pWal
+ */
+void fWal_Clear(sSim800Wal *pWal) {
+
+  pWal->Used = 0;
+  if(pWal->Size > 0 || pWal->Damaged) {
+    SIM800_FS.remove(pWal->pPath);
+    pWal->Size = 0;
+    pWal->Damaged = false;
+  }
+}
+
+/**
+ * @brief Reads every intact record of a log. Past a damaged one the next intact
+ *        record is looked for a byte further on at a time, so one bad spot does
+ *        not hide what was written after it.
+ *
+ * @param pPath
+ * @param pfRecord
+ * @param pCtx
+ * @return uint32_t bytes of intact records, less than the file when something was skipped
+ */
+uint32_t fWal_Scan(const char *pPath, pfSim800WalRecord pfRecord, void *pCtx) {
+
+  return fWal_ScanFile(pPath, UINT32_MAX, pfRecord, pCtx);
+}
+
+/**
+ * @brief Every record of an open log: the file, only up to Size after a failed
+ *        write, then the batch not written yet
+ *
+ * @param pWal
+ * @param pfRecord
+ * @param pCtx
+ */
+void fWal_ScanLog(const sSim800Wal *pWal, pfSim800WalRecord pfRecord, void *pCtx) {
+
+  uint16_t pos = 0;
+
+  fWal_ScanFile(pWal->pPath, pWal->Damaged ? pWal->Size : UINT32_MAX, pfRecord, pCtx);
+
+  while(pos < pWal->Used) {
+
+    const uint8_t *pRecord = &pWal->Buffer[pos];
+    uint16_t len = fWal_GetU16(&pRecord[3]);
+
+    pfRecord(pRecord[0], fWal_GetU16(&pRecord[1]), &pRecord[SIM800_WAL_HEADER_LEN], len, pCtx);
+    pos += SIM800_WAL_HEADER_LEN + len + SIM800_WAL_CRC_LEN;
+  }
+}
+
+/**
+ * @brief Starts an empty log at pTmpPath to copy the records still needed into
+ *
+ * @param pOut
+ * @param pTmpPath
+ */
+void fWal_BeginRewrite(sSim800Wal *pOut, const char *pTmpPath) {
+
+  SIM800_FS.remove(pTmpPath);
+  pOut->pPath = pTmpPath;
+  pOut->Used = 0;
+  pOut->Size = 0;
+  pOut->Damaged = false;
+}
+
+/**
+ * @brief Puts the rewritten log in place of the old one and its batch, which the
+ *        rewrite is expected to hold. A reset in between is sorted out by fWal_Open.
+ *
+ * @param pWal
+ * @param pOut
+ * @return false when the new log could not be written, the old one stays
+ */
+bool fWal_CommitRewrite(sSim800Wal *pWal, sSim800Wal *pOut) {
+
+  if(!fWal_Flush(pOut)) {
+    SIM800_FS.remove(pOut->pPath);
+    return false;
+  }
+
+  SIM800_FS.remove(pWal->pPath);
+  pWal->Size = 0;
+  pWal->Used = 0;
+  pWal->Damaged = false;
+
+  if(pOut->Size > 0) {
+    if(!SIM800_FS.rename(pOut->pPath, pWal->pPath)) return false;
+    pWal->Size = pOut->Size;
+  }
+
+  return true;
+}
+
+/**
+ * @brief CRC-16/CCITT, Crc is 0xFFFF for a new sum or the previous result to continue one
+ *
+ * @param pData
+ * @param Len
+ * @param Crc
+ * @return uint16_t
+ */
+uint16_t fWal_Crc16(const uint8_t *pData, uint16_t Len, uint16_t Crc) {
+
+  for(uint16_t i = 0; i < Len; i++) {
+
+    Crc ^= (uint16_t)pData[i] << 8;
+    for(uint8_t bit = 0; bit < 8; bit++) {
+      Crc = (Crc & 0x8000) ? (uint16_t)((Crc << 1) ^ WAL_CRC_POLY) : (uint16_t)(Crc << 1);
+    }
+  }
+
+  return Crc;
+}
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                            ##### Private Functions #####                        ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+/**
+ * @brief fWal_Scan over the first Limit bytes of the file
+ *
+ */
+static uint32_t fWal_ScanFile(const char *pPath, uint32_t Limit, pfSim800WalRecord pfRecord, void *pCtx) {
+
+  uint8_t record[SIM800_WAL_BUFFER_SIZE];
+  uint32_t valid = 0;
+  uint32_t pos = 0;
+  File file = SIM800_FS.open(pPath, FILE_READ);
+
+  if(!file) return 0;
+
+  while(pos + SIM800_WAL_HEADER_LEN <= Limit &&
+        file.read(record, SIM800_WAL_HEADER_LEN) == SIM800_WAL_HEADER_LEN) {
+
+    uint16_t len = fWal_GetU16(&record[3]);
+    uint16_t rest = len + SIM800_WAL_CRC_LEN;
+
+    if(len <= SIM800_WAL_RECORD_MAX_LEN && pos + SIM800_WAL_HEADER_LEN + rest <= Limit &&
+       file.read(&record[SIM800_WAL_HEADER_LEN], rest) == rest &&
+       fWal_Crc16(record, SIM800_WAL_HEADER_LEN + len, WAL_CRC_INIT) == fWal_GetU16(&record[SIM800_WAL_HEADER_LEN + len])) {
+
+      valid += SIM800_WAL_HEADER_LEN + rest;
+      pos += SIM800_WAL_HEADER_LEN + rest;
+      pfRecord(record[0], fWal_GetU16(&record[1]), &record[SIM800_WAL_HEADER_LEN], len, pCtx);
+      continue;
+    }
+
+    if(!file.seek(++pos)) break;
+  }
+
+  file.close();
+  return valid;
+}
+
+static void fWal_PutU16(uint8_t *pOut, uint16_t Value) {
+
+  pOut[0] = (uint8_t)Value;
+  pOut[1] = (uint8_t)(Value >> 8);
+}
+
+static uint16_t fWal_GetU16(const uint8_t *pIn) {
+
+  return (uint16_t)(pIn[0] | (pIn[1] << 8));
+}
+
+/**End of Group_Name
+  * @}
+  */
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,88 @@
+/**
+******************************************************************************
+* @file           : sim800_wal.h
+* @brief          : Append-only, CRC checked record log on flash for the sim800 driver
+* @note           : Records are collected in RAM and written in batches. A
+*                   damaged record is skipped: the scan moves on a byte at a
+*                   time until a header and CRC check again, so a write cut
+*                   short by a reset loses only the record it was writing.
+* @copyright      : COPYRIGHT© 2025 DiodeGroup
+******************************************************************************
+* @attention
+*
+* <h2><center>&copy; Copyright© 2025 DiodeGroup.
+* All rights reserved.</center></h2>
+*
+* This software is licensed under terms that can be found in the LICENSE file
+* in the root directory of this software component.
+* If no LICENSE file comes with this software, it is provided AS-IS.
+*
+******************************************************************************
+* @verbatim
+* @endverbatim
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef CDRV_SIM800_WAL_H
+#define CDRV_SIM800_WAL_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exported defines ----------------------------------------------------------*/
+#define SIM800_WAL_BUFFER_SIZE                  1280  /* records waiting for the next flash write, one holds the longest queued SMS */
+#define SIM800_WAL_HEADER_LEN                   5     /* type, ticket, length */
+#define SIM800_WAL_CRC_LEN                      2
+#define SIM800_WAL_RECORD_MAX_LEN               (SIM800_WAL_BUFFER_SIZE - SIM800_WAL_HEADER_LEN - SIM800_WAL_CRC_LEN)
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief Called for every intact record of a log, in the order they were written
+ *
+ */
+typedef void(*pfSim800WalRecord)(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx);
+
+/**
+ * @brief One log file and the records not written to it yet
+ *
+ */
+typedef struct {
+
+  const char *pPath;
+
+  uint8_t Buffer[SIM800_WAL_BUFFER_SIZE];
+
+  uint16_t Used;
+
+  unsigned long Pending;    /* when the oldest buffered record was added */
+
+  uint32_t Size;            /* bytes of intact records in the file */
+
+  bool Damaged;             /* a write failed part way, nothing is appended until a rewrite */
+
+}sSim800Wal;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void fWal_Open(sSim800Wal *pWal, const char *pPath, const char *pTmpPath);
+bool fWal_Append(sSim800Wal *pWal, uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len);
+bool fWal_Flush(sSim800Wal *pWal);
+void fWal_Clear(sSim800Wal *pWal);
+uint32_t fWal_Scan(const char *pPath, pfSim800WalRecord pfRecord, void *pCtx);
+void fWal_ScanLog(const sSim800Wal *pWal, pfSim800WalRecord pfRecord, void *pCtx);
+void fWal_BeginRewrite(sSim800Wal *pOut, const char *pTmpPath);
+bool fWal_CommitRewrite(sSim800Wal *pWal, sSim800Wal *pOut);
+uint16_t fWal_Crc16(const uint8_t *pData, uint16_t Len, uint16_t Crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CDRV_SIM800_WAL_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
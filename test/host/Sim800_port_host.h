@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * @file           : Sim800_port_host.h
+ * @brief          : SIM800_PORT_HEADER of the host build: a virtual millisecond
+ *                   clock, the host file system in place of SPIFFS and plain
+ *                   ring queues in place of FreeRTOS ones
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * Time only moves when the driver waits (SIM800_DELAY_MS, SIM800_YIELD) or a
+ * test calls fHost_Advance, so a run is the same on every machine and a minute
+ * of modem traffic takes as long as the driver needs to process it.
+ * @endverbatim
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef SIM800_PORT_HOST_H
+#define SIM800_PORT_HOST_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "Arduino.h"
+#include "SPIFFS.h"
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief Single task ring of one-byte items
+ *
+ */
+typedef struct {
+  uint8_t *pBuffer;
+  uint16_t Len;
+  uint16_t Head;
+  uint16_t Count;
+}sHostQueue;
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint32_t fHost_Millis(void);
+void fHost_Advance(uint32_t Ms);
+sHostQueue *fHostQueue_Create(uint16_t Len, uint8_t *pBuffer, sHostQueue *pQueue);
+bool fHostQueue_Send(sHostQueue *pQueue, const uint8_t *pItem);
+bool fHostQueue_Receive(sHostQueue *pQueue, uint8_t *pItem, uint32_t WaitMs);
+
+/* Exported defines ----------------------------------------------------------*/
+#define SIM800_MILLIS()                         fHost_Millis()
+#define SIM800_DELAY_MS(ms)                     fHost_Advance(ms)
+#define SIM800_YIELD()                          fHost_Advance(1)
+#define SIM800_WDT_RESET()                      ((void)0)
+#define SIM800_FS                               SPIFFS
+
+#define SIM800_EVENT_QUEUE_T                    sHostQueue *
+#define SIM800_EVENT_QUEUE_STORAGE_T            sHostQueue
+#define SIM800_EVENT_QUEUE_CREATE(len, pBuffer, pStorage) \
+                                                fHostQueue_Create(len, pBuffer, pStorage)
+#define SIM800_EVENT_QUEUE_SEND(queue, pItem)   fHostQueue_Send(queue, pItem)
+#define SIM800_EVENT_QUEUE_RECEIVE(queue, pItem, ms) \
+                                                fHostQueue_Receive(queue, pItem, ms)
+
+#endif /* SIM800_PORT_HOST_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
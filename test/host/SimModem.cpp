@@ -0,0 +1,349 @@
+/**
+ ******************************************************************************
+ * @file           : SimModem.cpp
+ * @brief          : Scripted SIM800 on the other end of Sim800.ComPort
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "SimModem.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_CTRL_Z                              26
+#define SIM_ESC                                 27
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                          ##### Exported Functions #####                         ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+/**
+ * @brief Back to power-on state, settings and scripts are kept
+ *
+ */
+void SimModem::Reset(void) {
+
+  Tx.clear();
+  LastDue = 0;
+  Line.clear();
+  Body.clear();
+  InBody = false;
+  PduMode = false;
+  ReportsOn = false;
+}
+
+/**
+ * @brief Queues modem output DelayMs after the latency, behind anything queued
+ *        before it
+ *
+ * @param Text
+ * @param DelayMs
+ */
+void SimModem::Push(const std::string &Text, uint32_t DelayMs) {
+
+  uint32_t due = fHost_Millis() + LatencyMs + DelayMs;
+  if(JitterMs > 0) due += fNext() % (JitterMs + 1);
+  if(!Tx.empty() && (int32_t)(due - LastDue) < 0) due = LastDue;
+  LastDue = due;
+
+  for(char c : Text) {
+    Tx.push_back(sByte{ due, c });
+  }
+}
+
+/**
+ * @brief Commands sent from index From on that start with pPrefix
+ *
+ * @param pPrefix
+ * @param From
+ * @return size_t
+ */
+size_t SimModem::Count(const char *pPrefix, size_t From) const {
+
+  size_t n = 0;
+  for(size_t i = From; i < Commands.size(); i++) {
+    if(Commands[i].rfind(pPrefix, 0) == 0) n++;
+  }
+  return n;
+}
+
+size_t SimModem::write(uint8_t c) {
+
+  if(InBody) {
+    if(c == SIM_CTRL_Z) {
+      InBody = false;
+      fSubmit();
+    } else if(c == SIM_ESC) {
+      InBody = false;
+      Body.clear();
+      Push("\r\nOK\r\n");
+    } else {
+      Body += (char)c;
+    }
+    return 1;
+  }
+
+  if(c == '\n') {
+    std::string line = Line;
+    Line.clear();
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    if(!line.empty()) fHandle(line);
+  } else {
+    Line += (char)c;
+  }
+  return 1;
+}
+
+size_t SimModem::write(const uint8_t *b, size_t n) {
+
+  for(size_t i = 0; i < n; i++) {
+    write(b[i]);
+  }
+  return n;
+}
+
+int SimModem::available() {
+
+  uint32_t now = fHost_Millis();
+  int n = 0;
+  for(const sByte &b : Tx) {
+    if((int32_t)(now - b.Due) < 0) break;
+    n++;
+  }
+  return n;
+}
+
+int SimModem::read() {
+
+  if(Tx.empty() || (int32_t)(fHost_Millis() - Tx.front().Due) < 0) return -1;
+
+  char c = Tx.front().c;
+  Tx.pop_front();
+  return (uint8_t)c;
+}
+
+int SimModem::peek() {
+
+  if(Tx.empty() || (int32_t)(fHost_Millis() - Tx.front().Due) < 0) return -1;
+  return (uint8_t)Tx.front().c;
+}
+
+size_t SimModem::readBytes(char *b, size_t n) {
+
+  uint32_t now = fHost_Millis();
+  size_t i = 0;
+  while(i < n && !Tx.empty() && (int32_t)(now - Tx.front().Due) >= 0) {
+    b[i++] = Tx.front().c;
+    Tx.pop_front();
+  }
+  return i;
+}
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                           ##### Private Functions #####                         ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+/**
+ * @brief xorshift32, the same sequence for the same seed on every host
+ *
+ * @return uint32_t
+ */
+uint32_t SimModem::fNext(void) {
+
+  Rand ^= Rand << 13;
+  Rand ^= Rand >> 17;
+  Rand ^= Rand << 5;
+  return Rand;
+}
+
+bool SimModem::fFails(void) {
+
+  return FailPermille > 0 && (fNext() % 1000) < FailPermille;
+}
+
+/**
+ * @brief One command line from the driver, a ';' batch answers once for all
+ *
+ * @param Command
+ */
+void SimModem::fHandle(const std::string &Command) {
+
+  Commands.push_back(Command);
+
+  if(Script && Script(Command)) return;
+
+  if(fFails()) {
+    Push("\r\nERROR\r\n");
+    return;
+  }
+
+  if(Command.rfind("AT+CMGS", 0) == 0) {
+    InBody = true;
+    Body.clear();
+    Push("\r\n> ");
+    return;
+  }
+
+  // Split "AT+A;+B" outside quotes, each part answers its info lines, one final OK
+  std::string replies;
+  std::vector<std::pair<std::string, uint32_t>> later;
+  bool quoted = false;
+  size_t start = 0;
+  for(size_t i = 0; i <= Command.size(); i++) {
+
+    if(i < Command.size() && Command[i] == '"') quoted = !quoted;
+    if(i < Command.size() && (Command[i] != ';' || quoted)) continue;
+
+    std::string part = Command.substr(start, i - start);
+    if(start > 0) part = "AT" + part;
+    start = i + 1;
+
+    std::string reply;
+    uint32_t delay = 0;
+    if(!fAnswer(part, &reply, &delay)) {
+      Push("\r\nERROR\r\n");
+      return;
+    }
+    if(delay > 0) {
+      later.push_back({ reply, delay });
+    } else {
+      replies += reply;
+    }
+  }
+
+  Push(replies + "\r\nOK\r\n");
+  for(const auto &l : later) {
+    Push(l.first, l.second);
+  }
+}
+
+/**
+ * @brief Answer to one command, without the final OK
+ *
+ * @param Command
+ * @param pReply info lines, each "\r\n...\r\n"
+ * @param pDelay when set, pReply comes that long after the OK (URC style)
+ * @return bool false for a command the SIM800 would refuse
+ */
+bool SimModem::fAnswer(const std::string &Command, std::string *pReply, uint32_t *pDelay) {
+
+  if(Command == "AT" || Command == "ATE0" || Command == "ATH" || Command == "AT&F") return true;
+
+  if(Command == "AT+CPIN?") {
+    *pReply = "\r\n+CPIN: READY\r\n";
+    return true;
+  }
+
+  if(Command == "AT+CSQ") {
+    *pReply = "\r\n+CSQ: 21,0\r\n";
+    return true;
+  }
+
+  if(Command.rfind("AT+CMGF=", 0) == 0) {
+    PduMode = (Command[8] == '0');
+    return true;
+  }
+
+  if(Command.rfind("AT+CSCS=", 0) == 0 || Command.rfind("AT+CSMP=", 0) == 0 || Command.rfind("AT+CFUN=", 0) == 0) return true;
+
+  if(Command.rfind("AT+CNMI=", 0) == 0) {
+    // <mode>,<mt>,<bm>,<ds>,<bfr>
+    ReportsOn = (Command.size() > 14 && Command[14] == '1');
+    return true;
+  }
+
+  if(Command.rfind("AT+CMGL", 0) == 0) {
+    for(const std::string &m : Inbox) {
+      *pReply += "\r\n" + m + "\r\n";
+    }
+    return true;
+  }
+
+  if(Command.rfind("AT+CMGR=", 0) == 0) {
+    int index = atoi(Command.c_str() + 8);
+    if(ReadMessage) {
+      *pReply = "\r\n" + ReadMessage(index) + "\r\n";
+      return true;
+    }
+    std::string tag = "+CMGL: " + std::to_string(index) + ",";
+    for(const std::string &m : Inbox) {
+      if(m.rfind(tag, 0) == 0) {
+        *pReply = "\r\n+CMGR: " + m.substr(tag.size()) + "\r\n";
+        return true;
+      }
+    }
+    return true;
+  }
+
+  if(Command.rfind("AT+CMGD=", 0) == 0) {
+    int index = atoi(Command.c_str() + 8);
+    size_t comma = Command.find(',');
+    int flag = (comma == std::string::npos) ? 0 : atoi(Command.c_str() + comma + 1);
+    if(flag != 0) {
+      Inbox.clear();
+      return true;
+    }
+    std::string tag = "+CMGL: " + std::to_string(index) + ",";
+    for(size_t i = 0; i < Inbox.size(); i++) {
+      if(Inbox[i].rfind(tag, 0) == 0) {
+        Inbox.erase(Inbox.begin() + i);
+        break;
+      }
+    }
+    return true;
+  }
+
+  if(Command.rfind("AT+CUSD=", 0) == 0) {
+    size_t open = Command.find('"');
+    if(open == std::string::npos) return true;
+    std::string code = Command.substr(open + 1, Command.find('"', open + 1) - open - 1);
+    auto it = Ussd.find(code);
+    if(it != Ussd.end()) {
+      *pReply = "\r\n+CUSD: 0, \"" + it->second + "\", 15\r\n";
+      *pDelay = UssdMs;
+    }
+    return true;
+  }
+
+  if(Command.rfind("ATD", 0) == 0) return true;
+
+  return Command.rfind("AT", 0) == 0;
+}
+
+/**
+ * @brief Message body closed with ^Z: +CMGS, then the delivery report if asked
+ *
+ */
+void SimModem::fSubmit(void) {
+
+  Bodies.push_back(Body);
+  Body.clear();
+
+  if(fFails()) {
+    Push("\r\n+CMS ERROR: 500\r\n", SubmitMs);
+    return;
+  }
+
+  uint8_t mr = ++MessageRef;
+  Push("\r\n+CMGS: " + std::to_string(mr) + "\r\n\r\nOK\r\n", SubmitMs);
+
+  if(!ReportsOn) return;
+
+  if(PduMode) {
+    char pdu[64];
+    snprintf(pdu, sizeof(pdu), "0006%02X0C918919123254765290211223518252902112235182" "00", mr);
+    Push(std::string("\r\n+CDS: 25\r\n") + pdu + "\r\n", ReportMs);
+  } else {
+    Push("\r\n+CDS: 6," + std::to_string(mr) + ",\"+989121234567\",145,\"25/09/12,21:32:15+14\",\"25/09/12,21:32:17+14\",0\r\n", ReportMs);
+  }
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * @file           : SimModem.h
+ * @brief          : Scripted SIM800 on the other end of Sim800.ComPort
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * Answers the commands the driver sends (AT, ATE0, AT+CPIN?, AT+CMGF, AT+CSCS,
+ * AT+CSMP, AT+CNMI, AT+CMGS with its body, AT+CMGL, AT+CMGR, AT+CMGD,
+ * AT+CUSD, ATD, ATH and ';' batches of them). Output is timed on the host
+ * clock: every reply shows up LatencyMs (plus up to JitterMs) after the line
+ * that caused it, never ahead of earlier output. FailPermille of the commands
+ * answer ERROR (+CMS ERROR for a message body) instead. Script sees every line
+ * first and answers it itself by returning true.
+ * @endverbatim
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef SIM800_SIM_MODEM_H
+#define SIM800_SIM_MODEM_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Sim800_port_host.h"
+
+/* Exported types ------------------------------------------------------------*/
+class SimModem : public Stream {
+public:
+  uint32_t LatencyMs = 5;
+  uint32_t JitterMs = 0;
+  uint16_t FailPermille = 0;
+  uint32_t SubmitMs = 20;                       /* body to +CMGS */
+  uint32_t ReportMs = 200;                      /* +CMGS to +CDS, when reports are on */
+  uint32_t UssdMs = 100;
+  std::map<std::string, std::string> Ussd = {   /* code to +CUSD text, unknown codes get no answer */
+    { "*555*4*3#", "1:Farsi 2:English 72" },
+    { "2", "Language: English" },
+    { "*555*1*2#", "Credit: 68,734 IRR" },
+  };
+
+  std::vector<std::string> Inbox;               /* "+CMGL: ...\r\nbody" listed by AT+CMGL */
+  std::function<std::string(int Index)> ReadMessage;   /* "+CMGR: ...\r\nbody" for AT+CMGR */
+  std::function<bool(const std::string &Line)> Script;
+
+  std::vector<std::string> Commands;            /* every line the driver sent */
+  std::vector<std::string> Bodies;              /* every message body, without the ^Z */
+  bool PduMode = false;
+  bool ReportsOn = false;
+  uint8_t MessageRef = 0;
+  size_t Pending() const { return Tx.size(); }
+
+  void Reset(void);
+  void Seed(uint32_t Value) { Rand = Value ? Value : 1; }
+  void Push(const std::string &Text, uint32_t DelayMs = 0);
+  size_t Count(const char *pPrefix, size_t From = 0) const;
+
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *b, size_t n) override;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(char *b, size_t n) override;
+
+private:
+  struct sByte { uint32_t Due; char c; };
+  std::deque<sByte> Tx;
+  uint32_t LastDue = 0;
+  std::string Line;
+  std::string Body;
+  bool InBody = false;
+  uint32_t Rand = 1;
+
+  uint32_t fNext(void);
+  bool fFails(void);
+  void fHandle(const std::string &Line);
+  bool fAnswer(const std::string &Command, std::string *pReply, uint32_t *pDelay);
+  void fSubmit(void);
+};
+
+#endif /* SIM800_SIM_MODEM_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
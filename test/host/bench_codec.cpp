@@ -0,0 +1,223 @@
+/**
+ ******************************************************************************
+ * @file           : bench_codec.cpp
+ * @brief          : UCS2 hex encoding of Persian and ASCII texts, the String
+ *                   based fTextToHex the driver used to have against the codec,
+ *                   and decoding inbound hex bodies back in place
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * fTextToHex is kept here as it was, so the before and after run on the same
+ * String the host shim provides. The decoder had no String version before it,
+ * so it is timed alone, on the texts the encoder wrote.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_codec.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_ROUNDS                            50000UL
+
+/* Private types -------------------------------------------------------------*/
+typedef struct {
+
+  double NsPerText;
+
+  double AllocsPerText;
+
+}sBenchResult;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *AsciiCorpus[] = {
+  "Alarm activated", "Lamp turned off", "Temperature sensor activated",
+  "Warning! The density of smoke is high: 41%", "Hello from Didomak.",
+  "Warning! The alarm was disconnected from the ceiling.",
+};
+
+static const char *PersianCorpus[] = {
+  "\xd8\xb3\xdb\x8c\xd8\xb3\xd8\xaa\xd9\x85 \xd8\xb1\xd9\x88\xd8\xb4\xd9\x86",                     // "سیستم روشن"
+  "\xd9\x84\xd8\xa7\xd9\x85\xd9\xbe \xd8\xae\xd8\xa7\xd9\x85\xd9\x88\xd8\xb4",                     // "لامپ خاموش"
+  "\xd8\xaf\xd9\x85\xd8\xa7: 41",                                                                  // "دما: 41"
+  "\xd8\xa2\xd8\xaa\xd8\xb4 \xd8\xaf\xd8\xb2\xd8\xaf\xda\xaf\xdb\x8c\xd8\xb1 \xd8\xb1\xd8\xb7\xd9\x88\xd8\xa8\xd8\xaa",  // "آتش دزدگیر رطوبت"
+};
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief The encoder as it was before the codec, verbatim
+ *
+ */
+static String fTextToHex(String text) {
+  String output = "";
+  int len = text.length();
+  for (int i = 0; i < len; ) {
+    uint32_t codepoint = 0;
+    uint8_t c = text[i];
+    if (c < 0x80) {
+      codepoint = c;
+      i += 1;
+    } else if ((c & 0xE0) == 0xC0) {
+      codepoint = ((c & 0x1F) << 6) | (text[i+1] & 0x3F);
+      i += 2;
+    } else if ((c & 0xF0) == 0xE0) {
+      codepoint = ((c & 0x0F) << 12) | ((text[i+1] & 0x3F) << 6) | (text[i+2] & 0x3F);
+      i += 3;
+    } else {
+      i++;
+      continue;
+    }
+    char buffer[5];
+    sprintf(buffer, "%04X", codepoint);
+    output += buffer;
+  }
+  return output;
+}
+
+/**
+ * @brief Encodes every text of the corpus BENCH_ROUNDS times
+ *
+ * @param ppTexts
+ * @param Count
+ * @param Codec the codec, or fTextToHex when false
+ * @return sBenchResult
+ */
+static sBenchResult fBench_Run(const char **ppTexts, size_t Count, bool Codec) {
+
+  sBenchResult result = {};
+  char hex[4 * SIM800_SMS_TEXT_MAX_LEN + 1];
+  volatile size_t sink = 0;
+
+  for(size_t i = 0; i < Count; i++) {
+
+    const char *p = ppTexts[i];
+    fCodec_Ucs2Hex(&p, p + strlen(p), hex, sizeof(hex));
+    HOST_CHECK(fTextToHex(ppTexts[i]) == hex);   // same output, BMP text only
+  }
+
+  size_t allocs = fHost_HeapAllocs();
+  double start = fHost_WallUs();
+
+  for(unsigned long r = 0; r < BENCH_ROUNDS; r++) {
+    for(size_t i = 0; i < Count; i++) {
+
+      if(Codec) {
+        sSim800TextInfo info;
+        const char *p = ppTexts[i];
+        uint16_t len = strlen(p);
+        fCodec_Analyze(p, len, &info);
+        sink += fCodec_Ucs2Hex(&p, p + len, hex, sizeof(hex)) + info.Units;
+      } else {
+        sink += fTextToHex(ppTexts[i]).length();
+      }
+    }
+  }
+
+  double us = fHost_WallUs() - start;
+  result.NsPerText = us * 1000 / (BENCH_ROUNDS * Count);
+  result.AllocsPerText = (double)(fHost_HeapAllocs() - allocs) / (BENCH_ROUNDS * Count);
+  (void)sink;
+
+  return result;
+}
+
+/**
+ * @brief Decodes the hex of every text of the corpus in place BENCH_ROUNDS
+ *        times, as the inbox does with a body read in the HEX character set
+ *
+ * @param ppTexts
+ * @param Count
+ * @param Ucs2 four digits a character, or one GSM-7 septet in two when false
+ * @return sBenchResult
+ */
+static sBenchResult fBench_Decode(const char **ppTexts, size_t Count, bool Ucs2) {
+
+  sBenchResult result = {};
+  char hex[8][4 * SIM800_SMS_TEXT_MAX_LEN + 1];
+  uint16_t lens[8];
+  char body[4 * SIM800_SMS_TEXT_MAX_LEN + 1];
+  volatile size_t sink = 0;
+
+  HOST_CHECK(Count <= 8);
+  for(size_t i = 0; i < Count; i++) {
+
+    const char *p = ppTexts[i];
+    if(Ucs2) {
+      lens[i] = fCodec_Ucs2Hex(&p, p + strlen(p), hex[i], sizeof(hex[i]));
+    } else {
+      lens[i] = fCodec_HexEncode((const uint8_t *)p, strlen(p), hex[i]);   // ASCII letters are their own septets
+    }
+
+    memcpy(body, hex[i], lens[i] + 1);
+    uint16_t len = Ucs2 ? fCodec_Ucs2HexToUtf8(body, lens[i], body, sizeof(body)) :
+                          fCodec_Gsm7HexToUtf8(body, lens[i], body, sizeof(body));
+    HOST_CHECK(len == strlen(ppTexts[i]) && strcmp(body, ppTexts[i]) == 0);
+  }
+
+  size_t allocs = fHost_HeapAllocs();
+  double start = fHost_WallUs();
+
+  for(unsigned long r = 0; r < BENCH_ROUNDS; r++) {
+    for(size_t i = 0; i < Count; i++) {
+
+      memcpy(body, hex[i], lens[i] + 1);
+      sink += Ucs2 ? fCodec_Ucs2HexToUtf8(body, lens[i], body, sizeof(body)) :
+                     fCodec_Gsm7HexToUtf8(body, lens[i], body, sizeof(body));
+    }
+  }
+
+  double us = fHost_WallUs() - start;
+  result.NsPerText = us * 1000 / (BENCH_ROUNDS * Count);
+  result.AllocsPerText = (double)(fHost_HeapAllocs() - allocs) / (BENCH_ROUNDS * Count);
+  (void)sink;
+
+  return result;
+}
+
+static void fBench_Corpus(const char *pName, const char **ppTexts, size_t Count) {
+
+  sBenchResult before = fBench_Run(ppTexts, Count, false);
+  sBenchResult after = fBench_Run(ppTexts, Count, true);
+
+  printf("codec: %-7s fTextToHex %.1f ns/text %.1f allocations/text, codec %.1f ns/text %.1f allocations/text, %.1fx\n",
+         pName, before.NsPerText, before.AllocsPerText, after.NsPerText, after.AllocsPerText,
+         before.NsPerText / after.NsPerText);
+
+  HOST_CHECK(after.AllocsPerText == 0);
+  HOST_CHECK(before.AllocsPerText > 0);
+  HOST_CHECK(after.NsPerText < before.NsPerText);
+}
+
+static void fBench_DecodeCorpus(const char *pName, const char **ppTexts, size_t Count, bool Ucs2) {
+
+  sBenchResult decode = fBench_Decode(ppTexts, Count, Ucs2);
+
+  printf("codec: %-7s %s hex to UTF-8 in place %.1f ns/text %.1f allocations/text\n",
+         pName, Ucs2 ? "UCS2" : "GSM-7", decode.NsPerText, decode.AllocsPerText);
+
+  HOST_CHECK(decode.AllocsPerText == 0);
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("bench_codec", NULL);
+
+  fBench_Corpus("ASCII", AsciiCorpus, sizeof(AsciiCorpus) / sizeof(AsciiCorpus[0]));
+  fBench_Corpus("Persian", PersianCorpus, sizeof(PersianCorpus) / sizeof(PersianCorpus[0]));
+  fBench_DecodeCorpus("ASCII", AsciiCorpus, sizeof(AsciiCorpus) / sizeof(AsciiCorpus[0]), false);
+  fBench_DecodeCorpus("ASCII", AsciiCorpus, sizeof(AsciiCorpus) / sizeof(AsciiCorpus[0]), true);
+  fBench_DecodeCorpus("Persian", PersianCorpus, sizeof(PersianCorpus) / sizeof(PersianCorpus[0]), true);
+
+  return fHost_End("bench_codec");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
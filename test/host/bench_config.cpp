@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * @file           : bench_config.cpp
+ * @brief          : SMS per minute with the modem settings re-sent before
+ *                   every message, and with the configuration shadow
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * Host time, so the rates are those of a modem answering commands in
+ * BENCH_LATENCY_MS and taking BENCH_SUBMIT_MS to hand a message to the network.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_MESSAGES                          100
+#define BENCH_LATENCY_MS                        60
+#define BENCH_SUBMIT_MS                         1500
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief Sends BENCH_MESSAGES one after the other
+ *
+ * @param Resend forget the applied settings before each one, as if there were no shadow
+ * @param pCommands AT lines per message
+ * @return double messages per minute
+ */
+static double fBench_Run(bool Resend, double *pCommands) {
+
+  uint32_t start = fHost_Millis();
+  size_t from = Modem.Commands.size();
+
+  for(int i = 0; i < BENCH_MESSAGES; i++) {
+
+    uint16_t ticket = 0;
+    bool done = false;
+
+    if(Resend) fCfg_Invalidate();
+    HOST_CHECK(fSim800_SMSSendEx("09121234567", "Temperature high: 41C", eSMS_PRIORITY_NORMAL, &ticket) == SIM800_RES_OK);
+    while(!done) {
+      fHost_Run(1);
+      fSim800_SMSStatus(ticket, &done);
+    }
+    HOST_CHECK(fSim800_SMSStatus(ticket, NULL) == eSMS_STATUS_SENT);
+  }
+
+  *pCommands = (double)(Modem.Commands.size() - from) / BENCH_MESSAGES;
+  return BENCH_MESSAGES * 60000.0 / (fHost_Millis() - start);
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  double before, after, commandsBefore, commandsAfter;
+
+  fHost_Begin("bench_config", &Modem);
+  Sim800.EnableDeliveryReport = false;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+
+  Modem.LatencyMs = BENCH_LATENCY_MS;
+  Modem.SubmitMs = BENCH_SUBMIT_MS;
+
+  before = fBench_Run(true, &commandsBefore);
+  after = fBench_Run(false, &commandsAfter);
+
+  printf("config: settings every message %.1f SMS/min (%.1f AT lines/SMS), shadowed %.1f SMS/min (%.1f AT lines/SMS)\n",
+         before, commandsBefore, after, commandsAfter);
+
+  HOST_CHECK(commandsAfter == 1.0);             // AT+CMGS alone
+  HOST_CHECK(commandsBefore > commandsAfter);
+  HOST_CHECK(after > before);
+
+  return fHost_End("bench_config");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
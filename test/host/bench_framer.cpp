@@ -0,0 +1,108 @@
+/**
+ ******************************************************************************
+ * @file           : bench_framer.cpp
+ * @brief          : UART line framer throughput and heap use per line
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_LINES                             2000000UL
+#define BENCH_UART_FIFO                         128   /* bytes the ESP32 UART driver hands over at once */
+
+/* Private types -------------------------------------------------------------*/
+/**
+ * @brief Replays a capture of modem output over and over, without allocating
+ *
+ */
+class LineSource : public Stream {
+public:
+  LineSource(const char *pText, unsigned long Lines) : pText(pText), Len(strlen(pText)) {
+    bool text = false;
+    for(size_t i = 0; i < Len; i++) {
+      if(pText[i] == '\n') { LinesPerPass += text; text = false; }
+      else if(pText[i] != '\r') text = true;
+    }
+    Passes = Left = (Lines + LinesPerPass - 1) / LinesPerPass;
+  }
+  using Print::write;
+  size_t write(uint8_t c) override { return 1; }
+  int available() override { return (Left == 0) ? 0 : BENCH_UART_FIFO; }
+  int read() override { char c; return readBytes(&c, 1) ? (uint8_t)c : -1; }
+  int peek() override { return Left ? (uint8_t)pText[Pos] : -1; }
+  size_t readBytes(char *b, size_t n) override {
+    size_t i = 0;
+    while(i < n && Left > 0) {
+      b[i++] = pText[Pos++];
+      if(Pos == Len) { Pos = 0; Left--; }
+    }
+    Bytes += i;
+    return i;
+  }
+  unsigned long Bytes = 0;
+  unsigned long LinesPerPass = 0;               /* not blank, the ones the framer hands out */
+  unsigned long Passes;
+
+private:
+  const char *pText;
+  size_t Len;
+  size_t Pos = 0;
+  unsigned long Left;
+};
+
+/* Private variables ---------------------------------------------------------*/
+static const char Capture[] =
+  "\r\n+CMTI: \"SM\",12\r\n"
+  "\r\n+CSQ: 21,0\r\n"
+  "\r\nOK\r\n"
+  "\r\n+CMGL: 3,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"\r\n"
+  "064406270645067E00200631064806340646\r\n"
+  "\r\n+CDS: 6,41,\"+989121234567\",145,\"25/09/12,21:32:15+14\",\"25/09/12,21:32:17+14\",0\r\n"
+  "\r\n+CUSD: 0, \"Credit: 68,734 IRR\", 15\r\n";
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  LineSource source(Capture, BENCH_LINES);
+  unsigned long lines = 0;
+  const char *pLine;
+
+  fHost_Begin("bench_framer", NULL);
+  Sim800.ComPort = &source;
+
+  size_t allocs = fHost_HeapAllocs();
+  double start = fHost_WallUs();
+
+  while(source.available() > 0 || Sim800.Rx.Tail != Sim800.Rx.Head) {
+    fRx_Fill();
+    while(fRx_NextLine(&pLine)) {
+      lines++;
+    }
+  }
+
+  double us = fHost_WallUs() - start;
+  allocs = fHost_HeapAllocs() - allocs;
+
+  printf("framer: %lu lines, %lu bytes in %.1f ms: %.2f M lines/s, %.1f MB/s, %.3f allocations/line\n",
+         lines, source.Bytes, us / 1000, lines / us, source.Bytes / us, (double)allocs / lines);
+
+  HOST_CHECK(lines == source.Passes * source.LinesPerPass);
+  HOST_CHECK(allocs == 0);
+  HOST_CHECK(Sim800.Rx.Overflows == 0);
+
+  return fHost_End("bench_framer");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
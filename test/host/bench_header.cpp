@@ -0,0 +1,165 @@
+/**
+ ******************************************************************************
+ * @file           : bench_header.cpp
+ * @brief          : Header throughput over captured +CMGL, +CMGR and +CDS
+ *                   lines, the String based parse the driver used to have
+ *                   against fSmsHeader_Parse
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * The old parse is kept here as it was, less the logging, and writes the same
+ * String fields. It took +CMGL and +CMGR only; a +CDS got two atoi calls at the
+ * first and last comma, and is timed that way.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_ROUNDS                            50000UL
+#define BENCH_REPEATS                           5
+
+/* Private types -------------------------------------------------------------*/
+typedef struct {
+
+  double LinesPerSec;
+
+  double AllocsPerLine;
+
+}sBenchResult;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *Captured[] = {
+  "+CMGL: 1,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"",
+  "+CMGL: 12,\"REC READ\",\"09121234567\",\"Ali, home\",\"24/03/01,03:30:00+14\"",
+  "+CMGR: \"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"",
+  "+CMGR: \"REC READ\",\"+989121234567\",\"\",\"24/02/29,23:00:00-00\"",
+  "+CDS: 6,7,\"+989121234567\",145,\"25/09/12,21:32:15+14\",\"25/09/12,21:32:20+14\",0",
+};
+
+#define CAPTURED_COUNT                          (sizeof(Captured) / sizeof(Captured[0]))
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief The +CMGL and +CMGR parse as it was before fSmsHeader_Parse
+ *
+ */
+static sim800_res_t fRecivedSms_ParseString(const String *pLine, sSmsData *pData) {
+
+  bool isList = pLine->startsWith("+CMGL:");
+
+  if (!isList && !pLine->startsWith("+CMGR:")) {
+    return SIM800_RES_REVIEVED_SMS_INVALID;
+  }
+
+  if (isList) {
+
+    int firstComma = pLine->indexOf(',');
+    if (firstComma == -1) return SIM800_RES_REVIEVED_SMS_INVALID;
+
+    String idxStr = pLine->substring(6, firstComma);
+    pData->index = idxStr.toInt();
+  }
+
+  int firstQuote = pLine->indexOf('"', 6);
+  int secondQuote = pLine->indexOf('"', firstQuote + 1);
+  int thirdQuote = pLine->indexOf('"', secondQuote + 1);
+  int fourthQuote = pLine->indexOf('"', thirdQuote + 1);
+
+  if (firstQuote == -1 || secondQuote == -1 || thirdQuote == -1 || fourthQuote == -1) return SIM800_RES_REVIEVED_SMS_INVALID;
+  String phoneNumber = pLine->substring(thirdQuote + 1, fourthQuote);
+
+  if(fNormalizedPhoneNumber(phoneNumber, &pData->phoneNumber) != SIM800_RES_OK) {
+    return SIM800_RES_PHONENUMBER_INVALID;
+  }
+
+  int lastQuoteOpen = pLine->lastIndexOf('"');
+  int lastQuoteClose = pLine->lastIndexOf('"', lastQuoteOpen - 1);
+  if (lastQuoteOpen > lastQuoteClose) {
+    pData->dateTime = pLine->substring(lastQuoteClose + 1, lastQuoteOpen);
+  }
+
+  return SIM800_RES_OK;
+}
+
+/**
+ * @brief Parses every captured line BENCH_ROUNDS times, as the inbox and the
+ *        report handler get them
+ *
+ * @param Parse fSmsHeader_Parse, or the String parse when false
+ * @return sBenchResult
+ */
+static sBenchResult fBench_Run(bool Parse) {
+
+  sBenchResult result = {};
+  sSmsData data;
+  sSim800SmsHeader header;
+  volatile uint32_t sink = 0;
+
+  size_t allocs = fHost_HeapAllocs();
+  double start = fHost_WallUs();
+
+  for(unsigned long r = 0; r < BENCH_ROUNDS; r++) {
+    for(size_t i = 0; i < CAPTURED_COUNT; i++) {
+
+      const char *pLine = Captured[i];
+
+      if(Parse) {
+        HOST_CHECK(fSmsHeader_Parse(pLine, &header, NULL) == SIM800_RES_OK);
+        sink += header.Time;
+      } else if(strncmp(pLine, "+CDS:", 5) == 0) {
+        sink += atoi(strchr(pLine, ',') + 1) + atoi(strrchr(pLine, ',') + 1);
+      } else {
+        String line = pLine;
+        HOST_CHECK(fRecivedSms_ParseString(&line, &data) == SIM800_RES_OK);
+        sink += data.dateTime.length();
+      }
+    }
+  }
+
+  double us = fHost_WallUs() - start;
+  result.LinesPerSec = (BENCH_ROUNDS * CAPTURED_COUNT) / (us / 1e6);
+  result.AllocsPerLine = (double)(fHost_HeapAllocs() - allocs) / (BENCH_ROUNDS * CAPTURED_COUNT);
+  (void)sink;
+
+  return result;
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("bench_header", NULL);
+
+  // best of a few alternating runs, so one slow time slice does not decide it
+  sBenchResult before = fBench_Run(false);
+  sBenchResult after = fBench_Run(true);
+  for(int i = 1; i < BENCH_REPEATS; i++) {
+    sBenchResult run = fBench_Run(false);
+    if(run.LinesPerSec > before.LinesPerSec) before = run;
+    run = fBench_Run(true);
+    if(run.LinesPerSec > after.LinesPerSec) after = run;
+  }
+
+  printf("header: %zu lines, String parse %.0f lines/s %.1f allocations/line, "
+         "fSmsHeader_Parse %.0f lines/s %.1f allocations/line, %.1fx\n",
+         CAPTURED_COUNT, before.LinesPerSec, before.AllocsPerLine, after.LinesPerSec, after.AllocsPerLine,
+         after.LinesPerSec / before.LinesPerSec);
+
+  HOST_CHECK(after.AllocsPerLine == 0);
+  HOST_CHECK(before.AllocsPerLine > 0);
+  HOST_CHECK(after.LinesPerSec > before.LinesPerSec);
+
+  return fHost_End("bench_header");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
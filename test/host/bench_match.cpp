@@ -0,0 +1,185 @@
+/**
+ ******************************************************************************
+ * @file           : bench_match.cpp
+ * @brief          : Command matching over a corpus of SMS bodies, the String
+ *                   toLowerCase and indexOf chain the driver used to have
+ *                   against fCommand_Parse
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * The old matcher lowered the body in place; here it lowers a copy each round,
+ * the same String the message arrived in, so the heap work it did is counted.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_ROUNDS                            50000UL
+#define BENCH_REPEATS                           5
+
+/* Private types -------------------------------------------------------------*/
+typedef struct {
+
+  const char *pText;
+
+  eCommandType Command;
+
+  eSim800Switch Switch;
+
+  bool HasValue;
+
+  int32_t Value;
+
+}sMatchCase;
+
+typedef struct {
+
+  double MessagesPerSec;
+
+  double AllocsPerMessage;
+
+}sBenchResult;
+
+/* Private variables ---------------------------------------------------------*/
+static const sMatchCase Corpus[] = {
+  { "Lamp on",                                eLAMP_COMMAND,     eSWITCH_ON,   false, 0 },
+  { "LAMP OFF",                               eLAMP_COMMAND,     eSWITCH_OFF,  false, 0 },
+  { "system off",                             eSYSTEM_COMMAND,   eSWITCH_OFF,  false, 0 },
+  { "Temperature 35",                         eTEMP_COMMAND,     eSWITCH_NONE, true,  35 },
+  { "temperature -5",                         eTEMP_COMMAND,     eSWITCH_NONE, true,  -5 },
+  { "humidity on 70",                         eHUMIDITY_COMMAND, eSWITCH_ON,   true,  70 },
+  { "Fire off",                               eFIRE_COMMAND,     eSWITCH_OFF,  false, 0 },
+  { "monoxide on",                            eMONIXIDE_COMMAND, eSWITCH_ON,   false, 0 },
+  { "alarm on",                               eALARM_COMMAND,    eSWITCH_ON,   false, 0 },
+  { "ip",                                     eIP_COMMAND,       eSWITCH_NONE, false, 0 },
+  { "\xd9\x84\xd8\xa7\xd9\x85\xd9\xbe \xd8\xb1\xd9\x88\xd8\xb4\xd9\x86",                            // "لامپ روشن"
+                                              eLAMP_COMMAND,     eSWITCH_ON,   false, 0 },
+  { "\xd8\xb3\xdb\x8c\xd8\xb3\xd8\xaa\xd9\x85 \xd8\xae\xd8\xa7\xd9\x85\xd9\x88\xd8\xb4",            // "سیستم خاموش"
+                                              eSYSTEM_COMMAND,   eSWITCH_OFF,  false, 0 },
+  { "\xd8\xaf\xd9\x85\xd8\xa7 30",            eTEMP_COMMAND,     eSWITCH_NONE, true,  30 },          // "دما 30"
+  // not commands: words that hold a keyword inside them
+  { "Ship it tomorrow please",                eNO_COMMAND,       eSWITCH_NONE, false, 0 },
+  { "Skip the lampshade, thanks",             eNO_COMMAND,       eSWITCH_NONE, false, 0 },
+  { "Your balance is 12500 Rials. Recharge to stay online.",
+                                              eNO_COMMAND,       eSWITCH_NONE, true,  12500 },
+  { "Hi, call me back when you are free",     eNO_COMMAND,       eSWITCH_NONE, false, 0 },
+};
+
+#define CORPUS_COUNT                            (sizeof(Corpus) / sizeof(Corpus[0]))
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief The matcher as it was before fCommand_Parse: the first keyword found
+ *        anywhere in the lowered body, in this order, no switch or value
+ *
+ */
+static eCommandType fMatch_IndexOf(const String &Massage) {
+
+  String text = Massage;
+  text.toLowerCase();
+
+  if(text.indexOf(SYSTEM) != -1) return eSYSTEM_COMMAND;
+  else if(text.indexOf(LAMP) != -1) return eLAMP_COMMAND;
+  else if(text.indexOf(SMSIP) != -1) return eIP_COMMAND;
+  else if(text.indexOf(ALARM) != -1) return eALARM_COMMAND;
+  else if(text.indexOf(MONOXIDE) != -1) return eMONIXIDE_COMMAND;
+  else if(text.indexOf(FIRE) != -1) return eFIRE_COMMAND;
+  else if(text.indexOf(HUMIDITY) != -1) return eHUMIDITY_COMMAND;
+  else if(text.indexOf(TEMP) != -1) return eTEMP_COMMAND;
+
+  return eNO_COMMAND;
+}
+
+/**
+ * @brief Matches every body of the corpus BENCH_ROUNDS times
+ *
+ * @param pBodies the bodies as the inbox hands them over
+ * @param Parse fCommand_Parse, or fMatch_IndexOf when false
+ * @return sBenchResult
+ */
+static sBenchResult fBench_Run(const String *pBodies, bool Parse) {
+
+  sBenchResult result = {};
+  sSim800RecievedMassgeDone args;
+  volatile int sink = 0;
+
+  size_t allocs = fHost_HeapAllocs();
+  double start = fHost_WallUs();
+
+  for(unsigned long r = 0; r < BENCH_ROUNDS; r++) {
+    for(size_t i = 0; i < CORPUS_COUNT; i++) {
+
+      if(Parse) {
+        sink += fCommand_Parse(pBodies[i].c_str(), &args);
+      } else {
+        sink += fMatch_IndexOf(pBodies[i]);
+      }
+    }
+  }
+
+  double us = fHost_WallUs() - start;
+  result.MessagesPerSec = (BENCH_ROUNDS * CORPUS_COUNT) / (us / 1e6);
+  result.AllocsPerMessage = (double)(fHost_HeapAllocs() - allocs) / (BENCH_ROUNDS * CORPUS_COUNT);
+  (void)sink;
+
+  return result;
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  String bodies[CORPUS_COUNT];
+  sSim800RecievedMassgeDone args;
+  int oldWrong = 0;
+
+  fHost_Begin("bench_match", NULL);
+
+  for(size_t i = 0; i < CORPUS_COUNT; i++) {
+
+    const sMatchCase *pCase = &Corpus[i];
+    bodies[i] = pCase->pText;
+
+    HOST_CHECK(fCommand_Parse(pCase->pText, &args) == (pCase->Command != eNO_COMMAND));
+    HOST_CHECK(args.CommandType == pCase->Command);
+    HOST_CHECK(args.Switch == pCase->Switch);
+    HOST_CHECK(args.HasValue == pCase->HasValue && args.Value == pCase->Value);
+
+    oldWrong += (fMatch_IndexOf(bodies[i]) != pCase->Command);
+  }
+
+  // best of a few alternating runs, so one slow time slice does not decide it
+  sBenchResult before = fBench_Run(bodies, false);
+  sBenchResult after = fBench_Run(bodies, true);
+  for(int i = 1; i < BENCH_REPEATS; i++) {
+    sBenchResult run = fBench_Run(bodies, false);
+    if(run.MessagesPerSec > before.MessagesPerSec) before = run;
+    run = fBench_Run(bodies, true);
+    if(run.MessagesPerSec > after.MessagesPerSec) after = run;
+  }
+
+  printf("match: %zu bodies, indexOf %.0f messages/s %.1f allocations/message %d wrong, "
+         "fCommand_Parse %.0f messages/s %.1f allocations/message, %.1fx\n",
+         CORPUS_COUNT, before.MessagesPerSec, before.AllocsPerMessage, oldWrong,
+         after.MessagesPerSec, after.AllocsPerMessage, after.MessagesPerSec / before.MessagesPerSec);
+
+  // "ship" and "lampshade" hold keywords inside them, and the Persian ones were not known
+  HOST_CHECK(oldWrong >= 5);
+  HOST_CHECK(after.AllocsPerMessage == 0);
+  HOST_CHECK(before.AllocsPerMessage > 0);
+  HOST_CHECK(after.MessagesPerSec > before.MessagesPerSec);
+
+  return fHost_End("bench_match");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,129 @@
+/**
+ ******************************************************************************
+ * @file           : bench_priority.cpp
+ * @brief          : Alarm latency behind a backlog of 100 normal messages
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * The normal messages are queued as fast as the queue takes them, so the
+ * backlog is always as deep as it can be. Every BENCH_ALARM_EVERY normal sends
+ * an alarm is raised; the latency runs from the first fSim800_SMSSendEx try to
+ * its ticket reporting it sent. Raised as eSMS_PRIORITY_NORMAL it stands for
+ * the single FIFO the driver used to have. Host time, modem as in bench_config.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_BACKLOG                           100
+#define BENCH_ALARM_EVERY                       10
+#define BENCH_LATENCY_MS                        60
+#define BENCH_SUBMIT_MS                         1500
+
+/* Private types -------------------------------------------------------------*/
+typedef struct {
+
+  double MeanMs;
+
+  uint32_t MaxMs;
+
+  int Alarms;
+
+}sBenchResult;
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief Sends BENCH_BACKLOG normal messages with alarms raised among them
+ *
+ * @param Priority class the alarms are raised in
+ * @return sBenchResult
+ */
+static sBenchResult fBench_Run(eSim800SmsPriority Priority) {
+
+  sBenchResult result = {};
+  uint64_t total = 0;
+  int queued = 0;
+  size_t bodies = Modem.Bodies.size();
+  uint32_t start = fHost_Millis();
+  bool raised = false;
+  bool pending = false;
+  uint16_t ticket = 0;
+  uint32_t since = 0;
+
+  while(queued < BENCH_BACKLOG || Sim800.QueueCount > 0 || Sim800.SmsTx.State != eSMS_TX_IDLE || pending || raised) {
+
+    size_t sent = Modem.Bodies.size() - bodies;
+    if(!pending && !raised && queued < BENCH_BACKLOG && sent >= (size_t)(result.Alarms + 1) * BENCH_ALARM_EVERY) {
+      pending = true;
+      since = fHost_Millis();
+    }
+    if(pending && fSim800_SMSSendEx("09121234567", "Warning! The density of smoke is high: 41%", Priority,
+                                    &ticket) == SIM800_RES_OK) {
+      pending = false;
+      raised = true;
+    }
+    if(raised) {
+      bool done = false;
+      fSim800_SMSStatus(ticket, &done);
+      if(done) {
+        uint32_t ms = fHost_Millis() - since;
+        HOST_CHECK(fSim800_SMSStatus(ticket, NULL) == eSMS_STATUS_SENT);
+        total += ms;
+        if(ms > result.MaxMs) result.MaxMs = ms;
+        result.Alarms++;
+        raised = false;
+      }
+    }
+
+    // after the alarm, which gets a slot freed in the last millisecond before the backlog does
+    while(queued < BENCH_BACKLOG && fSim800_SMSSend("09121234567", "Lamp turned on") == SIM800_RES_OK) {
+      queued++;
+    }
+
+    if(fHost_Millis() - start > 3600000) break;  // an hour of host time is a hang
+    fHost_Run(1);
+  }
+
+  HOST_CHECK(Modem.Bodies.size() - bodies == (size_t)(BENCH_BACKLOG + result.Alarms));
+  result.MeanMs = result.Alarms ? (double)total / result.Alarms : 0;
+  return result;
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("bench_priority", &Modem);
+  Sim800.EnableDeliveryReport = false;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(fSim800_AddPhoneNumber("09121234567", true) == SIM800_RES_OK);
+  Modem.LatencyMs = BENCH_LATENCY_MS;
+  Modem.SubmitMs = BENCH_SUBMIT_MS;
+
+  sBenchResult fifo = fBench_Run(eSMS_PRIORITY_NORMAL);
+  sBenchResult alarm = fBench_Run(eSMS_PRIORITY_ALARM);
+
+  printf("priority: %d alarms behind %d normal messages, as normal %.0f ms mean %u ms max, as alarm %.0f ms mean %u ms max\n",
+         alarm.Alarms, BENCH_BACKLOG, fifo.MeanMs, fifo.MaxMs, alarm.MeanMs, alarm.MaxMs);
+
+  HOST_CHECK(fifo.Alarms == alarm.Alarms && alarm.Alarms >= BENCH_BACKLOG / BENCH_ALARM_EVERY - 2);
+  HOST_CHECK(alarm.MaxMs < 2 * (BENCH_SUBMIT_MS + 4 * BENCH_LATENCY_MS));  // the send in progress, then the alarm
+  HOST_CHECK(alarm.MeanMs * 4 < fifo.MeanMs);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+
+  return fHost_End("bench_priority");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
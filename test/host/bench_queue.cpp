@@ -0,0 +1,96 @@
+/**
+ ******************************************************************************
+ * @file           : bench_queue.cpp
+ * @brief          : Soak of the SMS slot pool: millions of enqueue and dequeue
+ *                   cycles, heap use before, during and after
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_CYCLES                            4000000UL
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+static const char *Texts[] = {
+  "Alarm activated",
+  "Warning! The density of smoke is high: 41%",
+  "\xd8\xb3\xdb\x8c\xd8\xb3\xd8\xaa\xd9\x85 \xd8\xb1\xd9\x88\xd8\xb4\xd9\x86",   // "سیستم روشن"
+};
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  char number[SIM800_PHONE_MAX_DIGITS + 1];
+  unsigned long enqueued = 0, dequeued = 0, full = 0;
+  uint32_t seed = 1;
+
+  fHost_Begin("bench_queue", &Modem);
+  Sim800.PersistQueue = false;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+
+  size_t inUse = fHost_HeapInUse();
+  size_t allocs = fHost_HeapAllocs();
+  fHost_HeapResetPeak();
+  double start = fHost_WallUs();
+
+  // random bursts of enqueues and dequeues over every priority class, the
+  // queue swinging between empty and full
+  for(unsigned long i = 0; i < BENCH_CYCLES; i++) {
+
+    seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+
+    if(seed & 1) {
+      const char *pText = Texts[(seed >> 1) % 3];
+      eSim800SmsPriority priority = (eSim800SmsPriority)((seed >> 3) % eSMS_PRIORITY_COUNT);
+      if(fEnqueueMsg("09121234567", pText, strlen(pText), priority, NULL) == SIM800_RES_OK) enqueued++;
+      else full++;
+    } else {
+      uint8_t slot;
+      eSim800SmsPriority priority;
+      uint16_t recipient;
+      if(fDequeueMsg(&slot, number, sizeof(number), &priority, &recipient) == SIM800_RES_OK) {
+        fReleaseMsg(slot);
+        dequeued++;
+      }
+    }
+  }
+
+  double us = fHost_WallUs() - start;
+  size_t peak = fHost_HeapPeak();
+  allocs = fHost_HeapAllocs() - allocs;
+
+  printf("queue: %lu cycles, %lu enqueued, %lu dequeued, %lu refused full in %.1f ms: %.1f ns/cycle, "
+         "heap %zu bytes before, %zu peak, %zu after, %zu allocations\n",
+         BENCH_CYCLES, enqueued, dequeued, full, us / 1000, us * 1000 / BENCH_CYCLES,
+         inUse, peak, fHost_HeapInUse(), allocs);
+
+  HOST_CHECK(allocs == 0);
+  HOST_CHECK(peak == inUse);
+  HOST_CHECK(fHost_HeapInUse() == inUse);
+  HOST_CHECK(enqueued - dequeued == Sim800.QueueCount);
+  HOST_CHECK(full > 0 && dequeued > BENCH_CYCLES / 4);
+
+  // drained, every slot is back in the pool
+  uint8_t slot;
+  eSim800SmsPriority priority;
+  uint16_t recipient;
+  while(fDequeueMsg(&slot, number, sizeof(number), &priority, &recipient) == SIM800_RES_OK) fReleaseMsg(slot);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE && Sim800.QueueCount == 0);
+
+  return fHost_End("bench_queue");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,112 @@
+/**
+ ******************************************************************************
+ * @file           : bench_queuelog.cpp
+ * @brief          : Enqueue latency with the queue log off, batching, and
+ *                   written through for alarms
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * Wall time of fSim800_SMSSendEx alone on the host file system, which is far
+ * faster than SPIFFS: the ratios say more than the numbers. Each message is
+ * taken off the queue right after, and fQueueLog_Process runs every
+ * BENCH_STEP_MS of host time, as fSim800_Run would.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+#include <algorithm>
+#include <vector>
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_MESSAGES                          20000
+#define BENCH_STEP_MS                           50
+
+/* Private types -------------------------------------------------------------*/
+typedef struct {
+
+  double MeanUs;
+
+  double P99Us;
+
+}sBenchResult;
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief Queues and takes off BENCH_MESSAGES messages one at a time
+ *
+ * @param Persist queue log on
+ * @param Priority
+ * @return sBenchResult
+ */
+static sBenchResult fBench_Run(bool Persist, eSim800SmsPriority Priority) {
+
+  std::vector<double> us;
+  char number[SIM800_PHONE_MAX_DIGITS + 1];
+  sBenchResult result = {};
+
+  Sim800.PersistQueue = Persist;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  us.reserve(BENCH_MESSAGES);
+
+  for(int i = 0; i < BENCH_MESSAGES; i++) {
+
+    double start = fHost_WallUs();
+    HOST_CHECK(fSim800_SMSSendEx("09121234567", "Warning! The density of smoke is high: 41%", Priority, NULL) ==
+               SIM800_RES_OK);
+    us.push_back(fHost_WallUs() - start);
+
+    uint8_t slot;
+    eSim800SmsPriority priority;
+    uint16_t recipient;
+    HOST_CHECK(fDequeueMsg(&slot, number, sizeof(number), &priority, &recipient) == SIM800_RES_OK);
+    fReleaseMsg(slot);
+
+    fHost_Advance(BENCH_STEP_MS);
+    fQueueLog_Process();
+  }
+
+  for(double u : us) result.MeanUs += u;
+  result.MeanUs /= us.size();
+  std::sort(us.begin(), us.end());
+  result.P99Us = us[us.size() * 99 / 100];
+
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+  HOST_CHECK(!Sim800.QueueLog.Damaged);
+  HOST_CHECK(!Persist || !SPIFFS.exists(SmsQueueLogPath));   // dropped once nothing is queued
+
+  return result;
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("bench_queuelog", &Modem);
+
+  sBenchResult off = fBench_Run(false, eSMS_PRIORITY_NORMAL);
+  sBenchResult batched = fBench_Run(true, eSMS_PRIORITY_NORMAL);
+  sBenchResult alarm = fBench_Run(true, eSMS_PRIORITY_ALARM);
+
+  printf("queuelog: enqueue mean/p99, log off %.2f/%.2f us, normal %.2f/%.2f us, alarm %.2f/%.2f us\n",
+         off.MeanUs, off.P99Us, batched.MeanUs, batched.P99Us, alarm.MeanUs, alarm.P99Us);
+
+  // a normal message only goes into the RAM batch, an alarm is written before it returns
+  HOST_CHECK(batched.P99Us < alarm.MeanUs);
+
+  return fHost_End("bench_queuelog");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
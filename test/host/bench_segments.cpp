@@ -0,0 +1,85 @@
+/**
+ ******************************************************************************
+ * @file           : bench_segments.cpp
+ * @brief          : Concatenated SMS segments per minute in PDU mode
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * Host time, so the rate is that of a modem answering commands in
+ * BENCH_LATENCY_MS and taking BENCH_SUBMIT_MS to hand a segment to the network.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_MESSAGES                          60
+#define BENCH_LATENCY_MS                        60
+#define BENCH_SUBMIT_MS                         1500
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  // Both past the 160 bytes of a single SMS: 410 GSM-7 septets in 3 segments, 120 UCS2 characters in 2
+  std::string latin;
+  while(latin.size() < 390) latin += "FIRE zone 3, smoke 41%, temp 58C. ";
+  latin.resize(390);
+  latin += "[[[[[]]]]]";
+  std::string persian;
+  for(int i = 0; i < 30; i++) persian += "\xd8\xaf\xd9\x85\xd8\xa7 ";   // "دما "
+  persian.resize(persian.size() - 1);
+  persian += "!";
+
+  fHost_Begin("bench_segments", &Modem);
+  Sim800.EnableDeliveryReport = false;
+  Sim800.UsePduMode = true;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(fSim800_AddPhoneNumber("09121234567", true) == SIM800_RES_OK);
+  Modem.LatencyMs = BENCH_LATENCY_MS;
+  Modem.SubmitMs = BENCH_SUBMIT_MS;
+
+  size_t bodies = Modem.Bodies.size();
+  size_t from = Modem.Commands.size();
+  uint32_t start = fHost_Millis();
+  int queued = 0;
+  double wall = fHost_WallUs();
+
+  while(queued < BENCH_MESSAGES || Sim800.QueueCount > 0 || Sim800.SmsTx.State != eSMS_TX_IDLE) {
+    sim800_res_t res = SIM800_RES_ENQUEUE_FAIL;
+    if(queued < BENCH_MESSAGES) {
+      res = fSim800_SMSSend("09121234567", (queued & 1) ? persian.c_str() : latin.c_str());
+      HOST_CHECK(res == SIM800_RES_OK || res == SIM800_RES_ENQUEUE_FAIL);
+      if(res == SIM800_RES_OK) queued++;
+    }
+    if(fHost_Millis() - start > 3600000) break;  // an hour of host time is a hang
+    fHost_Run(1);
+  }
+
+  wall = fHost_WallUs() - wall;
+  uint32_t ms = fHost_Millis() - start;
+  size_t segments = Modem.Bodies.size() - bodies;
+  size_t setup = Modem.Commands.size() - from - Modem.Count("AT+CMGS=", from);
+
+  printf("segments: %zu segments of %d messages in %.1f s: %.1f segments/min, %zu other AT lines, %.1f ms host time\n",
+         segments, BENCH_MESSAGES, ms / 1000.0, segments * 60000.0 / ms, setup, wall / 1000);
+
+  HOST_CHECK(segments == (size_t)BENCH_MESSAGES / 2 * 3 + BENCH_MESSAGES / 2 * 2);
+  HOST_CHECK(setup <= 1);                       // the switch to PDU mode, then nothing between segments
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+
+  return fHost_End("bench_segments");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
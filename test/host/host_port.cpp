@@ -0,0 +1,150 @@
+/**
+ ******************************************************************************
+ * @file           : host_port.cpp
+ * @brief          : Host side of Sim800_port_host.h, plus the heap counters
+ *                   the tests read
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include <new>
+#include <filesystem>
+
+#include "host_test.h"
+
+/* Private define ------------------------------------------------------------*/
+#define HOST_HEAP_HEADER                        16    /* keeps the block aligned for any type */
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t Now = 1000;
+static size_t HeapInUse;
+static size_t HeapPeak;
+static size_t HeapAllocs;
+
+/* Exported variables --------------------------------------------------------*/
+HardwareSerial Serial;
+FSClass SPIFFS;
+int HostFailures;
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                          ##### Exported Functions #####                         ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+uint32_t fHost_Millis(void) {
+
+  return Now;
+}
+
+void fHost_Advance(uint32_t Ms) {
+
+  Now += Ms;
+}
+
+sHostQueue *fHostQueue_Create(uint16_t Len, uint8_t *pBuffer, sHostQueue *pQueue) {
+
+  pQueue->pBuffer = pBuffer;
+  pQueue->Len = Len;
+  pQueue->Head = 0;
+  pQueue->Count = 0;
+  return pQueue;
+}
+
+bool fHostQueue_Send(sHostQueue *pQueue, const uint8_t *pItem) {
+
+  if(pQueue->Count == pQueue->Len) return false;
+
+  pQueue->pBuffer[(pQueue->Head + pQueue->Count) % pQueue->Len] = *pItem;
+  pQueue->Count++;
+  return true;
+}
+
+bool fHostQueue_Receive(sHostQueue *pQueue, uint8_t *pItem, uint32_t WaitMs) {
+
+  (void)WaitMs;   // single task, nothing can arrive while waiting
+  if(pQueue->Count == 0) return false;
+
+  *pItem = pQueue->pBuffer[pQueue->Head];
+  pQueue->Head = (pQueue->Head + 1) % pQueue->Len;
+  pQueue->Count--;
+  return true;
+}
+
+/**
+ * @brief Starts a test program: empty flash under the temp directory, the
+ *        modem behind Sim800.ComPort, clock and heap peak reset
+ *
+ * @param pName names the flash directory
+ * @param pModem
+ */
+void fHost_Begin(const char *pName, SimModem *pModem) {
+
+  std::filesystem::path root = std::filesystem::temp_directory_path() / (std::string("sim800_") + pName);
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root);
+  SPIFFS.Root = root.string();
+  SPIFFS.WriteBudget = -1;
+  SPIFFS.CrashAfter = -1;
+
+  Serial.Echo = (getenv("SIM800_HOST_VERBOSE") != nullptr);
+  Sim800.ComPort = pModem;
+  HostFailures = 0;
+  fHost_HeapResetPeak();
+}
+
+/**
+ * @brief Prints the verdict
+ *
+ * @param pName
+ * @return int exit code
+ */
+int fHost_End(const char *pName) {
+
+  fprintf(stderr, "%s: %s (%d failures)\n", pName, HostFailures ? "FAILED" : "OK", HostFailures);
+  return HostFailures ? 1 : 0;
+}
+
+size_t fHost_HeapInUse(void) { return HeapInUse; }
+size_t fHost_HeapPeak(void) { return HeapPeak; }
+size_t fHost_HeapAllocs(void) { return HeapAllocs; }
+void fHost_HeapResetPeak(void) { HeapPeak = HeapInUse; }
+
+/*
+╔═════════════════════════════════════════════════════════════════════════════════╗
+║                           ##### Heap accounting #####                           ║
+╚═════════════════════════════════════════════════════════════════════════════════╝*/
+void *operator new(size_t Size) {
+
+  uint8_t *p = (uint8_t *)malloc(Size + HOST_HEAP_HEADER);
+  if(p == nullptr) throw std::bad_alloc();
+
+  *(size_t *)p = Size;
+  HeapInUse += Size;
+  HeapAllocs++;
+  if(HeapInUse > HeapPeak) HeapPeak = HeapInUse;
+  return p + HOST_HEAP_HEADER;
+}
+
+void operator delete(void *pBlock) noexcept {
+
+  if(pBlock == nullptr) return;
+
+  uint8_t *p = (uint8_t *)pBlock - HOST_HEAP_HEADER;
+  HeapInUse -= *(size_t *)p;
+  free(p);
+}
+
+void *operator new[](size_t Size) { return operator new(Size); }
+void operator delete[](void *pBlock) noexcept { operator delete(pBlock); }
+void operator delete(void *pBlock, size_t Size) noexcept { (void)Size; operator delete(pBlock); }
+void operator delete[](void *pBlock, size_t Size) noexcept { (void)Size; operator delete(pBlock); }
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * @file           : host_test.h
+ * @brief          : Helpers shared by the host tests and benchmarks
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef SIM800_HOST_TEST_H
+#define SIM800_HOST_TEST_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <chrono>
+
+#include "Sim800_cdrv.h"
+#include "SimModem.h"
+
+/* Exported defines ----------------------------------------------------------*/
+/**
+ * @brief Counts a failure and carries on, so one run reports all of them
+ *
+ */
+#define HOST_CHECK(x)                                                              \
+  do {                                                                             \
+    if(!(x)) {                                                                     \
+      fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #x);                 \
+      HostFailures++;                                                              \
+    }                                                                              \
+  } while(0)
+
+/* Exported functions prototypes ---------------------------------------------*/
+void fHost_Begin(const char *pName, SimModem *pModem);
+int fHost_End(const char *pName);
+size_t fHost_HeapInUse(void);
+size_t fHost_HeapPeak(void);
+size_t fHost_HeapAllocs(void);
+void fHost_HeapResetPeak(void);
+
+/* Exported variables --------------------------------------------------------*/
+extern int HostFailures;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+ * @brief Runs the driver loop for Ms of host time, one fSim800_Run per millisecond
+ *
+ * @param Ms
+ */
+static inline void fHost_Run(uint32_t Ms) {
+
+  for(uint32_t i = 0; i < Ms; i++) {
+    fSim800_Run();
+    fHost_Advance(1);
+  }
+}
+
+/**
+ * @brief Wall clock for the benchmarks, in microseconds
+ *
+ * @return double
+ */
+static inline double fHost_WallUs(void) {
+
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif /* SIM800_HOST_TEST_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
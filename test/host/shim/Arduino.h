@@ -0,0 +1,165 @@
+/**
+ ******************************************************************************
+ * @file           : Arduino.h
+ * @brief          : Host stand-in for the parts of the Arduino core the sim800
+ *                   driver uses: String, Print, Stream and Serial
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+#include <string>
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief Arduino String over std::string, only the members the driver calls
+ *
+ */
+class String {
+public:
+  std::string s;
+
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &c) : s(c) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+
+  String &operator=(const char *c) { s = c ? c : ""; return *this; }   // into the buffer it has, as Arduino's does
+
+  unsigned length() const { return s.size(); }
+  const char *c_str() const { return s.c_str(); }
+  bool startsWith(const String &p) const { return s.rfind(p.s, 0) == 0; }
+  int indexOf(const String &p, unsigned from = 0) const { size_t r = s.find(p.s, from); return r == std::string::npos ? -1 : (int)r; }
+  int indexOf(char c, unsigned from = 0) const { size_t r = s.find(c, from); return r == std::string::npos ? -1 : (int)r; }
+  int lastIndexOf(char c) const { size_t r = s.rfind(c); return r == std::string::npos ? -1 : (int)r; }
+  int lastIndexOf(char c, int from) const { size_t r = from < 0 ? std::string::npos : s.rfind(c, from); return r == std::string::npos ? -1 : (int)r; }
+  String substring(unsigned a) const { return a >= s.size() ? String() : String(s.substr(a)); }
+  String substring(unsigned a, unsigned b) const {
+    if(a > b) { unsigned t = a; a = b; b = t; }
+    return a >= s.size() ? String() : String(s.substr(a, b - a));
+  }
+  void trim() {
+    while(!s.empty() && isspace((unsigned char)s.back())) s.pop_back();
+    size_t i = 0;
+    while(i < s.size() && isspace((unsigned char)s[i])) i++;
+    s.erase(0, i);
+  }
+  void toLowerCase() { for(char &c : s) c = (char)tolower((unsigned char)c); }
+  long toInt() const { return atol(s.c_str()); }
+  void replace(const String &a, const String &b) {
+    size_t p = 0;
+    while(!a.s.empty() && (p = s.find(a.s, p)) != std::string::npos) { s.replace(p, a.s.size(), b.s); p += b.s.size(); }
+  }
+  bool reserve(unsigned n) { s.reserve(n); return true; }
+  char operator[](unsigned i) const { return i < s.size() ? s[i] : 0; }
+  String &operator+=(const String &o) { s += o.s; return *this; }
+  String &operator+=(const char *o) { s += o; return *this; }
+  String &operator+=(char o) { s += o; return *this; }
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator==(const char *o) const { return s == o; }
+  bool operator!=(const String &o) const { return s != o.s; }
+};
+
+inline String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+inline String operator+(const char *a, const String &b) { return String(std::string(a) + b.s); }
+inline String operator+(const String &a, const char *b) { return String(a.s + b); }
+inline String operator+(const String &a, char b) { return String(a.s + b); }
+
+/**
+ * @brief Arduino Print, everything funnels into write(uint8_t)
+ *
+ */
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *b, size_t n) { for(size_t i = 0; i < n; i++) write(b[i]); return n; }
+  size_t write(const char *b, size_t n) { return write((const uint8_t *)b, n); }
+  size_t write(char c) { return write((uint8_t)c); }
+  size_t print(const String &x) { return write((const uint8_t *)x.c_str(), x.length()); }
+  size_t print(const char *x) { return write((const uint8_t *)x, strlen(x)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return print(String(v)); }
+  size_t print(unsigned v) { return print(String(v)); }
+  size_t print(long v) { return print(String(v)); }
+  size_t print(unsigned long v) { return print(String(v)); }
+  size_t println() { return print("\r\n"); }
+  template <class T> size_t println(const T &x) { size_t n = print(x); return n + println(); }
+  size_t printf(const char *f, ...) __attribute__((format(printf, 2, 3))) {
+    char b[512];
+    va_list a;
+    va_start(a, f);
+    int n = vsnprintf(b, sizeof(b), f, a);
+    va_end(a);
+    if(n < 0) return 0;
+    return write((const uint8_t *)b, (size_t)n < sizeof(b) ? (size_t)n : sizeof(b) - 1);
+  }
+};
+
+/**
+ * @brief Arduino Stream without the read timeout: the reads return what has
+ *        arrived so far, which is how the driver's framer uses them
+ *
+ */
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t readBytes(char *b, size_t n) {
+    size_t i = 0;
+    while(i < n && available() > 0) b[i++] = (char)read();
+    return i;
+  }
+  String readString() { String r; while(available() > 0) r += (char)read(); return r; }
+  String readStringUntil(char t) {
+    String r;
+    while(available() > 0) { int c = read(); if(c == t) break; r += (char)c; }
+    return r;
+  }
+};
+
+/**
+ * @brief Serial monitor, printed to stderr when SIM800_HOST_VERBOSE is set
+ *        in the environment, dropped otherwise
+ *
+ */
+class HardwareSerial : public Stream {
+public:
+  bool Echo = false;
+  using Print::write;
+  size_t write(uint8_t c) override { if(Echo) fputc(c, stderr); return 1; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+
+/* Exported variables --------------------------------------------------------*/
+extern HardwareSerial Serial;
+
+#endif /* HOST_ARDUINO_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
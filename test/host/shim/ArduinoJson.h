@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * @file           : ArduinoJson.h
+ * @brief          : Host stand-in for ArduinoJson, a flat object of integer
+ *                   members, which is all the phonebook API exchanges
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef HOST_ARDUINOJSON_H
+#define HOST_ARDUINOJSON_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <vector>
+
+#include "Arduino.h"
+
+/* Exported types ------------------------------------------------------------*/
+class JsonDocument;
+
+struct JsonString {
+  std::string k;
+  const char *c_str() const { return k.c_str(); }
+};
+
+struct JsonVariantConst {
+  int v;
+  template <class T> T as() const { return (T)v; }
+};
+
+struct JsonPair {
+  std::string k;
+  int v;
+  JsonString key() const { return JsonString{k}; }
+  JsonVariantConst value() const { return JsonVariantConst{v}; }
+};
+
+class JsonObject {
+public:
+  std::vector<JsonPair> *p;
+  std::vector<JsonPair>::iterator begin() { return p->begin(); }
+  std::vector<JsonPair>::iterator end() { return p->end(); }
+};
+
+struct JsonVariant {
+  JsonDocument *d;
+  std::string k;
+  operator int() const;
+  JsonVariant &operator=(int v);
+};
+
+class JsonDocument {
+public:
+  std::vector<JsonPair> items;
+
+  size_t size() const { return items.size(); }
+  void clear() { items.clear(); }
+  JsonVariant operator[](const char *k) { return JsonVariant{this, k}; }
+  JsonVariant operator[](const String &k) { return JsonVariant{this, k.s}; }
+  template <class T> T as() { JsonObject o; o.p = &items; return o; }
+  /* Value of a member, -1 when it is missing */
+  int get(const char *k) const { for(const JsonPair &i : items) if(i.k == k) return i.v; return -1; }
+};
+
+inline JsonVariant::operator int() const { int v = d->get(k.c_str()); return v < 0 ? 0 : v; }
+inline JsonVariant &JsonVariant::operator=(int v) {
+  for(JsonPair &i : d->items) if(i.k == k) { i.v = v; return *this; }
+  d->items.push_back(JsonPair{k, v});
+  return *this;
+}
+
+#endif /* HOST_ARDUINOJSON_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,117 @@
+/**
+ ******************************************************************************
+ * @file           : FS.h
+ * @brief          : Host stand-in for the Arduino FS API, files live in a
+ *                   directory of the host file system
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "Arduino.h"
+
+/* Exported defines ----------------------------------------------------------*/
+#define FILE_READ                               "r"
+#define FILE_WRITE                              "w"
+#define FILE_APPEND                             "a"
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief Thrown where FSClass::CrashAfter runs out, the power went off there
+ *
+ */
+struct HostCrash {};
+
+/**
+ * @brief Counts a flash operation, throws HostCrash in place of the one
+ *        *pCountdown reaches zero at
+ *
+ */
+static inline bool fHostFs_Crashes(long *pCountdown) {
+
+  if(pCountdown == nullptr || *pCountdown < 0) return false;
+  return (*pCountdown)-- == 0;
+}
+
+class File : public Stream {
+public:
+  FILE *f = nullptr;
+  long *pBudget = nullptr;
+  long *pCrash = nullptr;
+
+  File() {}
+  File(FILE *x, long *pWriteBudget, long *pCrashAfter = nullptr) : f(x), pBudget(pWriteBudget), pCrash(pCrashAfter) {}
+  operator bool() const { return f != nullptr; }
+
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *b, size_t n) override {
+    if(fHostFs_Crashes(pCrash)) {
+      // part of it made it to flash
+      fwrite(b, 1, n / 2, f);
+      close();
+      throw HostCrash();
+    }
+    if(pBudget != nullptr && *pBudget >= 0) {
+      if((long)n > *pBudget) n = (size_t)*pBudget;
+      *pBudget -= (long)n;
+    }
+    return fwrite(b, 1, n, f);
+  }
+  int available() override { return (int)(size() - position()); }
+  int read() override { return fgetc(f); }
+  int peek() override { int c = fgetc(f); if(c != EOF) ungetc(c, f); return c; }
+  size_t read(uint8_t *b, size_t n) { return fread(b, 1, n, f); }
+  size_t size() { long p = ftell(f); fseek(f, 0, SEEK_END); long e = ftell(f); fseek(f, p, SEEK_SET); return (size_t)e; }
+  size_t position() { return (size_t)ftell(f); }
+  bool seek(uint32_t p) { return fseek(f, p, SEEK_SET) == 0; }
+  void flush() { fflush(f); }
+  void close() { if(f) fclose(f); f = nullptr; }
+};
+
+/**
+ * @brief File system rooted at Root. With WriteBudget at zero or more only
+ *        that many bytes are written, the rest fails like on a full flash.
+ *        With CrashAfter at zero or more that many writes, removes and renames
+ *        go through and the next one throws HostCrash, a write half done.
+ *
+ */
+class FSClass {
+public:
+  std::string Root = ".";
+  long WriteBudget = -1;
+  long CrashAfter = -1;
+
+  bool begin(bool FormatOnFail = false) { (void)FormatOnFail; return true; }
+  File open(const char *pPath, const char *pMode) {
+    const char *mode = (pMode[0] == 'r') ? "rb" : (pMode[0] == 'a') ? "ab" : "wb";
+    return File(fopen((Root + pPath).c_str(), mode), &WriteBudget, &CrashAfter);
+  }
+  File open(const String &Path, const char *pMode) { return open(Path.c_str(), pMode); }
+  bool exists(const char *pPath) { FILE *f = fopen((Root + pPath).c_str(), "rb"); if(f) fclose(f); return f != nullptr; }
+  bool remove(const char *pPath) {
+    if(fHostFs_Crashes(&CrashAfter)) throw HostCrash();
+    return ::remove((Root + pPath).c_str()) == 0;
+  }
+  bool rename(const char *pFrom, const char *pTo) {
+    if(fHostFs_Crashes(&CrashAfter)) throw HostCrash();
+    return ::rename((Root + pFrom).c_str(), (Root + pTo).c_str()) == 0;
+  }
+  std::string path(const char *pPath) const { return Root + pPath; }
+};
+
+#endif /* HOST_FS_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,29 @@
+/**
+ ******************************************************************************
+ * @file           : SPIFFS.h
+ * @brief          : Host stand-in for the ESP32 SPIFFS instance
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef HOST_SPIFFS_H
+#define HOST_SPIFFS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include "FS.h"
+
+/* Exported variables --------------------------------------------------------*/
+extern FSClass SPIFFS;
+
+#endif /* HOST_SPIFFS_H */
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,307 @@
+/**
+ ******************************************************************************
+ * @file           : test_codec.cpp
+ * @brief          : SMS text codec: GSM-7 packing, UCS2 hex, encoding choice,
+ *                   hex bodies back to UTF-8, SMS-SUBMIT PDUs and status
+ *                   reports
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_codec.h"
+
+/* Private functions ---------------------------------------------------------*/
+static std::string fHex(const uint8_t *pData, uint16_t Len) {
+
+  std::string hex(2 * Len, '\0');
+  fCodec_HexEncode(pData, Len, &hex[0]);
+  return hex;
+}
+
+static void fTest_Gsm7Pack(void) {
+
+  uint8_t out[SIM800_PDU_USER_DATA_MAX_LEN];
+
+  HOST_CHECK(fCodec_Gsm7Pack("hello", 5, out, sizeof(out), 0) == 5);
+  HOST_CHECK(fHex(out, 5) == "E8329BFD06");
+
+  // eight septets fill seven octets exactly
+  HOST_CHECK(fCodec_Gsm7Pack("12345678", 8, out, sizeof(out), 0) == 7);
+  HOST_CHECK(fHex(out, 7) == "31D98C56B3DD70");
+
+  // after a concatenation header the text starts one fill bit in
+  HOST_CHECK(fCodec_Gsm7Pack("hello", 5, out, sizeof(out), 1) == 5);
+  HOST_CHECK(fHex(out, 5) == "D06536FB0D");
+
+  // the euro sign is an escape and a code from the extension table
+  HOST_CHECK(fCodec_Gsm7Length("\xe2\x82\xac" "10", 5) == 4);
+  HOST_CHECK(fCodec_Gsm7Pack("\xe2\x82\xac" "10", 5, out, sizeof(out), 0) == 4);
+  HOST_CHECK(fHex(out, 4) == "9B720C06");
+
+  HOST_CHECK(fCodec_Gsm7Length("\xd8\xaf", 2) == SIM800_GSM7_NONE);
+  HOST_CHECK(fCodec_Gsm7Pack("\xd8\xaf", 2, out, sizeof(out), 0) == 0);
+  HOST_CHECK(fCodec_Gsm7Pack("hello", 5, out, 4, 0) == 0);
+}
+
+static void fTest_Ucs2(void) {
+
+  const char persian[] = "\xd8\xaf\xd9\x85\xd8\xa7";    // "دما"
+  const char emoji[] = "\xf0\x9f\x98\x80" "A";
+  char hex[32];
+  uint8_t out[8];
+  const char *p;
+
+  p = persian;
+  HOST_CHECK(fCodec_Ucs2Hex(&p, persian + 6, hex, sizeof(hex)) == 12);
+  HOST_CHECK(strcmp(hex, "062F06450627") == 0 && p == persian + 6);
+
+  // a buffer too small for the whole text takes what fits and leaves the rest
+  p = persian;
+  HOST_CHECK(fCodec_Ucs2Hex(&p, persian + 6, hex, 9) == 8);
+  HOST_CHECK(strcmp(hex, "062F0645") == 0 && p == persian + 4);
+  HOST_CHECK(fCodec_Ucs2Hex(&p, persian + 6, hex, 9) == 4);
+  HOST_CHECK(strcmp(hex, "0627") == 0 && p == persian + 6);
+
+  // outside the BMP: a surrogate pair, never split
+  p = emoji;
+  HOST_CHECK(fCodec_Ucs2Hex(&p, emoji + 5, hex, 8) == 0);
+  HOST_CHECK(strcmp(hex, "") == 0 && p == emoji);
+  HOST_CHECK(fCodec_Ucs2Hex(&p, emoji + 5, hex, sizeof(hex)) == 12);
+  HOST_CHECK(strcmp(hex, "D83DDE000041") == 0);
+
+  HOST_CHECK(fCodec_Ucs2Length(emoji, 5) == 3);
+  HOST_CHECK(fCodec_Ucs2Encode(persian, 6, out, sizeof(out)) == 6);
+  HOST_CHECK(fHex(out, 6) == "062F06450627");
+  HOST_CHECK(fCodec_Ucs2Encode(persian, 6, out, 5) == 0);
+}
+
+static void fTest_Analyze(void) {
+
+  sSim800TextInfo info;
+  std::string text;
+
+  fCodec_Analyze("Fire sensor activated", 21, &info);
+  HOST_CHECK(info.Dcs == eSMS_DCS_GSM7 && info.Units == 21 && info.Segments == 1);
+
+  text.assign(160, 'a');
+  fCodec_Analyze(text.c_str(), text.size(), &info);
+  HOST_CHECK(info.Dcs == eSMS_DCS_GSM7 && info.Units == 160 && info.Segments == 1);
+  text += "a";
+  fCodec_Analyze(text.c_str(), text.size(), &info);
+  HOST_CHECK(info.Units == 161 && info.Segments == 2);
+
+  // one Persian letter turns the whole text to UCS2
+  text.assign(69, 'a');
+  text += "\xd8\xaf";
+  fCodec_Analyze(text.c_str(), text.size(), &info);
+  HOST_CHECK(info.Dcs == eSMS_DCS_UCS2 && info.Units == 70 && info.Segments == 1);
+  text += "\xd8\xaf";
+  fCodec_Analyze(text.c_str(), text.size(), &info);
+  HOST_CHECK(info.Units == 71 && info.Segments == 2);
+
+  // a part holds 67 characters, 134 fill two and 135 need a third
+  text.clear();
+  for(int i = 0; i < 134; i++) text += "\xd8\xaf";
+  HOST_CHECK(fCodec_Segments(text.c_str(), text.size(), eSMS_DCS_UCS2) == 2);
+  text += "\xd8\xaf";
+  HOST_CHECK(fCodec_Segments(text.c_str(), text.size(), eSMS_DCS_UCS2) == 3);
+}
+
+static void fTest_FitPrefix(void) {
+
+  const char euros[] = "\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac";
+  const char emoji[] = "A\xf0\x9f\x98\x80";
+
+  // an escape sequence is two septets and is never split
+  HOST_CHECK(fCodec_FitPrefix(euros, 9, eSMS_DCS_GSM7, 3) == 3);
+  HOST_CHECK(fCodec_FitPrefix(euros, 9, eSMS_DCS_GSM7, 4) == 6);
+  HOST_CHECK(fCodec_FitPrefix(euros, 9, eSMS_DCS_UCS2, 3) == 9);
+
+  // nor is a surrogate pair
+  HOST_CHECK(fCodec_FitPrefix(emoji, 5, eSMS_DCS_UCS2, 2) == 1);
+  HOST_CHECK(fCodec_FitPrefix(emoji, 5, eSMS_DCS_UCS2, 3) == 5);
+}
+
+static void fTest_HexToUtf8(void) {
+
+  char out[32];
+  char ucs2[] = "062F06450627";
+  char gsm7[] = "68656C6C6F";
+
+  // a surrogate pair joins, a high half with no low half after it does not
+  HOST_CHECK(fCodec_Ucs2HexToUtf8("D83DDE00D83D0041", 16, out, sizeof(out)) == 8);
+  HOST_CHECK(strcmp(out, "\xf0\x9f\x98\x80" "\xef\xbf\xbd" "A") == 0);
+  HOST_CHECK(fCodec_Ucs2HexToUtf8("DC000041", 8, out, sizeof(out)) == 4);
+  HOST_CHECK(strcmp(out, "\xef\xbf\xbd" "A") == 0);
+
+  // what does not fit or is not hex ends the text, the output stays terminated
+  HOST_CHECK(fCodec_Ucs2HexToUtf8("0041D83DDE00", 12, out, 5) == 1 && strcmp(out, "A") == 0);
+  HOST_CHECK(fCodec_Ucs2HexToUtf8("0041ZZ410042", 12, out, sizeof(out)) == 1 && strcmp(out, "A") == 0);
+  HOST_CHECK(fCodec_Ucs2HexToUtf8("004", 3, out, sizeof(out)) == 0 && out[0] == '\0');
+
+  // in place, as the inbox decodes a body
+  HOST_CHECK(fCodec_Ucs2HexToUtf8(ucs2, 12, ucs2, sizeof(ucs2)) == 6);
+  HOST_CHECK(strcmp(ucs2, "\xd8\xaf\xd9\x85\xd8\xa7") == 0);
+
+  // escapes read from the extension table
+  HOST_CHECK(fCodec_Gsm7HexToUtf8("1B6531301B3C", 12, out, sizeof(out)) == 6);
+  HOST_CHECK(strcmp(out, "\xe2\x82\xac" "10[") == 0);
+  HOST_CHECK(fCodec_Gsm7HexToUtf8("0002", 4, out, sizeof(out)) == 2 && strcmp(out, "@$") == 0);
+  HOST_CHECK(fCodec_Gsm7HexToUtf8("311B", 4, out, sizeof(out)) == 1 && strcmp(out, "1") == 0);
+  HOST_CHECK(fCodec_Gsm7HexToUtf8("3180", 4, out, sizeof(out)) == 1 && strcmp(out, "1") == 0);
+  HOST_CHECK(fCodec_Gsm7HexToUtf8("1B6531", 6, out, 3) == 0 && out[0] == '\0');
+
+  HOST_CHECK(fCodec_Gsm7HexToUtf8(gsm7, 10, gsm7, sizeof(gsm7)) == 5 && strcmp(gsm7, "hello") == 0);
+}
+
+static void fTest_Gsm7Unpack(void) {
+
+  char out[32];
+
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("E8329BFD06DDDF723619", 20, 0, out, sizeof(out)) == 11);
+  HOST_CHECK(strcmp(out, "hello world") == 0);
+
+  // after a six octet concatenation header the first septet is one fill bit in
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("CC69791904", 10, 1, out, sizeof(out)) == 5 && strcmp(out, "fire ") == 0);
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("DE6633", 6, 1, out, sizeof(out)) == 3 && strcmp(out, "off") == 0);
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("D06536FB0D", 10, 1, out, sizeof(out)) == 5 && strcmp(out, "hello") == 0);
+
+  // seven zero bits at the end are padding, eight septets fill seven octets
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("31D98C56B3DD00", 14, 0, out, sizeof(out)) == 7);
+  HOST_CHECK(strcmp(out, "1234567") == 0);
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("31D98C56B3DD70", 14, 0, out, sizeof(out)) == 8);
+  HOST_CHECK(strcmp(out, "12345678") == 0);
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("0000", 4, 0, out, sizeof(out)) == 2 && strcmp(out, "@@") == 0);
+
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("9B720C06", 8, 0, out, sizeof(out)) == 5);
+  HOST_CHECK(strcmp(out, "\xe2\x82\xac" "10") == 0);
+
+  // cut where the output ends or the hex does
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("E8329BFD06", 10, 0, out, 4) == 3 && strcmp(out, "hel") == 0);
+  HOST_CHECK(fCodec_Gsm7PackedHexToUtf8("E832ZZFD06", 10, 0, out, sizeof(out)) == 2 && strcmp(out, "he") == 0);
+}
+
+static void fTest_PduSubmit(void) {
+
+  uint8_t pdu[SIM800_PDU_MAX_LEN];
+  sSim800PduSubmit submit = {};
+  std::string text(160, 'a');
+
+  submit.pNumber = "989121234567";
+  submit.pText = "hello";
+  submit.TextLen = 5;
+  submit.Dcs = eSMS_DCS_GSM7;
+
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) == 20);
+  HOST_CHECK(fHex(pdu, 20) == "001100" "0C91891912325476" "0000A705E8329BFD06");
+
+  // a report asked for, and the reference the report will carry
+  submit.StatusReport = true;
+  submit.MessageRef = 0x2A;
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) == 20);
+  HOST_CHECK(fHex(pdu, 3) == "00312A");
+
+  // a part: the header counts as seven septets, the text starts one fill bit in
+  submit.StatusReport = false;
+  submit.MessageRef = 0;
+  submit.ConcatRef = 7;
+  submit.PartCount = 2;
+  submit.PartNumber = 1;
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) == 26);
+  HOST_CHECK(fHex(pdu, 26) == "005100" "0C91891912325476" "0000A70C050003070201D06536FB0D");
+  submit.PartNumber = 3;
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) == 0);
+
+  submit.PartCount = 0;
+  submit.pText = "\xd8\xaf\xd9\x85\xd8\xa7";   // "دما"
+  submit.TextLen = 6;
+  submit.Dcs = eSMS_DCS_UCS2;
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) == 21);
+  HOST_CHECK(fHex(pdu, 21) == "001100" "0C91891912325476" "0008A706062F06450627");
+
+  // what does not make one message
+  submit.Dcs = eSMS_DCS_GSM7;
+  submit.pText = text.c_str();
+  submit.TextLen = 160;
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) > 0);
+  submit.TextLen = 161;
+  text += "a";
+  submit.pText = text.c_str();
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) == 0);
+  submit.pText = "hello";
+  submit.TextLen = 5;
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, 18) == 0);
+  submit.pNumber = "+989121234567";
+  HOST_CHECK(fPdu_BuildSubmit(&submit, pdu, sizeof(pdu)) == 0);
+}
+
+static void fTest_StatusReport(void) {
+
+  const std::string report = "0006070C91891912325476" "52902112235182" "52902112235182" "00";
+  const std::string withSmsc = "07918919010000F0" "06070C91891912325476" "52902112235182" "52902112235182" "45";
+  uint8_t ref = 0, status = 0xFF;
+
+  HOST_CHECK(fPdu_ParseStatusReport(report.c_str(), report.size(), &ref, &status));
+  HOST_CHECK(ref == 7 && status == 0x00);
+
+  // the SMSC address is skipped by its length
+  HOST_CHECK(fPdu_ParseStatusReport(withSmsc.c_str(), withSmsc.size(), &ref, &status));
+  HOST_CHECK(ref == 7 && status == 0x45);
+
+  // cut before TP-ST, not a report, not hex
+  HOST_CHECK(!fPdu_ParseStatusReport(report.c_str(), report.size() - 2, &ref, &status));
+  HOST_CHECK(!fPdu_ParseStatusReport(report.c_str(), 20, &ref, &status));
+  HOST_CHECK(!fPdu_ParseStatusReport("0004070C91891912325476", 22, &ref, &status));
+  HOST_CHECK(!fPdu_ParseStatusReport("00G6", 4, &ref, &status));
+  HOST_CHECK(!fPdu_ParseStatusReport("", 0, &ref, &status));
+}
+
+static void fTest_HexAndBcd(void) {
+
+  uint8_t bytes[4];
+  uint8_t bcd[6];
+  char digits[13];
+
+  HOST_CHECK(fCodec_HexDecode("0aFf", 4, bytes, sizeof(bytes)) == 2 && bytes[0] == 0x0A && bytes[1] == 0xFF);
+  HOST_CHECK(fCodec_HexDecode("0aF", 3, bytes, sizeof(bytes)) == 0);
+  HOST_CHECK(fCodec_HexDecode("0G", 2, bytes, sizeof(bytes)) == 0);
+  HOST_CHECK(fCodec_HexDecode("0102030405", 10, bytes, sizeof(bytes)) == 0);
+
+  HOST_CHECK(fCodec_BcdPack("09121234567", bcd, sizeof(bcd)) == 11);
+  HOST_CHECK(fHex(bcd, 6) == "09121234567F");
+  HOST_CHECK(fCodec_BcdUnpack(bcd, sizeof(bcd), digits, sizeof(digits)) == 11);
+  HOST_CHECK(strcmp(digits, "09121234567") == 0);
+  HOST_CHECK(fCodec_BcdUnpack(bcd, sizeof(bcd), digits, 5) == 4 && strcmp(digits, "0912") == 0);
+  HOST_CHECK(fCodec_BcdPack("0912x", bcd, sizeof(bcd)) == 0);
+  HOST_CHECK(fCodec_BcdPack("0912123456789", bcd, sizeof(bcd)) == 0);
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("test_codec", NULL);
+
+  fTest_Gsm7Pack();
+  fTest_Ucs2();
+  fTest_Analyze();
+  fTest_FitPrefix();
+  fTest_HexToUtf8();
+  fTest_Gsm7Unpack();
+  fTest_HexAndBcd();
+  fTest_PduSubmit();
+  fTest_StatusReport();
+
+  return fHost_End("test_codec");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,270 @@
+/**
+ ******************************************************************************
+ * @file           : test_engine.cpp
+ * @brief          : AT command engine: non-blocking submit, blocking calls
+ *                   from callbacks, batch completion, the data prompt, command
+ *                   handlers and the deferred command queue
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+static sim800_res_t CallResult;
+static uint32_t Credit;
+static int Done;
+static std::string Responses[2];
+static int PlainCalls[2];
+static int Deferred;
+
+/* Private functions ---------------------------------------------------------*/
+static void fOnLamp(sSim800RecievedMassgeDone *pArgs, void *pCtx) {
+
+  CallResult = fSim800_Call("09121234567");
+  Credit = fSim800_CheckCredit();
+}
+
+static void fOnPlainA(sSim800RecievedMassgeDone *pArgs) {
+
+  PlainCalls[0]++;
+}
+
+static void fOnPlainB(sSim800RecievedMassgeDone *pArgs) {
+
+  PlainCalls[1]++;
+}
+
+static void fOnOnce(sSim800RecievedMassgeDone *pArgs, void *pCtx) {
+
+  (*(int *)pCtx)++;
+  (void)fSim800_Unsubscribe(pArgs->CommandType, fOnOnce, pCtx);
+}
+
+static void fOnDeferred(sSim800RecievedMassgeDone *pArgs, void *pCtx) {
+
+  const sSim800RecievedMassgeDone *pPosted = (const sSim800RecievedMassgeDone *)pCtx;
+
+  HOST_CHECK(pArgs != pPosted && pArgs->CommandType == pPosted->CommandType && pArgs->Value == pPosted->Value);
+  HOST_CHECK(strcmp(pArgs->MassageData.Massage.c_str(), pPosted->MassageData.Massage.c_str()) == 0);
+  HOST_CHECK(strcmp(pArgs->MassageData.phoneNumber.c_str(), pPosted->MassageData.phoneNumber.c_str()) == 0);
+  Deferred++;
+}
+
+static void fOnCommandDone(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  HOST_CHECK(Result == SIM800_RES_OK);
+  CallResult = fSim800_Call("09121234567");
+  Done++;
+}
+
+static void fOnBatchDone(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  int i = (int)(intptr_t)pCtx;
+
+  Responses[i] = pResponse;
+  if(i == 0) {
+    // try everything that used to run the engine again under the second callback
+    fSim800_Run();
+    fCmd_Process();
+    HOST_CHECK(fSim800_Init() == SIM800_RES_ENGINE_BUSY);
+    HOST_CHECK(fSim800_SubmitCommand("AT+CSQ", "+CSQ:", 1000, NULL, NULL) == SIM800_RES_OK);
+  }
+  Done++;
+}
+
+static void fTest_Submit(void) {
+
+  size_t from = Modem.Commands.size();
+
+  HOST_CHECK(fSim800_SubmitCommand("AT+CSQ", "+CSQ:", 1000, fOnCommandDone, NULL) == SIM800_RES_OK);
+  HOST_CHECK(Modem.Commands.size() == from);   // returned before anything was sent
+
+  fHost_Run(100);
+  HOST_CHECK(Done == 1);
+  HOST_CHECK(CallResult == SIM800_RES_ENGINE_BUSY);
+  HOST_CHECK(Modem.Count("ATD", from) == 0);
+
+  // outside a callback the same call goes through
+  HOST_CHECK(fSim800_Call("09121234567") == SIM800_RES_OK);
+  HOST_CHECK(Modem.Count("ATD", from) == 1);
+}
+
+static void fTest_Subscriber(void) {
+
+  size_t from = Modem.Commands.size();
+  CallResult = SIM800_RES_OK;
+  Credit = 1;
+
+  HOST_CHECK(fSim800_Subscribe(eLAMP_COMMAND, fOnLamp, NULL) == SIM800_RES_OK);
+  Modem.Inbox = { "+CMGL: 4,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"\r\nlamp on" };
+  fSim800_CheckInbox();
+  fHost_Run(1000);
+
+  HOST_CHECK(CallResult == SIM800_RES_ENGINE_BUSY);
+  HOST_CHECK(Credit == 0);
+  HOST_CHECK(Modem.Count("ATD", from) == 0 && Modem.Count("AT+CUSD", from) == 0);
+  HOST_CHECK(Modem.Inbox.empty());               // the listing still finished and deleted it
+  HOST_CHECK(!Sim800.Running && !Sim800.CmdEngine.Processing);
+}
+
+static void fTest_Handlers(void) {
+
+  sSim800RecievedMassgeDone args = {};
+
+  // only what fSim800_Subscribe added comes off, once
+  HOST_CHECK(fSim800_RegisterLampEvent(fOnPlainA) == SIM800_RES_OK);
+  HOST_CHECK(fSim800_Unsubscribe(eLAMP_COMMAND, NULL, NULL) == SIM800_RES_INIT_FAIL);
+  HOST_CHECK(fSim800_Unsubscribe(eLAMP_COMMAND, fOnLamp, &args) == SIM800_RES_SUBSCRIBER_NOT_FOUND);
+  HOST_CHECK(fSim800_Unsubscribe(eLAMP_COMMAND, fOnLamp, NULL) == SIM800_RES_OK);
+  HOST_CHECK(fSim800_Unsubscribe(eLAMP_COMMAND, fOnLamp, NULL) == SIM800_RES_SUBSCRIBER_NOT_FOUND);
+
+  // a second Register replaces the first, as the single callback did
+  HOST_CHECK(fSim800_RegisterCommandEvent(fOnPlainA) == SIM800_RES_OK);
+  HOST_CHECK(fSim800_RegisterCommandEvent(fOnPlainB) == SIM800_RES_OK);
+  args.CommandType = eLAMP_COMMAND;
+  fEvent_Dispatch(&args);
+  HOST_CHECK(PlainCalls[0] == 1 && PlainCalls[1] == 1);
+
+  HOST_CHECK(fSim800_RegisterLampEvent(fOnPlainB) == SIM800_RES_OK);
+  fEvent_Dispatch(&args);
+  HOST_CHECK(PlainCalls[0] == 1 && PlainCalls[1] == 3);
+
+  // every slot of a type is free again after that
+  for(uint8_t i = 0; i < SIM800_EVENT_SUBSCRIBERS - 1; i++) {
+    HOST_CHECK(fSim800_Subscribe(eLAMP_COMMAND, fOnLamp, (void *)(intptr_t)(i + 1)) == SIM800_RES_OK);
+  }
+  HOST_CHECK(fSim800_Subscribe(eLAMP_COMMAND, fOnLamp, NULL) == SIM800_RES_SUBSCRIBERS_FULL);
+  for(uint8_t i = 0; i < SIM800_EVENT_SUBSCRIBERS - 1; i++) {
+    HOST_CHECK(fSim800_Unsubscribe(eLAMP_COMMAND, fOnLamp, (void *)(intptr_t)(i + 1)) == SIM800_RES_OK);
+  }
+
+  // a handler takes itself off from the dispatch that runs it
+  int once = 0;
+  HOST_CHECK(fSim800_Subscribe(eLAMP_COMMAND, fOnOnce, &once) == SIM800_RES_OK);
+  fEvent_Dispatch(&args);
+  fEvent_Dispatch(&args);
+  HOST_CHECK(once == 1);
+  memset(Sim800.Subscribers, 0, sizeof(Sim800.Subscribers));
+}
+
+static void fTest_CommandValue(void) {
+
+  sSim800RecievedMassgeDone args = {};
+
+  HOST_CHECK(fCommand_Parse("temperature 2147483647", &args));
+  HOST_CHECK(args.HasValue && args.Value == INT32_MAX);
+  HOST_CHECK(fCommand_Parse("temperature -2147483647", &args));
+  HOST_CHECK(args.HasValue && args.Value == -INT32_MAX);
+
+  // a number that does not fit is no value, and the next one does not stand in for it
+  HOST_CHECK(fCommand_Parse("temperature 2147483648", &args));
+  HOST_CHECK(!args.HasValue && args.Value == 0);
+  HOST_CHECK(fCommand_Parse("humidity on 99999999999 then 5", &args));
+  HOST_CHECK(args.CommandType == eHUMIDITY_COMMAND && args.Switch == eSWITCH_ON && !args.HasValue);
+}
+
+static void fTest_DeferredEvents(void) {
+
+  sSim800RecievedMassgeDone args = {};
+
+  Sim800.DeferEvents = true;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(fSim800_Subscribe(eNO_COMMAND, fOnDeferred, &args) == SIM800_RES_OK);
+
+  // the longest body the inbox hands over
+  args.CommandType = eTEMP_COMMAND;
+  args.MassageData.phoneNumber = "09121234567";
+  args.MassageData.dateTime = "25/09/12,21:32:15+14";
+  args.MassageData.Massage = std::string(SIM800_INBOX_BODY_SIZE - 1, 't').c_str();
+
+  size_t allocs = fHost_HeapAllocs();
+
+  for(int i = 0; i < 3 * SIM800_EVENT_QUEUE_LEN; i++) {
+    args.Value = i;
+    fEvent_Post(&args);
+    HOST_CHECK(fSim800_DispatchEvents(0));
+  }
+  HOST_CHECK(Deferred == 3 * SIM800_EVENT_QUEUE_LEN);
+
+  // every slot taken, one more is dropped, then each of them is handled
+  for(int i = 0; i <= SIM800_EVENT_QUEUE_LEN; i++) fEvent_Post(&args);
+  for(int i = 0; i < SIM800_EVENT_QUEUE_LEN; i++) HOST_CHECK(fSim800_DispatchEvents(0));
+  HOST_CHECK(!fSim800_DispatchEvents(0));
+  HOST_CHECK(Deferred == 4 * SIM800_EVENT_QUEUE_LEN);
+
+  HOST_CHECK(fHost_HeapAllocs() == allocs);
+
+  Sim800.DeferEvents = false;
+  memset(Sim800.Subscribers, 0, sizeof(Sim800.Subscribers));
+}
+
+static void fTest_Batch(void) {
+
+  size_t from = Modem.Commands.size();
+  Done = 0;
+
+  for(int i = 0; i < 2; i++) {
+    sSim800Cmd cmd = {};
+    strcpy(cmd.Command, i ? "AT+CSCS=\"HEX\"" : "AT+CMGF=1");
+    strcpy(cmd.Expected, ATOK);
+    cmd.TimeoutMs = 1000;
+    cmd.Flags = SIM800_CMD_FLAG_BATCHABLE;
+    cmd.pfDone = fOnBatchDone;
+    cmd.pCtx = (void *)(intptr_t)i;
+    HOST_CHECK(fCmd_Submit(&cmd) == SIM800_RES_OK);
+  }
+  fHost_Run(100);
+
+  HOST_CHECK(Modem.Count("AT+CMGF=1;+CSCS=\"HEX\"", from) == 1);
+  HOST_CHECK(Done == 2);
+  HOST_CHECK(Responses[0] == ATOK && Responses[1] == ATOK);
+  HOST_CHECK(Modem.Count("AT+CSQ", from) == 1);
+}
+
+static void fTest_Prompt(void) {
+
+  const char *pLine = NULL;
+
+  // "> " opening a line is only the data prompt while AT+CMGS waits for its body
+  Modem.Push("\r\n> 2 messages\r\n");
+  fHost_Advance(Modem.LatencyMs);
+  fRx_Fill();
+  HOST_CHECK(fRx_NextLine(&pLine) && strcmp(pLine, "> 2 messages") == 0);
+
+  size_t bodies = Modem.Bodies.size();
+  HOST_CHECK(fSim800_SMSSend("09121234567", "prompt") == SIM800_RES_OK);
+  fHost_Run(2000);
+  HOST_CHECK(Modem.Bodies.size() == bodies + 1);
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("test_engine", &Modem);
+
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(fSim800_AddPhoneNumber("09121234567", true) == SIM800_RES_OK);
+  fTest_Submit();
+  fTest_Subscriber();
+  fTest_Batch();
+  fTest_Prompt();
+  fTest_Handlers();
+  fTest_CommandValue();
+  fTest_DeferredEvents();
+
+  return fHost_End("test_engine");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
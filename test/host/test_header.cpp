@@ -0,0 +1,243 @@
+/**
+ ******************************************************************************
+ * @file           : test_header.cpp
+ * @brief          : +CMGL, +CMGR and +CDS header parsing, and the same lines
+ *                   mangled at random
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ * @verbatim
+ * Every fuzzed line is parsed from a heap block of its exact length, so a read
+ * past the terminator shows up in the sanitized build.
+ * @endverbatim
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_cdrv.cpp"
+
+#include <vector>
+
+/* Private define ------------------------------------------------------------*/
+#define FUZZ_ROUNDS                             200000UL
+
+/* Private variables ---------------------------------------------------------*/
+static const char *Captured[] = {
+  "+CMGL: 1,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"",
+  "+CMGL: 12,\"REC READ\",\"09121234567\",\"Ali, home\",\"24/03/01,03:30:00+14\"",
+  "+CMGR: \"REC READ\",\"+989121234567\",\"\",\"24/02/29,23:00:00-00\"",
+  "+CMGR: \"STO SENT\",\"09121234567\",\"\"",
+  "+CDS: 6,7,\"+989121234567\",145,\"25/09/12,21:32:15+14\",\"25/09/12,21:32:20+14\",0",
+  "+CDS: 6,255,\"09121234567\",129,\"25/09/12,21:32:15+14\",\"25/09/12,21:40:00+14\",70",
+};
+
+static const char FuzzBytes[] = "\",: +-/0123456789REC\xff";
+
+/* Private functions ---------------------------------------------------------*/
+static std::string fNumber(const sSim800SmsHeader *pHeader) {
+
+  char number[SIM800_PHONE_MAX_DIGITS + 1];
+
+  fCodec_BcdUnpack(pHeader->Number, SIM800_PHONE_BCD_LEN, number, sizeof(number));
+  return number;
+}
+
+static void fTest_Formats(void) {
+
+  sSim800SmsHeader header = {};
+  const char *pTime = NULL;
+
+  HOST_CHECK(fSmsHeader_Parse(Captured[0], &header, &pTime) == SIM800_RES_OK);
+  HOST_CHECK(header.Index == 1 && header.Status == eSMS_STAT_REC_UNREAD && header.MessageRef == 0);
+  HOST_CHECK(header.NumberValid && fNumber(&header) == "09121234567");
+  HOST_CHECK(header.Time == 1757700135);
+  HOST_CHECK(pTime != NULL && strncmp(pTime, "25/09/12,21:32:15+14", SMS_TIMESTAMP_LEN) == 0);
+
+  // a comma inside the quoted name does not move the fields after it
+  HOST_CHECK(fSmsHeader_Parse(Captured[1], &header, &pTime) == SIM800_RES_OK);
+  HOST_CHECK(header.Index == 12 && header.Status == eSMS_STAT_REC_READ);
+  HOST_CHECK(header.NumberValid && fNumber(&header) == "09121234567");
+  HOST_CHECK(header.Time == 1709251200);
+
+  // +CMGR has no index, what the caller put there stays
+  header.Index = 72;
+  HOST_CHECK(fSmsHeader_Parse(Captured[2], &header, &pTime) == SIM800_RES_OK);
+  HOST_CHECK(header.Index == 72 && header.Status == eSMS_STAT_REC_READ);
+  HOST_CHECK(header.Time == 1709247600);   // the leap day
+
+  // no time stamp at all
+  HOST_CHECK(fSmsHeader_Parse(Captured[3], &header, &pTime) == SIM800_RES_REVIEVED_SMS_INVALID);
+
+  HOST_CHECK(fSmsHeader_Parse(Captured[4], &header, NULL) == SIM800_RES_OK);
+  HOST_CHECK(header.MessageRef == 7 && header.Status == 0);
+  HOST_CHECK(header.NumberValid && fNumber(&header) == "09121234567");
+  HOST_CHECK(header.Time == 1757700135);
+
+  HOST_CHECK(fSmsHeader_Parse(Captured[5], &header, NULL) == SIM800_RES_OK);
+  HOST_CHECK(header.MessageRef == 255 && header.Status == 70);
+}
+
+static void fTest_Damaged(void) {
+
+  sSim800SmsHeader header = {};
+  const char *pTime = NULL;
+
+  // an operator name is not a number, the rest still reads
+  HOST_CHECK(fSmsHeader_Parse("+CMGL: 3,\"REC UNREAD\",\"MCI\",\"\",\"25/09/12,21:32:15+14\"", &header, &pTime) ==
+             SIM800_RES_OK);
+  HOST_CHECK(!header.NumberValid && header.Time == 1757700135);
+  HOST_CHECK(fSmsHeader_Parse("+CMGL: 3,\"REC UNREAD\",\"+98912123456a\",\"\",\"25/09/12,21:32:15+14\"", &header,
+                              NULL) == SIM800_RES_OK);
+  HOST_CHECK(!header.NumberValid);
+
+  // a time stamp that is not one
+  HOST_CHECK(fSmsHeader_Parse("+CMGR: \"REC READ\",\"09121234567\",\"\",\"25/13/12,21:32:15+14\"", &header, &pTime) ==
+             SIM800_RES_OK);
+  HOST_CHECK(header.Time == 0 && pTime != NULL);
+  HOST_CHECK(fSmsHeader_Parse("+CMGR: \"REC READ\",\"09121234567\",\"\",\"25/09/12 21:32:15+14\"", &header, NULL) ==
+             SIM800_RES_OK);
+  HOST_CHECK(header.Time == 0);
+  HOST_CHECK(fSmsHeader_Parse("+CMGR: \"REC READ\",\"09121234567\",\"\",\"25/09/12,21:32\"", &header, &pTime) ==
+             SIM800_RES_OK);
+  HOST_CHECK(header.Time == 0 && pTime == NULL);
+
+  // an unknown storage status
+  HOST_CHECK(fSmsHeader_Parse("+CMGR: \"REC LOST\",\"09121234567\",\"\",\"25/09/12,21:32:15+14\"", &header, NULL) ==
+             SIM800_RES_OK);
+  HOST_CHECK(header.Status == eSMS_STAT_UNKNOWN);
+
+  HOST_CHECK(fSmsHeader_Parse("+CMGL: x,\"REC READ\",\"09121234567\",\"\",\"25/09/12,21:32:15+14\"", &header, NULL) ==
+             SIM800_RES_REVIEVED_SMS_INVALID);
+  HOST_CHECK(fSmsHeader_Parse("+CMGL: 70000,\"REC READ\",\"09121234567\",\"\",\"25/09/12,21:32:15+14\"", &header,
+                              NULL) == SIM800_RES_REVIEVED_SMS_INVALID);
+  HOST_CHECK(fSmsHeader_Parse("+CMGR: \"REC UNREAD\",\"+98912", &header, NULL) == SIM800_RES_REVIEVED_SMS_INVALID);
+  HOST_CHECK(fSmsHeader_Parse("+CDS: 6,256,\"09121234567\",129,\"\",\"\",0", &header, NULL) ==
+             SIM800_RES_REVIEVED_SMS_INVALID);
+  HOST_CHECK(fSmsHeader_Parse("+CMTI: \"SM\",4", &header, NULL) == SIM800_RES_REVIEVED_SMS_INVALID);
+  HOST_CHECK(fSmsHeader_Parse("", &header, NULL) == SIM800_RES_REVIEVED_SMS_INVALID);
+}
+
+static void fTest_Coding(void) {
+
+  sSim800SmsHeader header = {};
+  sSmsConcatInfo concat = {};
+
+  // AT+CSDH=1 adds <fo> and <dcs> to +CMGR, +CMGL only gets <tooa>,<length>
+  HOST_CHECK(fSmsHeader_Parse("+CMGR: \"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\",145,68,0,8,"
+                              "\"+989350001500\",145,12", &header, NULL) == SIM800_RES_OK);
+  HOST_CHECK(header.HasCoding && header.FirstOctet == 68 && header.Dcs == 8);
+  HOST_CHECK(header.NumberValid && header.Time == 1757700135);
+  HOST_CHECK(fSmsHeader_Parse("+CMGL: 1,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\",145,4", &header,
+                              NULL) == SIM800_RES_OK);
+  HOST_CHECK(!header.HasCoding);
+  HOST_CHECK(fSmsHeader_Parse(Captured[2], &header, NULL) == SIM800_RES_OK && !header.HasCoding);
+
+  HOST_CHECK(fInbox_Alphabet(0x00) == SMS_ALPHABET_GSM7 && fInbox_Alphabet(0x08) == SMS_ALPHABET_UCS2);
+  HOST_CHECK(fInbox_Alphabet(0x04) == SMS_ALPHABET_8BIT && fInbox_Alphabet(0x19) == SMS_ALPHABET_UCS2);
+  HOST_CHECK(fInbox_Alphabet(0xF4) == SMS_ALPHABET_8BIT && fInbox_Alphabet(0xF1) == SMS_ALPHABET_GSM7);
+  HOST_CHECK(fInbox_Alphabet(0xE0) == SMS_ALPHABET_UCS2 && fInbox_Alphabet(0xC8) == SMS_ALPHABET_GSM7);
+  HOST_CHECK(fInbox_Alphabet(0x0C) == SMS_ALPHABET_GSM7);
+
+  // GSM-7 starting with '@' (septet 00) looks like UCS2 to the guess, not to the DCS
+  HOST_CHECK(std::string(fInbox_DecodeBody("00310032", &header, &concat)) == "12");
+  header.HasCoding = true;
+  header.FirstOctet = 0x04;
+  header.Dcs = 0x00;
+  HOST_CHECK(std::string(fInbox_DecodeBody("00310032", &header, &concat)) == "@1@2" && concat.Total == 0);
+
+  header.Dcs = 0x08;
+  HOST_CHECK(std::string(fInbox_DecodeBody("00680069", &header, &concat)) == "hi");
+
+  // a port address header is skipped, the concatenation element is found behind it
+  header.FirstOctet = 0x44;
+  HOST_CHECK(std::string(fInbox_DecodeBody("060504123456780068", &header, &concat)) == "h" && concat.Total == 0);
+  HOST_CHECK(std::string(fInbox_DecodeBody("0B05041234567800030702010068", &header, &concat)) == "h");
+  HOST_CHECK(concat.Ref == 7 && concat.Total == 2 && concat.Part == 1);
+  HOST_CHECK(std::string(fInbox_DecodeBody("0C050412345678080401020301" "0068", &header, &concat)) == "h");
+  HOST_CHECK(concat.Ref == 0x0102 && concat.Total == 3 && concat.Part == 1);
+
+  // GSM-7 septets after the header start on a septet boundary
+  header.Dcs = 0x00;
+  sSim800SmsHeader plain = {};
+  std::string guessed = fInbox_DecodeBody("050003070201CC69791904", &plain, &concat);
+  HOST_CHECK(std::string(fInbox_DecodeBody("050003070201CC69791904", &header, &concat)) == guessed);
+  HOST_CHECK(concat.Total == 2 && concat.Part == 1);
+
+  // a header longer than the body is not taken, 8-bit data stays hex
+  header.Dcs = 0x08;
+  fInbox_DecodeBody("0500030702", &header, &concat);
+  HOST_CHECK(concat.Total == 0);
+  header.FirstOctet = 0x04;
+  header.Dcs = 0x04;
+  HOST_CHECK(std::string(fInbox_DecodeBody("0102FF", &header, &concat)) == "0102FF");
+}
+
+/**
+ * @brief Replaces, drops, inserts and cuts bytes of the captured lines. Whatever
+ *        comes out, the parser stays inside the line and reports only what it
+ *        could read.
+ *
+ */
+static void fTest_Fuzz(void) {
+
+  uint32_t seed = 22;
+  unsigned long ok = 0;
+
+  for(unsigned long round = 0; round < FUZZ_ROUNDS; round++) {
+
+    seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+    std::string line = Captured[seed % (sizeof(Captured) / sizeof(Captured[0]))];
+
+    for(int edits = 1 + (seed >> 8) % 4; edits > 0 && !line.empty(); edits--) {
+
+      seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+      size_t at = (seed >> 4) % line.size();
+      char c = FuzzBytes[(seed >> 16) % (sizeof(FuzzBytes) - 1)];
+
+      switch(seed % 4) {
+        case 0: line[at] = c; break;
+        case 1: line.erase(at, 1); break;
+        case 2: line.insert(at, 1, c); break;
+        default: line.resize(at); break;
+      }
+    }
+
+    std::vector<char> text(line.begin(), line.end());
+    text.push_back('\0');
+    const char *pEnd = &text.back();
+
+    sSim800SmsHeader header = {};
+    const char *pTime = NULL;
+    if(fSmsHeader_Parse(text.data(), &header, &pTime) != SIM800_RES_OK) continue;
+    ok++;
+
+    if(pTime != NULL) HOST_CHECK(pTime > text.data() && pTime + SMS_TIMESTAMP_LEN <= pEnd);
+    if(header.NumberValid) HOST_CHECK(fNumber(&header).size() == SIM800_PHONE_MAX_DIGITS && fNumber(&header)[0] == '0');
+    // 2000 to the end of 2099, give or take a zone
+    if(header.Time != 0) HOST_CHECK(header.Time >= 946684800u - 2 * 86400 && header.Time < 4102444800u + 2 * 86400);
+  }
+
+  HOST_CHECK(ok > FUZZ_ROUNDS / 10);
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("test_header", NULL);
+
+  fTest_Formats();
+  fTest_Damaged();
+  fTest_Coding();
+  fTest_Fuzz();
+
+  return fHost_End("test_header");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,256 @@
+/**
+ ******************************************************************************
+ * @file           : test_modem.cpp
+ * @brief          : The driver against the scripted modem: init, SMS out and
+ *                   in, USSD, with latency and injected failures
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+static int Events;
+static sSim800RecievedMassgeDone LastEvent;
+static uint16_t DoneTicket;
+static eSim800SmsStatus DoneStatus;
+static int DoneCalls;
+
+/* Private functions ---------------------------------------------------------*/
+static void fOnCommand(sSim800RecievedMassgeDone *pArgs) {
+
+  Events++;
+  LastEvent = *pArgs;
+}
+
+static void fOnSmsDone(uint16_t Ticket, eSim800SmsStatus Status, void *pCtx) {
+
+  HOST_CHECK(pCtx == &DoneTicket);
+  DoneTicket = Ticket;
+  DoneStatus = Status;
+  DoneCalls++;
+}
+
+static void fTest_Init(void) {
+
+  // nothing is queued before the driver is up
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", "hello", eSMS_PRIORITY_NORMAL, NULL) == SIM800_RES_INIT_FAIL);
+  HOST_CHECK(fSim800_SMSSendToAllEx("hello", eSMS_PRIORITY_ALARM, NULL) == SIM800_RES_INIT_FAIL);
+  HOST_CHECK(Sim800.QueueCount == 0);
+
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(Modem.Count("AT+CPIN?") == 1);
+  HOST_CHECK(Modem.ReportsOn == Sim800.EnableDeliveryReport);
+
+  // +CMGR carries <fo> and <dcs>, the body is decoded by them
+  size_t details = 0;
+  for(const std::string &line : Modem.Commands) details += (line.find("+CSDH=1") != std::string::npos);
+  HOST_CHECK(details == 1);
+
+  // a SIM asking for its PIN is reported as such
+  Modem.Script = [](const std::string &Line) {
+    if(Line != "AT+CPIN?") return false;
+    Modem.Push("\r\n+CPIN: SIM PIN\r\n\r\nOK\r\n");
+    return true;
+  };
+  HOST_CHECK(fSim800_Init() == SIM800_RES_SIM_PIN_REQUIRED);
+  Modem.Script = nullptr;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+}
+
+static void fTest_SmsOut(void) {
+
+  size_t bodies = Modem.Bodies.size();
+  size_t from = Modem.Commands.size();
+
+  HOST_CHECK(fSim800_SMSSend("09121234567", "hello") == SIM800_RES_OK);
+  fHost_Run(3000);
+
+  HOST_CHECK(Modem.Bodies.size() == bodies + 1);
+  HOST_CHECK(Modem.Bodies.back() == "00680065006C006C006F");
+  HOST_CHECK(Modem.Count("AT+CMGS=\"+989121234567\"", from) == 1);
+  HOST_CHECK(Sim800.SmsTx.State == eSMS_TX_IDLE);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+
+  // the done callback of a ticket, and of one already done
+  uint16_t ticket = 0;
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", "hello", eSMS_PRIORITY_NORMAL, &ticket) == SIM800_RES_OK);
+  HOST_CHECK(fSim800_SMSOnDone(ticket, fOnSmsDone, &DoneTicket) == SIM800_RES_OK);
+  fHost_Run(3000);
+  HOST_CHECK(DoneCalls == 1 && DoneTicket == ticket && DoneStatus == eSMS_STATUS_DELIVERED);
+  HOST_CHECK(fSim800_SMSOnDone(ticket, fOnSmsDone, &DoneTicket) == SIM800_RES_OK);
+  HOST_CHECK(DoneCalls == 2);
+  HOST_CHECK(fSim800_SMSOnDone(ticket + 1, fOnSmsDone, &DoneTicket) == SIM800_RES_TICKET_NOT_FOUND);
+}
+
+static void fTest_SmsLong(void) {
+
+  std::string alert;
+  while(alert.size() < 200) alert += "FIRE zone 3, smoke 41%. ";
+  alert.resize(200);
+  size_t bodies = Modem.Bodies.size();
+  size_t from = Modem.Commands.size();
+  uint16_t ticket = 0;
+  bool done = false;
+
+  // longer than one text mode SMS: two PDU parts although UsePduMode is off
+  HOST_CHECK(!Sim800.UsePduMode);
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", alert.c_str(), eSMS_PRIORITY_ALARM, &ticket) == SIM800_RES_OK);
+  fHost_Run(5000);
+  HOST_CHECK(Modem.Bodies.size() == bodies + 2);
+  HOST_CHECK(Modem.Count("AT+CMGF=0", from) == 1);
+  HOST_CHECK(fSim800_SMSStatus(ticket, &done) == eSMS_STATUS_DELIVERED && done);
+
+  // and a short one after it goes in text mode again
+  HOST_CHECK(fSim800_SMSSend("09121234567", "hello") == SIM800_RES_OK);
+  fHost_Run(3000);
+  HOST_CHECK(Modem.Bodies.back() == "00680065006C006C006F");
+
+  // more parts than SIM800_SMS_MAX_PARTS is refused up front, not cut short
+  std::string mixed = "\xd8\xaf" + std::string(SIM800_SMS_MAX_PARTS * SIM800_UCS2_CONCAT_CHARS, 'a');
+  HOST_CHECK(fSim800_SMSSend("09121234567", mixed.c_str()) == SIM800_RES_SMS_TOO_LONG);
+  HOST_CHECK(fSim800_SMSSendToAllEx(mixed.c_str(), eSMS_PRIORITY_NORMAL, NULL) == SIM800_RES_SMS_TOO_LONG);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+}
+
+static void fTest_SmsIn(void) {
+
+  int before = Events;
+  Modem.Inbox = { "+CMGL: 3,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"\r\nLamp on" };
+  fSim800_CheckInbox();
+  fHost_Run(1000);
+
+  HOST_CHECK(Events == before + 1);
+  HOST_CHECK(LastEvent.CommandType == eLAMP_COMMAND && LastEvent.Switch == eSWITCH_ON);
+  HOST_CHECK(Modem.Inbox.empty());
+
+  // announced with +CMTI and read with +CMGR
+  Modem.Inbox = { "+CMGL: 7,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"\r\nfire off" };
+  Modem.Push("\r\n+CMTI: \"SM\",7\r\n");
+  fHost_Run(500);
+  HOST_CHECK(Events == before + 2);
+  HOST_CHECK(LastEvent.CommandType == eFIRE_COMMAND && LastEvent.Switch == eSWITCH_OFF);
+  HOST_CHECK(Modem.Inbox.empty());
+
+  // two GSM-7 parts in the HEX character set, the second one listed first
+  Modem.Inbox = { "+CMGL: 8,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"\r\n050003070202DE6633",
+                  "+CMGL: 9,\"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"\r\n050003070201CC69791904" };
+  fSim800_CheckInbox();
+  fHost_Run(1000);
+  HOST_CHECK(Events == before + 3);
+  HOST_CHECK(LastEvent.MassageData.Massage == "fire off");
+  HOST_CHECK(LastEvent.CommandType == eFIRE_COMMAND && LastEvent.Switch == eSWITCH_OFF);
+}
+
+static void fOnCredit(sim800_res_t Result, uint32_t Credit, void *pCtx) {
+
+  HOST_CHECK(Result == SIM800_RES_OK);
+  *(uint32_t *)pCtx = Credit;
+}
+
+static void fTest_Ussd(void) {
+
+  HOST_CHECK(fSim800_CheckCredit() == 6873);
+
+  // the same dialogue without blocking: the caller returns at once, fSim800_Run drives it
+  uint32_t credit = 0;
+  size_t from = Modem.Commands.size();
+  uint32_t start = fHost_Millis();
+  HOST_CHECK(fSim800_CheckCreditAsync(fOnCredit, &credit) == SIM800_RES_OK);
+  HOST_CHECK(fHost_Millis() == start);
+  HOST_CHECK(fSim800_CheckCreditAsync(fOnCredit, &credit) == SIM800_RES_CREDIT_BUSY);
+
+  // an SMS queued meanwhile is not held up behind the menu pause
+  size_t bodies = Modem.Bodies.size();
+  bool sentFirst = false;
+  HOST_CHECK(fSim800_SMSSend("09121234567", "hello") == SIM800_RES_OK);
+  for(int i = 0; i < 20000 && credit == 0; i++) {
+    fHost_Run(1);
+    sentFirst |= (Modem.Bodies.size() > bodies && credit == 0);
+  }
+  HOST_CHECK(sentFirst && credit == 6873);
+  HOST_CHECK(Modem.Count("AT+CUSD=", from) == 5);
+  HOST_CHECK(!Sim800.Credit.Busy);
+  fHost_Run(3000);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+}
+
+static void fTest_Latency(void) {
+
+  Modem.LatencyMs = 400;
+  Modem.JitterMs = 300;
+  size_t bodies = Modem.Bodies.size();
+
+  for(int i = 0; i < 3; i++) {
+    HOST_CHECK(fSim800_SMSSend("09121234567", "slow") == SIM800_RES_OK);
+  }
+  fHost_Run(30000);
+
+  HOST_CHECK(Modem.Bodies.size() == bodies + 3);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+  Modem.LatencyMs = 5;
+  Modem.JitterMs = 0;
+}
+
+static void fTest_Failures(void) {
+
+  // one command in five refused: retries get every message out
+  Modem.Seed(1);
+  Modem.FailPermille = 200;
+  Sim800.EnableDeliveryReport = false;
+  size_t bodies = Modem.Bodies.size();
+
+  for(int i = 0; i < 6; i++) {
+    HOST_CHECK(fSim800_SMSSend("09121234567", "retry") == SIM800_RES_OK);
+  }
+  fHost_Run(120000);
+
+  HOST_CHECK(Modem.Bodies.size() >= bodies + 6);
+  HOST_CHECK(Sim800.QueueCount == 0);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+
+  // a modem that refuses everything: the message fails and the slot comes back
+  Modem.FailPermille = 1000;
+  uint16_t ticket = 0;
+  bool done = false;
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", "lost", eSMS_PRIORITY_NORMAL, &ticket) == SIM800_RES_OK);
+  fHost_Run(120000);
+  HOST_CHECK(fSim800_SMSStatus(ticket, &done) == eSMS_STATUS_FAILED && done);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+
+  Modem.FailPermille = 0;
+  Sim800.EnableDeliveryReport = true;
+  fHost_Run(5000);
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("test_modem", &Modem);
+  Sim800.EnableDeliveryReport = true;
+
+  fTest_Init();
+  fSim800_RegisterCommandEvent(fOnCommand);
+  HOST_CHECK(fSim800_AddPhoneNumber("09121234567", true) == SIM800_RES_OK);
+
+  fTest_SmsOut();
+  fTest_SmsLong();
+  fTest_SmsIn();
+  fTest_Ussd();
+  fTest_Latency();
+  fTest_Failures();
+
+  return fHost_End("test_modem");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
@@ -0,0 +1,117 @@
+/**
+ ******************************************************************************
+ * @file           : test_urc.cpp
+ * @brief          : Unsolicited codes arriving while commands are in flight
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+static int Rings;
+static int Done;
+static std::string Response;
+
+/* Private functions ---------------------------------------------------------*/
+static void fOnRing(const char *pLine, void *pCtx) {
+
+  Rings++;
+}
+
+static void fOnDone(sim800_res_t Result, const char *pResponse, void *pCtx) {
+
+  HOST_CHECK(Result == SIM800_RES_OK);
+  Response = pResponse;
+  Done++;
+}
+
+static void fTest_UssdWithUrcs(void) {
+
+  size_t from = Modem.Commands.size();
+
+  // a message announcement carrying the text the USSD step waits for arrives first
+  Modem.Script = [](const std::string &Line) {
+    if(Line != "AT+CUSD=1,\"*555*4*3#\"") return false;
+    Modem.Push("\r\n+CMTI: \"SM\",72\r\n\r\nOK\r\n");
+    Modem.Push("\r\n+CUSD: 0, \"1:Farsi 2:English 72\", 15\r\n", 300);
+    return true;
+  };
+  Modem.ReadMessage = [](int Index) {
+    return std::string("+CMGR: \"REC UNREAD\",\"+989121234567\",\"\",\"25/09/12,21:32:15+14\"\r\nhello");
+  };
+
+  HOST_CHECK(fSim800_CheckCredit() == 6873);
+  fHost_Run(1000);
+  HOST_CHECK(Modem.Count("AT+CMGR=72", from) == 1);   // the +CMTI reached its handler
+
+  Modem.Script = nullptr;
+  Modem.ReadMessage = nullptr;
+}
+
+static void fTest_QueryWithUrcs(void) {
+
+  Done = 0;
+
+  // "+CSQ:" must open the line, a RING or report mentioning it is not the answer
+  Modem.Script = [](const std::string &Line) {
+    if(Line != "AT+CSQ") return false;
+    Modem.Push("\r\nRING\r\n\r\nNO CARRIER +CSQ: 1\r\n");
+    Modem.Push("\r\n+CSQ: 21,0\r\n\r\nOK\r\n", 50);
+    return true;
+  };
+  HOST_CHECK(fSim800_SubmitCommand("AT+CSQ", "+CSQ:", 1000, fOnDone, NULL) == SIM800_RES_OK);
+  fHost_Run(200);
+
+  HOST_CHECK(Done == 1 && Response == "+CSQ: 21,0");
+  HOST_CHECK(Rings == 1);
+  Modem.Script = nullptr;
+}
+
+static void fTest_ReportDuringSend(void) {
+
+  uint16_t ticket = 0;
+  bool done = false;
+
+  // the report of the first message lands between the second one's prompt and +CMGS
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", "one", eSMS_PRIORITY_NORMAL, &ticket) == SIM800_RES_OK);
+  HOST_CHECK(fSim800_SMSSend("09121234567", "two") == SIM800_RES_OK);
+  Modem.ReportMs = 30;
+  fHost_Run(3000);
+  Modem.ReportMs = 200;
+
+  HOST_CHECK(fSim800_SMSStatus(ticket, &done) == eSMS_STATUS_DELIVERED && done);
+  HOST_CHECK(Sim800.FreeCount == SIM800_SMS_QUEUE_SIZE);
+  for(int i = 0; i < SIM800_SMS_INFLIGHT_SIZE; i++) {
+    HOST_CHECK(Sim800.InFlight[i].State == eREPORT_FREE);
+  }
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("test_urc", &Modem);
+  Sim800.EnableDeliveryReport = true;
+
+  HOST_CHECK(fSim800_RegisterUrcHandler("RING", fOnRing, NULL) == SIM800_RES_OK);
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(fSim800_AddPhoneNumber("09121234567", true) == SIM800_RES_OK);
+
+  fTest_UssdWithUrcs();
+  fTest_QueryWithUrcs();
+  fTest_ReportDuringSend();
+
+  return fHost_End("test_urc");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/
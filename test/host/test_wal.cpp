@@ -0,0 +1,279 @@
+/**
+ ******************************************************************************
+ * @file           : test_wal.cpp
+ * @brief          : Flash logs: failed writes, damaged records, power cut at
+ *                   every step of a rewrite, and the queue log across a reset
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2025 DiodeGroup.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component
+ *
+ ******************************************************************************
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "host_test.h"
+#include "Sim800_wal.h"
+#include "SPIFFS.h"
+
+#include <filesystem>
+
+/* Private variables ---------------------------------------------------------*/
+static SimModem Modem;
+static std::vector<uint16_t> Seen;
+
+/* Private functions ---------------------------------------------------------*/
+static void fOnRecord(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx) {
+
+  HOST_CHECK(Len == 4 && memcmp(pData, &Ticket, 2) == 0);
+  Seen.push_back(Ticket);
+}
+
+static bool fAppend(sSim800Wal *pWal, uint16_t Ticket) {
+
+  uint8_t data[4] = { (uint8_t)Ticket, (uint8_t)(Ticket >> 8), 0xA5, 0x5A };
+
+  return fWal_Append(pWal, 1, Ticket, data, sizeof(data));
+}
+
+static void fCopy(uint8_t Type, uint16_t Ticket, const uint8_t *pData, uint16_t Len, void *pCtx) {
+
+  HOST_CHECK(fWal_Append((sSim800Wal *)pCtx, Type, Ticket, pData, Len));
+}
+
+static std::vector<uint16_t> fTickets(int From, int To) {
+
+  std::vector<uint16_t> tickets;
+  for(int i = From; i <= To; i++) tickets.push_back(i);
+  return tickets;
+}
+
+static void fTest_FailedFlush(void) {
+
+  sSim800Wal wal, out;
+
+  fWal_Open(&wal, "/test.log", "/test.tmp");
+  for(int i = 1; i <= 3; i++) HOST_CHECK(fAppend(&wal, i));
+  HOST_CHECK(fWal_Flush(&wal));
+  uint32_t size = wal.Size;
+
+  // the flash fills up part way through the next batch
+  for(int i = 4; i <= 5; i++) HOST_CHECK(fAppend(&wal, i));
+  SPIFFS.WriteBudget = 10;
+  HOST_CHECK(!fWal_Flush(&wal));
+  SPIFFS.WriteBudget = -1;
+  HOST_CHECK(wal.Damaged && wal.Size == size && wal.Used > 0);
+
+  // nothing goes behind the torn record, the batch stays and grows
+  HOST_CHECK(fAppend(&wal, 6));
+  HOST_CHECK(!fWal_Flush(&wal));
+  Seen.clear();
+  HOST_CHECK(fWal_Scan("/test.log", fOnRecord, NULL) == size);
+  HOST_CHECK(Seen == fTickets(1, 3));
+  Seen.clear();
+  fWal_ScanLog(&wal, fOnRecord, NULL);
+  HOST_CHECK(Seen == fTickets(1, 6));
+
+  // the rewrite takes the file and the batch, and the log is writable again
+  fWal_BeginRewrite(&out, "/test.tmp");
+  fWal_ScanLog(&wal, fCopy, &out);
+  HOST_CHECK(fWal_CommitRewrite(&wal, &out));
+  HOST_CHECK(!wal.Damaged && wal.Used == 0);
+  HOST_CHECK(fAppend(&wal, 7) && fWal_Flush(&wal));
+  Seen.clear();
+  HOST_CHECK(fWal_Scan("/test.log", fOnRecord, NULL) == wal.Size);
+  HOST_CHECK(Seen == fTickets(1, 7));
+
+  fWal_Clear(&wal);
+  HOST_CHECK(!SPIFFS.exists("/test.log"));
+}
+
+/**
+ * @brief Log /test.log with records 1 to Count on flash
+ *
+ */
+static void fWal_Make(sSim800Wal *pWal, int Count) {
+
+  SPIFFS.remove("/test.log");
+  SPIFFS.remove("/test.tmp");
+  fWal_Open(pWal, "/test.log", "/test.tmp");
+  for(int i = 1; i <= Count; i++) HOST_CHECK(fAppend(pWal, i));
+  HOST_CHECK(fWal_Flush(pWal));
+}
+
+static std::vector<uint16_t> fWal_Read(void) {
+
+  Seen.clear();
+  fWal_Scan("/test.log", fOnRecord, NULL);
+  return Seen;
+}
+
+static void fTest_Damaged(void) {
+
+  sSim800Wal wal;
+  const long record = SIM800_WAL_HEADER_LEN + 4 + SIM800_WAL_CRC_LEN;
+
+  // a flipped bit in the third record costs that record only
+  fWal_Make(&wal, 6);
+  FILE *f = fopen(SPIFFS.path("/test.log").c_str(), "r+b");
+  fseek(f, 2 * record + SIM800_WAL_HEADER_LEN + 1, SEEK_SET);
+  fputc(0xFF, f);
+  fclose(f);
+  Seen.clear();
+  HOST_CHECK(fWal_Scan("/test.log", fOnRecord, NULL) == wal.Size - record);
+  HOST_CHECK(Seen == std::vector<uint16_t>({ 1, 2, 4, 5, 6 }));
+
+  // and so does a length that runs past the end of the file
+  fWal_Make(&wal, 6);
+  f = fopen(SPIFFS.path("/test.log").c_str(), "r+b");
+  fseek(f, record + 3, SEEK_SET);
+  fputc(0xF0, f);
+  fclose(f);
+  HOST_CHECK(fWal_Read() == std::vector<uint16_t>({ 1, 3, 4, 5, 6 }));
+
+  // a record cut short at the end, and garbage after the last one
+  fWal_Make(&wal, 6);
+  std::filesystem::resize_file(SPIFFS.path("/test.log"), wal.Size - 3);
+  HOST_CHECK(fWal_Read() == fTickets(1, 5));
+  f = fopen(SPIFFS.path("/test.log").c_str(), "ab");
+  const char garbage[] = "\x01\x09\x00\x04\x00garbage";
+  fwrite(garbage, 1, sizeof(garbage) - 1, f);
+  fclose(f);
+  HOST_CHECK(fWal_Read() == fTickets(1, 5));
+}
+
+/**
+ * @brief Power cut at every write, remove and rename of a rewrite, then again at
+ *        a random step of the restart. What comes back is the old log or the new
+ *        one, never a mix or nothing.
+ *
+ */
+static void fTest_KillPoints(void) {
+
+  const std::vector<uint16_t> before = fTickets(1, 6);
+  const std::vector<uint16_t> after = { 2, 4, 6, 7 };
+  uint32_t seed = 7;
+  int crashes = 0, olds = 0, news = 0;
+
+  for(long kill = 0; ; kill++) {
+
+    bool crashed = false;
+
+    for(int round = 0; round < 20; round++) {
+
+      sSim800Wal wal, out;
+      crashed = false;
+
+      fWal_Make(&wal, 6);
+      SPIFFS.CrashAfter = kill;
+      try {
+        fWal_BeginRewrite(&out, "/test.tmp");
+        for(int i = 2; i <= 6; i += 2) HOST_CHECK(fAppend(&out, i));
+        HOST_CHECK(fAppend(&out, 7));
+        HOST_CHECK(fWal_CommitRewrite(&wal, &out));
+      } catch(const HostCrash &) {
+        crashed = true;
+      }
+
+      // between removing the old log and renaming the new one into place
+      if(kill == 3) HOST_CHECK(crashed && !SPIFFS.exists("/test.log") && SPIFFS.exists("/test.tmp"));
+
+      seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+      SPIFFS.CrashAfter = (long)(seed % 4) - 1;
+      try {
+        fWal_Open(&wal, "/test.log", "/test.tmp");
+      } catch(const HostCrash &) {
+        SPIFFS.CrashAfter = -1;
+        fWal_Open(&wal, "/test.log", "/test.tmp");
+      }
+      SPIFFS.CrashAfter = -1;
+
+      std::vector<uint16_t> seen = fWal_Read();
+      HOST_CHECK(seen == before || seen == after);
+      HOST_CHECK(!SPIFFS.exists("/test.tmp"));
+      crashes += crashed;
+      olds += (seen == before);
+      news += (seen == after);
+
+      // and it takes records again
+      HOST_CHECK(fAppend(&wal, 8) && fWal_Flush(&wal));
+      seen.push_back(8);
+      HOST_CHECK(fWal_Read() == seen);
+
+      if(!crashed) break;
+    }
+
+    if(!crashed) break;   // the rewrite takes fewer steps than that
+  }
+
+  HOST_CHECK(crashes > 0 && olds > 0 && news > 0);
+}
+
+static void fTest_QueueLogFull(void) {
+
+  // nothing is sent, the log is all there is once the driver starts again
+  for(int i = 0; i < 3; i++) {
+    HOST_CHECK(fSim800_SMSSend("09121234567", "Lamp turned on") == SIM800_RES_OK);
+  }
+
+  // the alarm's flush and the rewrite after it both run out of flash
+  SPIFFS.WriteBudget = 20;
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", "Fire!", eSMS_PRIORITY_ALARM, NULL) == SIM800_RES_OK);
+  HOST_CHECK(Sim800.QueueLog.Damaged);
+
+  // room again: the next alarm rewrites the log with everything in it
+  SPIFFS.WriteBudget = -1;
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", "CO!", eSMS_PRIORITY_ALARM, NULL) == SIM800_RES_OK);
+  HOST_CHECK(!Sim800.QueueLog.Damaged && Sim800.QueueLog.Used == 0);
+
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(Sim800.QueueCount == 5);
+  HOST_CHECK(Sim800.SmsJobs[eSMS_PRIORITY_ALARM].Count == 2);
+}
+
+static void fTest_QueueLogLong(void) {
+
+  std::string text(SIM800_SMS_TEXT_MAX_LEN, 'a');
+  uint16_t queued = Sim800.QueueCount;
+
+  // a multipart message of every part is one record, one byte more is not taken
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", (text + "a").c_str(), eSMS_PRIORITY_ALARM, NULL) ==
+             SIM800_RES_SMS_TOO_LONG);
+  HOST_CHECK(fSim800_SMSSendEx("09121234567", text.c_str(), eSMS_PRIORITY_ALARM, NULL) == SIM800_RES_OK);
+  HOST_CHECK(Sim800.QueueLog.Used == 0 && !Sim800.QueueLog.Damaged);
+
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(Sim800.QueueCount == queued + 1);
+
+  int restored = 0;
+  for(uint8_t i = 0; i < SIM800_SMS_QUEUE_SIZE; i++) {
+    const sSmsMessage *pMsg = &Sim800.SmsQueue[i];
+    restored += pMsg->RefCount > 0 && pMsg->TextLen == text.size() && text == pMsg->Text &&
+                pMsg->Segments == SIM800_SMS_MAX_PARTS;
+  }
+  HOST_CHECK(restored == 1);
+}
+
+/* Main ----------------------------------------------------------------------*/
+int main(void) {
+
+  fHost_Begin("test_wal", &Modem);
+
+  fTest_FailedFlush();
+  fTest_Damaged();
+  fTest_KillPoints();
+
+  Sim800.PersistQueue = true;
+  HOST_CHECK(fSim800_Init() == SIM800_RES_OK);
+  HOST_CHECK(fSim800_AddPhoneNumber("09121234567", true) == SIM800_RES_OK);
+  fTest_QueueLogFull();
+  fTest_QueueLogLong();
+
+  return fHost_End("test_wal");
+}
+
+/************************ © COPYRIGHT DiodeGroup *****END OF FILE****/